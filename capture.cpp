@@ -0,0 +1,113 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Capturing Realsense frames on separate thread
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include "capture.h"
+
+#include <iostream>
+
+using namespace std;
+using namespace std::chrono;
+
+int capture_config_parse(const options &opts, capture_config *config)
+{
+	//synthetic and recording sources with --realtime=0 are paced by the capture thread,
+	//not by encoding, only blocking ring keeps all of their frames
+	const bool paced_by_capture = options_get(opts, "source", "live") != "live" && options_get_int(opts, "realtime", 1) == 0;
+	const string policy = options_get(opts, "ring", paced_by_capture ? "block" : "drop");
+
+	if(policy == "drop")
+		config->policy = RING_DROP_OLDEST;
+	else if(policy == "block")
+		config->policy = RING_BLOCK;
+	else
+	{
+		cerr << "unknown ring policy '" << policy << "', valid policies: 'drop', 'block'" << endl;
+		return -1;
+	}
+
+	if(paced_by_capture && config->policy == RING_DROP_OLDEST)
+	{
+		cerr << "--ring=drop would lose frames of --realtime=0 source, use --ring=block (the default then)" << endl;
+		return -1;
+	}
+
+	config->ring_size = options_get_int(opts, "ring-size", 2);
+
+	if(config->ring_size < 0)
+	{
+		cerr << "ring size has to be non-negative (0 for capturing on encoding thread)" << endl;
+		return -1;
+	}
+
+	return 0;
+}
+
+frame_capture::frame_capture(frame_source &source, const capture_config &config) :
+	source(source), config(config), ring(config.ring_size, config.policy), stopping(false)
+{
+	if(config.ring_size > 0)
+		thread = std::thread(&frame_capture::run, this);
+}
+
+frame_capture::~frame_capture()
+{
+	stopping = true;
+	ring.close();
+
+	if(thread.joinable())
+		thread.join();
+}
+
+void frame_capture::run()
+{
+	try
+	{
+		while(!stopping)
+		{
+			captured_frameset captured;
+			captured.frameset = source.wait_for_frames();
+			captured.captured = steady_clock::now();
+
+			if(!ring.push(captured))
+				break;
+		}
+	}
+	catch(const exception &e)
+	{
+		cerr << "capture failed: " << e.what() << endl;
+	}
+
+	ring.close();
+}
+
+bool frame_capture::wait_for_frames(captured_frameset *out)
+{
+	if(config.ring_size == 0)
+	{  //synchronous capture on this thread, fresh timestamps like from the ring
+		*out = captured_frameset();
+		out->frameset = source.wait_for_frames();
+		out->captured = out->dequeued = steady_clock::now();
+		return true;
+	}
+
+	if(!ring.pop(out))
+		return false;
+
+	out->dequeued = steady_clock::now();
+	return true;
+}
+
+uint64_t frame_capture::dropped() const
+{
+	return ring.dropped();
+}
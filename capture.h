@@ -0,0 +1,69 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Capturing Realsense frames on separate thread
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "frame_ring.h"
+#include "frame_source.h"
+#include "options.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+struct capture_config
+{
+	int ring_size; //0 captures synchronously on encoding thread (no capture thread)
+	RingPolicy policy;
+};
+
+//--ring=drop/block --ring-size=N, returns -1 on invalid input
+//the default is block for non-live --realtime=0 source (drop is rejected with it)
+int capture_config_parse(const options &opts, capture_config *config);
+
+struct captured_frameset
+{
+	rs2::frameset frameset;
+	std::chrono::steady_clock::time_point captured; //wait_for_frames returned
+	std::chrono::steady_clock::time_point dequeued; //encoding thread received the frameset
+	std::chrono::steady_clock::time_point processed; //depth post-processing end (if any)
+	std::chrono::steady_clock::time_point aligned; //alignment end (if any)
+	std::chrono::steady_clock::time_point roi; //texture region of interest map end (if any)
+};
+
+//runs realsense wait_for_frames on its own thread feeding bounded ring
+//so that slow encoding doesn't stall the capture
+class frame_capture
+{
+public:
+	frame_capture(frame_source &source, const capture_config &config);
+	~frame_capture();
+
+	//blocks until the next frameset, false on capture failure
+	bool wait_for_frames(captured_frameset *out);
+
+	//framesets dropped by the ring (encoding too slow)
+	uint64_t dropped() const;
+
+private:
+	void run();
+
+	frame_source &source;
+	const capture_config config;
+	frame_ring<captured_frameset> ring;
+	std::atomic<bool> stopping;
+	std::thread thread;
+};
+
+#endif
@@ -0,0 +1,102 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Chroma planes for luma only streams (shared constant or carrying infrared)
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include "chroma_plane.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <mutex>
+#include <new>
+#include <vector>
+
+struct chroma_plane
+{
+	uint8_t *data;
+	size_t size;
+};
+
+//planes of one value, the last is the largest
+//older planes are kept, streams may still use them
+struct chroma_planes
+{
+	std::vector<chroma_plane> planes;
+};
+
+static std::mutex pool_mutex;
+static chroma_planes nv12_planes, p010le_planes;
+
+static uint8_t *chroma_plane_alloc(size_t size, uint8_t first, uint8_t second)
+{
+	void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if(data == MAP_FAILED)
+		throw std::bad_alloc();
+
+	uint8_t *bytes = (uint8_t*)data;
+
+	//interleaved bytes, little endian for 16 bit
+	for(size_t i = 0; i + 1 < size; i += 2)
+		bytes[i] = first, bytes[i + 1] = second;
+
+	mprotect(data, size, PROT_READ);
+
+	return bytes;
+}
+
+static uint8_t *chroma_plane_get(chroma_planes *pool, int stride, int height, uint8_t first, uint8_t second)
+{
+	//chroma has half the luma rows (rounded up), and the same stride in bytes for NV12 and P010LE
+	const size_t size = (size_t)stride * ((height + 1) / 2);
+
+	std::lock_guard<std::mutex> lock(pool_mutex);
+
+	if(!pool->planes.empty() && pool->planes.back().size >= size)
+		return pool->planes.back().data;
+
+	//page size multiple, the next slightly larger request gets the same plane
+	const size_t page = sysconf(_SC_PAGESIZE);
+	const size_t rounded = (size + page - 1) / page * page;
+	chroma_plane plane = { chroma_plane_alloc(rounded, first, second), rounded };
+
+	pool->planes.push_back(plane);
+
+	return plane.data;
+}
+
+uint8_t *chroma_plane_nv12(int stride, int height)
+{
+	return chroma_plane_get(&nv12_planes, stride, height, 128, 128);
+}
+
+uint8_t *chroma_plane_p010le(int stride, int height)
+{
+	return chroma_plane_get(&p010le_planes, stride, height, 0x00, 0x80);
+}
+
+void chroma_plane_pack_ir(const uint8_t *ir, int ir_stride, int width, int height, uint16_t *uv, int uv_stride)
+{
+	for(int y = 0; y < height / 2; ++y)
+	{
+		const uint8_t *top = ir + 2 * y * ir_stride, *bottom = top + ir_stride;
+		uint16_t *out = (uint16_t*)((uint8_t*)uv + y * uv_stride);
+
+		//simple loop, the compiler vectorizes it
+		for(int x = 0; x < width / 2; ++x)
+		{
+			const int sum = top[2*x] + top[2*x + 1] + bottom[2*x] + bottom[2*x + 1];
+			out[2*x] = ((sum + 2) >> 2) << 8;
+			out[2*x + 1] = 0x8000;
+		}
+	}
+}
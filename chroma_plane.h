@@ -0,0 +1,39 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Chroma planes for luma only streams (shared constant or carrying infrared)
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef CHROMA_PLANE_H
+#define CHROMA_PLANE_H
+
+#include <stdint.h>
+
+//dummy interleaved U/V plane with middle value (no color) for luma of stride and height
+//- NV12 - 8 bit 128 (infrared)
+//- P010LE - 16 bit 0x8000 equals 128 << 8 (depth)
+//
+//the planes are constant so one is shared by all streams and encoders of the process:
+//- page aligned, read-only after filling (writes crash instead of corrupting other streams)
+//- any plane of the same value that is large enough is reused (stride may change any time)
+//- valid until process exit, never NULL (allocation failure throws std::bad_alloc)
+//
+//cheap enough to call for every frame, thread safe
+uint8_t *chroma_plane_nv12(int stride, int height);
+uint8_t *chroma_plane_p010le(int stride, int height);
+
+//P010LE interleaved U/V plane carrying 2x downsampled infrared (single encoder depth + infrared)
+//- U is the average of 2x2 infrared block (8 bit in the 8 most significant bits)
+//- V is constant 0x8000 (no color, cheap to encode)
+//infrared is Y8 of depth width x height, uv has (width / 2) U/V pairs in (height / 2) rows
+//strides are in bytes
+void chroma_plane_pack_ir(const uint8_t *ir, int ir_stride, int width, int height, uint16_t *uv, int uv_stride);
+
+#endif
@@ -0,0 +1,373 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Depth and color alignment with precomputed mapping
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include "depth_align.h"
+
+#include <librealsense2/rsutil.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+//tasks per thread, smaller tasks balance uneven rows (e.g. invalid depth)
+const int TASKS_PER_THREAD = 4;
+
+depth_aligner::depth_aligner(AlignTarget target, thread_pool &pool) :
+	target(target), pool(pool), depth_profile(-1), color_profile(-1), pinhole(false), yuyv(false), depth_units(0.0f)
+{
+	memset(&image, 0, sizeof(image));
+}
+
+void depth_aligner::set_depth_units(float units)
+{
+	depth_units = units;
+}
+
+//with zero coefficients these models reduce to pinhole in librealsense (bit exactly)
+static bool is_pinhole(const rs2_intrinsics &i)
+{
+	if(i.model != RS2_DISTORTION_NONE && i.model != RS2_DISTORTION_BROWN_CONRADY &&
+	   i.model != RS2_DISTORTION_MODIFIED_BROWN_CONRADY && i.model != RS2_DISTORTION_INVERSE_BROWN_CONRADY)
+		return false;
+
+	for(int c = 0; c < 5; ++c)
+		if(i.coeffs[c] != 0.0f)
+			return false;
+
+	return true;
+}
+
+void depth_aligner::build(const rs2::depth_frame &depth_frame, const rs2::video_frame &color_frame)
+{
+	const rs2::video_stream_profile depth = depth_frame.get_profile().as<rs2::video_stream_profile>();
+	const rs2::video_stream_profile color = color_frame.get_profile().as<rs2::video_stream_profile>();
+
+	depth_profile = depth.unique_id();
+	color_profile = color.unique_id();
+
+	depth_intrinsics = depth.get_intrinsics();
+	color_intrinsics = color.get_intrinsics();
+	depth_to_color = depth.get_extrinsics_to(color);
+	pinhole = is_pinhole(color_intrinsics);
+	yuyv = color.format() == RS2_FORMAT_YUYV;
+
+	const int w = depth_intrinsics.width, h = depth_intrinsics.height;
+	const float *r = depth_to_color.rotation; //column major
+
+	ray_x.resize((w + 1) * (h + 1));
+	ray_y.resize(ray_x.size());
+	ray_z.resize(ray_x.size());
+
+	//corner (x, y) is top left corner of depth pixel (x, y) and bottom right of (x - 1, y - 1)
+	for(int y = 0; y <= h; ++y)
+		for(int x = 0; x <= w; ++x)
+		{
+			const float pixel[2] = {x - 0.5f, y - 0.5f};
+			float ray[3];
+
+			rs2_deproject_pixel_to_point(ray, &depth_intrinsics, pixel, 1.0f);
+
+			const int i = y * (w + 1) + x;
+			ray_x[i] = r[0] * ray[0] + r[3] * ray[1] + r[6] * ray[2];
+			ray_y[i] = r[1] * ray[0] + r[4] * ray[1] + r[7] * ray[2];
+			ray_z[i] = r[2] * ray[0] + r[5] * ray[1] + r[8] * ray[2];
+		}
+
+	if(target == ALIGN_TO_COLOR)
+	{
+		rectangles.resize(w * h * 4);
+		row_min.resize(h);
+		row_max.resize(h);
+	}
+
+	const int bpp = (target == ALIGN_TO_COLOR) ? 2 : color_frame.get_bytes_per_pixel();
+
+	image.width = (target == ALIGN_TO_COLOR) ? color_intrinsics.width : w;
+	image.height = (target == ALIGN_TO_COLOR) ? color_intrinsics.height : h;
+	image.stride = image.width * bpp;
+
+	//YUYV is stored in whole macropixels
+	if(target == ALIGN_TO_DEPTH && yuyv)
+		image.stride = (image.width + 1) / 2 * 4;
+
+	aligned.resize(image.stride * image.height);
+	image.data = aligned.data();
+
+	cout << "Built " << (target == ALIGN_TO_COLOR ? "depth to color" : "color to depth") <<
+		" alignment map (" << w << "x" << h << " -> " << color_intrinsics.width << "x" << color_intrinsics.height <<
+		(pinhole ? ", pinhole" : ", distortion") << ")" << endl;
+}
+
+//the same arithmetic as rs2_project_point_to_pixel and rounding as rs2::align
+inline void depth_aligner::project(int corner, float depth, int *x, int *y) const
+{
+	const float point[3] = { depth * ray_x[corner] + depth_to_color.translation[0],
+	                         depth * ray_y[corner] + depth_to_color.translation[1],
+	                         depth * ray_z[corner] + depth_to_color.translation[2] };
+	float pixel[2];
+
+	if(pinhole)
+	{
+		pixel[0] = point[0] / point[2] * color_intrinsics.fx + color_intrinsics.ppx;
+		pixel[1] = point[1] / point[2] * color_intrinsics.fy + color_intrinsics.ppy;
+	}
+	else
+		rs2_project_point_to_pixel(pixel, &color_intrinsics, point);
+
+	*x = (int)(pixel[0] + 0.5f);
+	*y = (int)(pixel[1] + 0.5f);
+}
+
+//color rectangle of depth pixel, false if outside of color image
+inline bool depth_aligner::map(int x, int y, float depth, int *x0, int *y0, int *x1, int *y1) const
+{
+	const int top_left = y * (depth_intrinsics.width + 1) + x;
+	const int bottom_right = top_left + depth_intrinsics.width + 2;
+
+	project(top_left, depth, x0, y0);
+	project(bottom_right, depth, x1, y1);
+
+	return *x0 >= 0 && *y0 >= 0 && *x1 < color_intrinsics.width && *y1 < color_intrinsics.height;
+}
+
+void depth_aligner::map_rows(const rs2::depth_frame &depth, int row_begin, int row_end)
+{
+	const float units = depth.get_units();
+	const int w = depth_intrinsics.width;
+	const int stride = depth.get_stride_in_bytes();
+	const uint8_t *data = (const uint8_t*)depth.get_data();
+
+	for(int y = row_begin; y < row_end; ++y)
+	{
+		const uint16_t *z = (const uint16_t*)(data + y * stride);
+		int16_t *rect = &rectangles[y * w * 4];
+		int min_y = INT_MAX, max_y = INT_MIN;
+
+		for(int x = 0; x < w; ++x, rect += 4)
+		{
+			int x0, y0, x1, y1;
+
+			//empty rectangle if no depth or mapped outside color
+			if(!z[x] || !map(x, y, units * z[x], &x0, &y0, &x1, &y1))
+			{
+				rect[0] = 1; rect[1] = 1; rect[2] = 0; rect[3] = 0;
+				continue;
+			}
+
+			rect[0] = x0; rect[1] = y0; rect[2] = x1; rect[3] = y1;
+
+			if(y0 <= y1)
+			{
+				min_y = min(min_y, y0);
+				max_y = max(max_y, y1);
+			}
+		}
+
+		row_min[y] = min_y;
+		row_max[y] = max_y;
+	}
+}
+
+void depth_aligner::fill_band(const rs2::depth_frame &depth, int row_begin, int row_end)
+{
+	const int w = depth_intrinsics.width, h = depth_intrinsics.height;
+	const int stride = depth.get_stride_in_bytes();
+	const uint8_t *data = (const uint8_t*)depth.get_data();
+
+	memset(image.data + row_begin * image.stride, 0, (row_end - row_begin) * image.stride);
+
+	for(int y = 0; y < h; ++y)
+	{
+		//depth row doesn't touch this band
+		if(row_max[y] < row_begin || row_min[y] >= row_end)
+			continue;
+
+		const uint16_t *z = (const uint16_t*)(data + y * stride);
+		const int16_t *rect = &rectangles[y * w * 4];
+
+		for(int x = 0; x < w; ++x, rect += 4)
+		{
+			const int y0 = max((int)rect[1], row_begin), y1 = min((int)rect[3], row_end - 1);
+
+			for(int oy = y0; oy <= y1; ++oy)
+			{
+				uint16_t *out = (uint16_t*)(image.data + oy * image.stride);
+
+				//the nearest depth wins like in rs2::align
+				for(int ox = rect[0]; ox <= rect[2]; ++ox)
+					out[ox] = out[ox] ? min(out[ox], z[x]) : z[x];
+			}
+		}
+	}
+
+	//rescaling after the nearest depth is chosen (out of range is zeroed, not the nearest)
+	//the band is still in cache
+	rescale((uint16_t*)(image.data + row_begin * image.stride), image.width, 0, row_end - row_begin, image.stride);
+}
+
+//rows of image at data, no-op if not rescaling
+void depth_aligner::rescale(uint16_t *data, int width, int row_begin, int row_end, int stride)
+{
+	if(depth_units == 0.0f || row_begin >= row_end)
+		return;
+
+	uint16_t *rows = (uint16_t*)((uint8_t*)data + row_begin * stride);
+
+	//the table is already built for current multiplier in process, only read here
+	if(lut.use_table)
+		depth_lut_apply(lut, rows, width, row_end - row_begin, stride);
+	else
+		depth_rescale(rows, width, row_end - row_begin, stride, lut.multiplier);
+}
+
+//color pixel taken for depth pixel in align to depth, false if none
+inline bool depth_aligner::source(int x, int y, uint16_t z, float units, int *color_x, int *color_y) const
+{
+	int x0, y0;
+
+	//rs2::align copies every pixel of the rectangle, the last one (bottom right) stays
+	return z && map(x, y, units * z, &x0, &y0, color_x, color_y) && x0 <= *color_x && y0 <= *color_y;
+}
+
+void depth_aligner::gather_rows(const rs2::depth_frame &depth, const rs2::video_frame &color, int row_begin, int row_end)
+{
+	const float units = depth.get_units();
+	const int w = depth_intrinsics.width;
+	const int depth_stride = depth.get_stride_in_bytes();
+	const int color_stride = color.get_stride_in_bytes();
+	const int bpp = color.get_bytes_per_pixel();
+	const uint8_t *depth_data = (const uint8_t*)depth.get_data();
+	const uint8_t *color_data = (const uint8_t*)color.get_data();
+
+	for(int y = row_begin; y < row_end; ++y)
+	{
+		const uint16_t *z = (const uint16_t*)(depth_data + y * depth_stride);
+		uint8_t *out = image.data + y * image.stride;
+
+		for(int x = 0; x < w; ++x, out += bpp)
+		{
+			int cx, cy;
+
+			if(source(x, y, z[x], units, &cx, &cy))
+				memcpy(out, color_data + cy * color_stride + cx * bpp, bpp);
+			else
+				memset(out, 0, bpp);
+		}
+	}
+}
+
+//YUYV macropixel (Y0 U Y1 V) is remapped as two pixels
+//- luma is taken from each pixel source like in gather_rows
+//- chroma is the average of source macropixels chroma (4:2:2 stays 4:2:2)
+//- pixels without mapping are black (Y 16, U/V 128), the same as RGBA zeros after encoder conversion
+void depth_aligner::gather_rows_yuyv(const rs2::depth_frame &depth, const rs2::video_frame &color, int row_begin, int row_end)
+{
+	const float units = depth.get_units();
+	const int w = depth_intrinsics.width;
+	const int depth_stride = depth.get_stride_in_bytes();
+	const int color_stride = color.get_stride_in_bytes();
+	const uint8_t *depth_data = (const uint8_t*)depth.get_data();
+	const uint8_t *color_data = (const uint8_t*)color.get_data();
+
+	for(int y = row_begin; y < row_end; ++y)
+	{
+		const uint16_t *z = (const uint16_t*)(depth_data + y * depth_stride);
+		uint8_t *out = image.data + y * image.stride;
+
+		//odd width has the last pixel in macropixel without pair
+		for(int x = 0; x < w; x += 2, out += 4)
+		{
+			int u = 0, v = 0, valid = 0;
+
+			for(int i = 0; i < 2; ++i)
+			{
+				int cx, cy;
+
+				if(x + i >= w || !source(x + i, y, z[x + i], units, &cx, &cy))
+				{
+					out[2 * i] = 16;
+					continue;
+				}
+
+				const uint8_t *pixel = color_data + cy * color_stride + cx * 2;
+				const uint8_t *macropixel = color_data + cy * color_stride + (cx & ~1) * 2;
+
+				out[2 * i] = pixel[0];
+				u += macropixel[1];
+				v += macropixel[3];
+				++valid;
+			}
+
+			out[1] = valid ? (u + valid / 2) / valid : 128;
+			out[3] = valid ? (v + valid / 2) / valid : 128;
+		}
+	}
+}
+
+aligned_image depth_aligner::process(const rs2::depth_frame &depth, const rs2::video_frame &color)
+{
+	if(depth.get_profile().unique_id() != depth_profile || color.get_profile().unique_id() != color_profile)
+		build(depth, color);
+
+	const int w = depth_intrinsics.width, h = depth_intrinsics.height;
+	const int tasks = pool.size() * TASKS_PER_THREAD;
+
+	if(depth_units != 0.0f)
+		depth_lut_update(&lut, depth.get_units() / depth_units);
+
+	//split rows into tasks, the last task may get less
+	auto rows = [](int task, int tasks, int rows, int *begin, int *end)
+	{
+		const int per_task = (rows + tasks - 1) / tasks;
+		*begin = min(task * per_task, rows);
+		*end = min(*begin + per_task, rows);
+	};
+
+	if(target == ALIGN_TO_DEPTH)
+	{
+		pool.run(tasks, [&](int task)
+		{
+			int begin, end;
+			rows(task, tasks, h, &begin, &end);
+
+			if(yuyv)
+				gather_rows_yuyv(depth, color, begin, end);
+			else
+				gather_rows(depth, color, begin, end);
+
+			//mapping needs depth in device units, rows are rescaled after they are gathered
+			rescale((uint16_t*)depth.get_data(), w, begin, end, depth.get_stride_in_bytes());
+		});
+
+		return image;
+	}
+
+	pool.run(tasks, [&](int task)
+	{
+		int begin, end;
+		rows(task, tasks, h, &begin, &end);
+		map_rows(depth, begin, end);
+	});
+
+	pool.run(tasks, [&](int task)
+	{
+		int begin, end;
+		rows(task, tasks, image.height, &begin, &end);
+		fill_band(depth, begin, end);
+	});
+
+	return image;
+}
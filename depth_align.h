@@ -0,0 +1,105 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Depth and color alignment with precomputed mapping
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef DEPTH_ALIGN_H
+#define DEPTH_ALIGN_H
+
+#include "thread_pool.h"
+#include "depth_kernels.h"
+
+// Realsense API
+#include <librealsense2/rs.hpp>
+
+#include <vector>
+#include <stdint.h>
+
+enum AlignTarget {ALIGN_TO_COLOR, ALIGN_TO_DEPTH};
+
+//image owned by aligner, valid until the next process call
+struct aligned_image
+{
+	uint8_t *data;
+	int width;
+	int height;
+	int stride; //in bytes
+};
+
+//the same mapping as rs2::align
+//- each depth pixel corners are deprojected, transformed and projected to color
+//- align to color fills color pixels in the rectangle with the nearest depth
+//- align to depth takes color from the rectangle bottom right corner
+//- align to depth also supports YUYV (unlike rs2::align), chroma of macropixel is averaged
+//- pixels without mapping are zero
+//
+//rs2::align redoes deprojection and extrinsics for every pixel of every frame
+//here the corner rays rotated to color space are computed once per stream profile
+//so per frame only depth scaling and projection remain, split across thread pool
+//
+//align to color is race free without atomics:
+//- first pass maps depth rows to color rectangles (parallel over depth rows)
+//- second pass fills color row bands (parallel over bands, each band owned by one task)
+class depth_aligner
+{
+public:
+	depth_aligner(AlignTarget target, thread_pool &pool);
+
+	//rescale depth to these units (with P010LE_MAX clamping) in the same pass as alignment
+	//ALIGN_TO_COLOR rescales aligned depth, ALIGN_TO_DEPTH rescales depth frame in place
+	//0 (default) leaves depth in device units
+	void set_depth_units(float units);
+
+	//ALIGN_TO_COLOR - Z16 depth in color geometry (P010LE luma if rescaling)
+	//ALIGN_TO_DEPTH - color (in its format, packed RGB or YUYV) in depth geometry
+	aligned_image process(const rs2::depth_frame &depth, const rs2::video_frame &color);
+
+private:
+	void build(const rs2::depth_frame &depth, const rs2::video_frame &color);
+	void project(int corner, float depth, int *x, int *y) const;
+	bool map(int x, int y, float depth, int *x0, int *y0, int *x1, int *y1) const;
+
+	void map_rows(const rs2::depth_frame &depth, int row_begin, int row_end);
+	void fill_band(const rs2::depth_frame &depth, int row_begin, int row_end);
+	void rescale(uint16_t *data, int width, int row_begin, int row_end, int stride);
+	bool source(int x, int y, uint16_t z, float units, int *color_x, int *color_y) const;
+	void gather_rows(const rs2::depth_frame &depth, const rs2::video_frame &color, int row_begin, int row_end);
+	void gather_rows_yuyv(const rs2::depth_frame &depth, const rs2::video_frame &color, int row_begin, int row_end);
+
+	const AlignTarget target;
+	thread_pool &pool;
+
+	//the mapping is built for these stream profiles
+	int depth_profile;
+	int color_profile;
+
+	rs2_intrinsics depth_intrinsics;
+	rs2_intrinsics color_intrinsics;
+	rs2_extrinsics depth_to_color;
+	bool pinhole; //color projection without distortion (all coefficients zero)
+	bool yuyv; //color in YUYV, remapped in macropixels
+
+	//(depth width + 1) x (depth height + 1) pixel corner rays rotated to color space
+	std::vector<float> ray_x, ray_y, ray_z;
+
+	//align to color first pass, color rectangle per depth pixel (empty if x0 > x1)
+	std::vector<int16_t> rectangles;
+	//color rows range touched by each depth row
+	std::vector<int> row_min, row_max;
+
+	float depth_units; //0 if not rescaling
+	depth_lut lut; //rescaling table or arithmetic, whichever is faster on this CPU
+
+	std::vector<uint8_t> aligned;
+	aligned_image image;
+};
+
+#endif
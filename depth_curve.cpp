@@ -0,0 +1,182 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Non-linear depth quantization curves (inverse, logarithmic, piecewise)
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include "depth_curve.h"
+
+#include <iostream>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+const int CODE_MIN = 1;
+const int CODE_MAX = 1023;
+const int CODE_RANGE = CODE_MAX - CODE_MIN;
+const int CODE_SHIFT = 6; //P010LE
+
+static const char *NAMES[] = {"none", "linear", "inverse", "log", "piecewise"};
+
+int depth_curve_parse(const options &opts, depth_curve *curve)
+{
+	const string name = options_get(opts, "depth-curve", "none");
+	int type = 0;
+
+	while(type <= DEPTH_CURVE_PIECEWISE && name != NAMES[type])
+		++type;
+
+	if(type > DEPTH_CURVE_PIECEWISE)
+	{
+		cerr << "unknown depth curve '" << name << "', valid curves: 'none', 'linear', 'inverse', 'log', 'piecewise'" << endl;
+		return -1;
+	}
+
+	curve->type = (DepthCurveType)type;
+	curve->near = options_get_float(opts, "curve-near", 0.2f);
+	curve->far = options_get_float(opts, "curve-far", 6.5f);
+	curve->knee = options_get_float(opts, "curve-knee", 1.0f);
+
+	if(curve->type == DEPTH_CURVE_NONE)
+		return 0;
+
+	if(curve->near <= 0.0f || curve->far <= curve->near)
+	{
+		cerr << "depth curve needs 0 < near < far (got near " << curve->near << " far " << curve->far << ")" << endl;
+		return -1;
+	}
+
+	if(curve->type == DEPTH_CURVE_PIECEWISE && (curve->knee <= curve->near || curve->knee >= curve->far))
+	{
+		cerr << "piecewise depth curve needs near < knee < far (got knee " << curve->knee << ")" << endl;
+		return -1;
+	}
+
+	return 0;
+}
+
+const char *depth_curve_name(DepthCurveType type)
+{
+	return NAMES[type];
+}
+
+//meters in [near, far] to [0, 1]
+static double curve_forward(const depth_curve &c, double z)
+{
+	switch(c.type)
+	{
+		case DEPTH_CURVE_INVERSE:
+			return (1.0 / c.near - 1.0 / z) / (1.0 / c.near - 1.0 / c.far);
+		case DEPTH_CURVE_LOG:
+			return log(z / c.near) / log((double)c.far / c.near);
+		case DEPTH_CURVE_PIECEWISE:
+			return z < c.knee ? 0.5 * (z - c.near) / (c.knee - c.near) : 0.5 + 0.5 * (z - c.knee) / (c.far - c.knee);
+		default: //linear
+			return (z - c.near) / (c.far - c.near);
+	}
+}
+
+//[0, 1] to meters in [near, far]
+static double curve_inverse(const depth_curve &c, double t)
+{
+	switch(c.type)
+	{
+		case DEPTH_CURVE_INVERSE:
+			return 1.0 / (1.0 / c.near - t * (1.0 / c.near - 1.0 / c.far));
+		case DEPTH_CURVE_LOG:
+			return c.near * exp(t * log((double)c.far / c.near));
+		case DEPTH_CURVE_PIECEWISE:
+			return t < 0.5 ? c.near + 2.0 * t * (c.knee - c.near) : c.knee + (2.0 * t - 1.0) * (c.far - c.knee);
+		default: //linear
+			return c.near + t * (c.far - c.near);
+	}
+}
+
+uint16_t depth_curve_encode(const depth_curve &curve, float meters)
+{
+	if(meters < curve.near || meters > curve.far)
+		return 0;
+
+	const int code = CODE_MIN + (int)lround(curve_forward(curve, meters) * CODE_RANGE);
+
+	return code << CODE_SHIFT;
+}
+
+float depth_curve_decode(const depth_curve &curve, uint16_t value)
+{
+	const int code = (value + (1 << (CODE_SHIFT - 1))) >> CODE_SHIFT;
+
+	if(code < CODE_MIN)
+		return 0.0f;
+
+	return curve_inverse(curve, (double)(code - CODE_MIN) / CODE_RANGE);
+}
+
+float depth_curve_step(const depth_curve &curve, float meters)
+{
+	const double z = meters;
+
+	switch(curve.type)
+	{
+		case DEPTH_CURVE_INVERSE:
+			return z * z * (1.0 / curve.near - 1.0 / curve.far) / CODE_RANGE;
+		case DEPTH_CURVE_LOG:
+			return z * log((double)curve.far / curve.near) / CODE_RANGE;
+		case DEPTH_CURVE_PIECEWISE:
+			return 2.0 * (z < curve.knee ? curve.knee - curve.near : curve.far - curve.knee) / CODE_RANGE;
+		default: //linear
+			return (curve.far - curve.near) / CODE_RANGE;
+	}
+}
+
+bool depth_curve_lut_update(depth_lut *lut, const depth_curve &curve, float units)
+{
+	if(lut->multiplier == units && !lut->table.empty())
+		return false;
+
+	lut->table.resize(UINT16_MAX + 1);
+
+	lut->table[0] = 0;
+
+	for(uint32_t i = 1; i <= UINT16_MAX; ++i)
+		lut->table[i] = depth_curve_encode(curve, i * units);
+
+	lut->multiplier = units;
+	lut->use_table = true; //no arithmetic alternative
+
+	return true;
+}
+
+void depth_curve_to_message(const depth_curve &curve, uint8_t *message)
+{
+	const float params[3] = {curve.near, curve.far, curve.knee};
+
+	memset(message, 0, DEPTH_CURVE_MESSAGE_SIZE);
+	message[0] = curve.type;
+	//little endian hosts (x86, ARM) only
+	memcpy(message + 4, params, sizeof(params));
+}
+
+int depth_curve_from_message(const uint8_t *message, int size, depth_curve *curve)
+{
+	if(size != DEPTH_CURVE_MESSAGE_SIZE || message[0] > DEPTH_CURVE_PIECEWISE)
+		return -1;
+
+	float params[3];
+	memcpy(params, message + 4, sizeof(params));
+
+	curve->type = (DepthCurveType)message[0];
+	curve->near = params[0];
+	curve->far = params[1];
+	curve->knee = params[2];
+
+	return 0;
+}
@@ -0,0 +1,64 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Non-linear depth quantization curves (inverse, logarithmic, piecewise)
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef DEPTH_CURVE_H
+#define DEPTH_CURVE_H
+
+#include "options.h"
+#include "depth_kernels.h"
+
+#include <stdint.h>
+
+//P010LE depth is linear, the step (depth units * 64) is the same near and far
+//curves map [near, far] meters to 10 bit codes 1-1023 (0 is no depth or out of range):
+//- linear - the same step in whole range
+//- inverse - uniform in 1/z (disparity like), step grows with z^2
+//- log - uniform in log(z), step grows with z (constant relative error)
+//- piecewise - linear with half of the codes below knee, half above
+enum DepthCurveType {DEPTH_CURVE_NONE, DEPTH_CURVE_LINEAR, DEPTH_CURVE_INVERSE, DEPTH_CURVE_LOG, DEPTH_CURVE_PIECEWISE};
+
+struct depth_curve
+{
+	DepthCurveType type; //NONE keeps device units depth
+	float near; //in meters
+	float far;
+	float knee; //only for piecewise
+};
+
+//--depth-curve=none/linear/inverse/log/piecewise --curve-near=M --curve-far=M --curve-knee=M
+//returns -1 on invalid input
+int depth_curve_parse(const options &opts, depth_curve *curve);
+
+const char *depth_curve_name(DepthCurveType type);
+
+//meters to P010LE value (code in 10 most significant bits), 0 outside [near, far]
+uint16_t depth_curve_encode(const depth_curve &curve, float meters);
+//P010LE value (rounded to nearest code) to meters, 0 for no depth
+float depth_curve_decode(const depth_curve &curve, uint16_t value);
+//quantization step in meters at distance
+float depth_curve_step(const depth_curve &curve, float meters);
+
+//table from device depth in units to P010LE curve value
+//applied with depth_lut_apply, lut multiplier holds the units table was built for
+//returns true if table was rebuilt (first use or device reported different units)
+bool depth_curve_lut_update(depth_lut *lut, const depth_curve &curve, float units);
+
+//parameters for the receiver, sent with each frameset (auxiliary channel)
+//type (uint8), 3 zero bytes, near, far, knee (IEEE 754 float, little endian)
+const int DEPTH_CURVE_MESSAGE_SIZE = 16;
+
+void depth_curve_to_message(const depth_curve &curve, uint8_t *message);
+//returns -1 if message is not a valid curve
+int depth_curve_from_message(const uint8_t *message, int size, depth_curve *curve);
+
+#endif
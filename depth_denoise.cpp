@@ -0,0 +1,257 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Fused spatial and temporal depth denoising before encoding
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include "depth_denoise.h"
+
+#include <algorithm>
+#include <iostream>
+#include <cstdlib>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RNHVE_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+//small tiles stay in L1/L2 with their halo, many tiles balance threads
+const int TILE_WIDTH = 128;
+const int TILE_HEIGHT = 16;
+
+//per strength 1-3
+const int THRESHOLDS[] = {6, 5, 4}; //1.6%, 3.1%, 6.3% of depth
+const int SMOOTHING[] = {1, 2, 3}; //new frame weight 1/2, 1/4, 1/8
+const int PERSISTENCE[] = {1, 2, 4};
+
+int depth_denoise_config_parse(const options &opts, depth_denoise_config *config)
+{
+	config->strength = options_get_int(opts, "denoise", 0);
+	config->threads = options_get_int(opts, "denoise-threads", 0);
+
+	if(config->strength < 0 || config->strength > 3)
+	{
+		cerr << "denoise strength has to be 0 (disabled) to 3" << endl;
+		return -1;
+	}
+
+	return 0;
+}
+
+depth_denoiser::depth_denoiser(int strength, thread_pool &pool, bool simd) :
+	threshold(THRESHOLDS[max(strength, 1) - 1]),
+	smoothing(SMOOTHING[max(strength, 1) - 1]),
+	persistence(PERSISTENCE[max(strength, 1) - 1]),
+	pool(pool), simd(simd), width(0), height(0)
+{
+}
+
+uint16_t *depth_denoiser::process(const uint16_t *data, int width, int height, int stride)
+{
+	if(width != this->width || height != this->height)
+	{
+		this->width = width;
+		this->height = height;
+		history.assign(width * height, 0);
+		age.assign(width * height, UINT8_MAX);
+		output.resize(width * height);
+	}
+
+	const int tiles_x = (width + TILE_WIDTH - 1) / TILE_WIDTH;
+	const int tiles_y = (height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+
+	pool.run(tiles_x * tiles_y, [&](int tile)
+	{
+		const int x = tile % tiles_x * TILE_WIDTH, y = tile / tiles_x * TILE_HEIGHT;
+		filter_tile(data, stride, x, min(x + TILE_WIDTH, width), y, min(y + TILE_HEIGHT, height));
+	});
+
+	return &output[0];
+}
+
+typedef void (*filter_row_fn)(const uint16_t *top, const uint16_t *mid, const uint16_t *bottom, int x_begin, int x_end,
+	uint16_t *hist, uint8_t *ages, uint16_t *out, int threshold, int smoothing, int persistence);
+
+//one row of pixels x_begin to x_end, x - 1 and x + 1 have to be readable
+static void filter_row_scalar(const uint16_t *top, const uint16_t *mid, const uint16_t *bottom, int x_begin, int x_end,
+	uint16_t *hist, uint8_t *ages, uint16_t *out, int threshold, int smoothing, int persistence)
+{
+	const int half = 1 << (smoothing - 1);
+
+	for(int x = x_begin; x < x_end; ++x)
+	{
+		const int c = mid[x];
+		const int n[9] = {top[x-1], top[x], top[x+1], mid[x-1], c, mid[x+1], bottom[x-1], bottom[x], bottom[x+1]};
+		const int limit = c >> threshold;
+		int sum = 0, count = 0;
+
+		for(int i = 0; i < 9; ++i)
+			if(n[i] && abs(n[i] - c) <= limit)
+				sum += n[i], ++count;
+
+		//center counts if valid
+		const int s = (int)((sum + count / 2) / (float)max(count, 1));
+
+		//smooth only if close to history, otherwise it is new surface
+		const int h = hist[x];
+		const bool close = h && abs(s - h) <= limit;
+		const int smoothed = close ? ((h << smoothing) - h + s + half) >> smoothing : s;
+
+		//invalid pixel holds the last value for a while
+		const bool hold = !c && h && ages[x] < persistence;
+
+		ages[x] = c ? 0 : ages[x] + hold;
+		out[x] = hist[x] = c ? smoothed : (hold ? h : 0);
+	}
+}
+
+#ifdef RNHVE_X86
+
+//unsigned 16 bit a <= b
+__attribute__((target("sse2")))
+static inline __m128i less_equal_epu16(__m128i a, __m128i b)
+{
+	return _mm_cmpeq_epi16(_mm_subs_epu16(a, b), _mm_setzero_si128());
+}
+
+__attribute__((target("sse2")))
+static inline __m128i abs_diff_epu16(__m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_subs_epu16(a, b), _mm_subs_epu16(b, a));
+}
+
+//32 bit lanes to unsigned 16 bit (values fit in 16 bits)
+__attribute__((target("sse2")))
+static inline __m128i pack_epu32(__m128i lo, __m128i hi)
+{
+	const __m128i bias32 = _mm_set1_epi32(32768), bias16 = _mm_set1_epi16((short)0x8000);
+	return _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(lo, bias32), _mm_sub_epi32(hi, bias32)), bias16);
+}
+
+//8 pixels at a time, exactly the same operations as scalar
+__attribute__((target("sse2")))
+static void filter_row_sse2(const uint16_t *top, const uint16_t *mid, const uint16_t *bottom, int x_begin, int x_end,
+	uint16_t *hist, uint8_t *ages, uint16_t *out, int threshold, int smoothing, int persistence)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi16(1);
+	const __m128i half = _mm_set1_epi32(1 << (smoothing - 1));
+	const __m128i keep = _mm_set1_epi16(persistence);
+	const __m128i thr = _mm_cvtsi32_si128(threshold);
+	const __m128i smooth = _mm_cvtsi32_si128(smoothing);
+	const uint16_t *rows[3] = {top, mid, bottom};
+	int x = x_begin;
+
+	for(; x + 8 <= x_end; x += 8)
+	{
+		const __m128i c = _mm_loadu_si128((const __m128i*)(mid + x));
+		const __m128i limit = _mm_srl_epi16(c, thr);
+		__m128i sum_lo = zero, sum_hi = zero, count = zero;
+
+		for(int i = 0; i < 3; ++i)
+			for(int j = -1; j <= 1; ++j)
+			{
+				const __m128i n = _mm_loadu_si128((const __m128i*)(rows[i] + x + j));
+				const __m128i in = _mm_andnot_si128(_mm_cmpeq_epi16(n, zero), less_equal_epu16(abs_diff_epu16(n, c), limit));
+				const __m128i masked = _mm_and_si128(n, in);
+
+				sum_lo = _mm_add_epi32(sum_lo, _mm_unpacklo_epi16(masked, zero));
+				sum_hi = _mm_add_epi32(sum_hi, _mm_unpackhi_epi16(masked, zero));
+				count = _mm_sub_epi16(count, in);
+			}
+
+		//(sum + count / 2) / max(count, 1) in float, truncated
+		const __m128i divisor = _mm_max_epi16(count, one);
+		const __m128i rounding = _mm_srli_epi16(count, 1);
+		sum_lo = _mm_add_epi32(sum_lo, _mm_unpacklo_epi16(rounding, zero));
+		sum_hi = _mm_add_epi32(sum_hi, _mm_unpackhi_epi16(rounding, zero));
+		const __m128i s_lo = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(sum_lo), _mm_cvtepi32_ps(_mm_unpacklo_epi16(divisor, zero))));
+		const __m128i s_hi = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(sum_hi), _mm_cvtepi32_ps(_mm_unpackhi_epi16(divisor, zero))));
+		const __m128i s = pack_epu32(s_lo, s_hi);
+
+		//temporal smoothing in 32 bits, ((h << smoothing) - h + s + half) >> smoothing
+		const __m128i h = _mm_loadu_si128((const __m128i*)(hist + x));
+		const __m128i h_lo = _mm_unpacklo_epi16(h, zero), h_hi = _mm_unpackhi_epi16(h, zero);
+		const __m128i t_lo = _mm_srl_epi32(_mm_add_epi32(_mm_sub_epi32(_mm_sll_epi32(h_lo, smooth), h_lo), _mm_add_epi32(s_lo, half)), smooth);
+		const __m128i t_hi = _mm_srl_epi32(_mm_add_epi32(_mm_sub_epi32(_mm_sll_epi32(h_hi, smooth), h_hi), _mm_add_epi32(s_hi, half)), smooth);
+		const __m128i smoothed = pack_epu32(t_lo, t_hi);
+
+		const __m128i h_valid = _mm_xor_si128(_mm_cmpeq_epi16(h, zero), _mm_set1_epi16(-1));
+		const __m128i close = _mm_and_si128(h_valid, less_equal_epu16(abs_diff_epu16(s, h), limit));
+		const __m128i filtered = _mm_or_si128(_mm_and_si128(close, smoothed), _mm_andnot_si128(close, s));
+
+		const __m128i invalid = _mm_cmpeq_epi16(c, zero);
+		const __m128i age = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(ages + x)), zero);
+		const __m128i hold = _mm_and_si128(_mm_and_si128(invalid, h_valid), _mm_cmplt_epi16(age, keep));
+
+		const __m128i result = _mm_or_si128(_mm_andnot_si128(invalid, filtered), _mm_and_si128(hold, h));
+		const __m128i new_age = _mm_andnot_si128(_mm_andnot_si128(invalid, _mm_set1_epi16(-1)), _mm_sub_epi16(age, hold));
+
+		_mm_storeu_si128((__m128i*)(out + x), result);
+		_mm_storeu_si128((__m128i*)(hist + x), result);
+		_mm_storel_epi64((__m128i*)(ages + x), _mm_packus_epi16(new_age, zero));
+	}
+
+	filter_row_scalar(top, mid, bottom, x, x_end, hist, ages, out, threshold, smoothing, persistence);
+}
+
+static filter_row_fn filter_row_sse2_supported()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2") ? filter_row_sse2 : NULL;
+}
+
+#else
+
+static filter_row_fn filter_row_sse2_supported()
+{
+	return NULL;
+}
+
+#endif
+
+void depth_denoiser::filter_tile(const uint16_t *data, int stride, int x_begin, int x_end, int y_begin, int y_end)
+{
+	static const filter_row_fn sse2 = filter_row_sse2_supported();
+	const filter_row_fn filter_row = (simd && sse2) ? sse2 : filter_row_scalar;
+	const int begin = max(x_begin, 1), end = min(x_end, width - 1);
+
+	for(int y = y_begin; y < y_end; ++y)
+	{
+		const uint16_t *rows[3];
+
+		//border rows repeat the edge
+		for(int i = 0; i < 3; ++i)
+			rows[i] = (const uint16_t*)((const uint8_t*)data + min(max(y + i - 1, 0), height - 1) * stride);
+
+		uint16_t *hist = &history[y * width];
+		uint8_t *ages = &age[y * width];
+		uint16_t *out = &output[y * width];
+
+		filter_row(rows[0], rows[1], rows[2], begin, end, hist, ages, out, threshold, smoothing, persistence);
+
+		//border columns repeat the edge through 3 pixel copies
+		for(int x = x_begin; x < x_end; ++x)
+		{
+			if(x >= begin && x < end)
+				continue;
+
+			uint16_t pad[3][3];
+
+			for(int i = 0; i < 3; ++i)
+				for(int j = 0; j < 3; ++j)
+					pad[i][j] = rows[i][min(max(x + j - 1, 0), width - 1)];
+
+			filter_row_scalar(pad[0], pad[1], pad[2], 1, 2, hist + x - 1, ages + x - 1, out + x - 1, threshold, smoothing, persistence);
+		}
+	}
+}
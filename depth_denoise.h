@@ -0,0 +1,69 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Fused spatial and temporal depth denoising before encoding
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef DEPTH_DENOISE_H
+#define DEPTH_DENOISE_H
+
+#include "options.h"
+#include "thread_pool.h"
+
+#include <vector>
+#include <stdint.h>
+
+//depth noise flickers frame to frame and encoder spends bits on it
+//
+//one pass per pixel over tiles (split across thread pool):
+//- spatial - mean of 3x3 neighbours within relative threshold of the center (edge preserving)
+//- temporal - exponential smoothing with previous output while within threshold
+//  (reset on larger change, e.g. motion or edges)
+//- persistence - invalid pixel keeps previous output for a few frames
+//
+//strength 1-3 raises threshold, smoothing and persistence, 0 disables
+//works on linear depth (before quantization curves), zero is no depth
+//rows are filtered with SSE2 (bit exact with scalar) if CPU supports it
+struct depth_denoise_config
+{
+	int strength;
+	int threads; //0 for all cores
+};
+
+//--denoise=0-3 --denoise-threads=N, returns -1 on invalid input
+int depth_denoise_config_parse(const options &opts, depth_denoise_config *config);
+
+class depth_denoiser
+{
+public:
+	//simd false forces scalar code (e.g. for comparison)
+	depth_denoiser(int strength, thread_pool &pool, bool simd = true);
+
+	//returns denoised depth (width * 2 stride) valid until the next call
+	//input is not modified, the history restarts when frame size changes
+	uint16_t *process(const uint16_t *data, int width, int height, int stride);
+
+private:
+	void filter_tile(const uint16_t *data, int stride, int x_begin, int x_end, int y_begin, int y_end);
+
+	const int threshold; //neighbour counted if |difference| <= depth >> threshold
+	const int smoothing; //log2 of temporal filter weight of new frame
+	const int persistence; //frames invalid pixel keeps its value
+
+	thread_pool &pool;
+	const bool simd;
+
+	int width, height;
+	std::vector<uint16_t> history;
+	std::vector<uint8_t> age; //frames since pixel was valid
+	std::vector<uint16_t> output; //history is kept intact for later in place processing
+};
+
+#endif
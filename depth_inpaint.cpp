@@ -0,0 +1,189 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Invalid depth inpainting with validity mask for the receiver
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include "depth_inpaint.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+//tasks per thread, smaller tasks balance uneven rows (e.g. invalid depth)
+const int TASKS_PER_THREAD = 4;
+
+static void put_varint(vector<uint8_t> *out, uint32_t value)
+{
+	for(; value >= 0x80; value >>= 7)
+		out->push_back((value & 0x7F) | 0x80);
+
+	out->push_back(value);
+}
+
+//returns bytes read or 0 if malformed
+static int get_varint(const uint8_t *in, int size, uint32_t *value)
+{
+	*value = 0;
+
+	for(int i = 0; i < size && i < 5; ++i)
+	{
+		*value |= (uint32_t)(in[i] & 0x7F) << (7 * i);
+
+		if(!(in[i] & 0x80))
+			return i + 1;
+	}
+
+	return 0;
+}
+
+depth_inpainter::depth_inpainter(thread_pool &pool) : pool(pool)
+{
+}
+
+const vector<uint8_t> &depth_inpainter::process(uint16_t *data, int width, int height, int stride)
+{
+	const int tasks = pool.size() * TASKS_PER_THREAD;
+
+	row_masks.resize(height);
+	empty.assign(height, 0);
+
+	pool.run(tasks, [&](int task)
+	{  //split rows into tasks, the last task may get less
+		const int per_task = (height + tasks - 1) / tasks;
+		const int begin = min(task * per_task, height);
+		const int end = min(begin + per_task, height);
+
+		fill_rows(data, width, stride, begin, end);
+	});
+
+	fill_empty_rows(data, width, height, stride);
+
+	mask.clear();
+
+	for(int y = 0; y < height; ++y)
+		mask.insert(mask.end(), row_masks[y].begin(), row_masks[y].end());
+
+	return mask;
+}
+
+void depth_inpainter::fill_rows(uint16_t *data, int width, int stride, int row_begin, int row_end)
+{
+	for(int y = row_begin; y < row_end; ++y)
+	{
+		uint16_t *row = (uint16_t*)((uint8_t*)data + y * stride);
+		vector<uint8_t> &runs = row_masks[y];
+		int last_valid = -1; //the last valid pixel before hole
+		int x = 0;
+
+		runs.clear();
+
+		while(x < width)
+		{
+			const int valid_begin = x;
+
+			while(x < width && row[x])
+				++x;
+
+			put_varint(&runs, x - valid_begin);
+
+			if(x == width)
+				break;
+
+			if(x > 0)
+				last_valid = x - 1;
+
+			const int hole_begin = x;
+
+			while(x < width && !row[x])
+				++x;
+
+			put_varint(&runs, x - hole_begin);
+
+			//no valid pixels in row, filled from other rows later
+			if(last_valid < 0 && x == width)
+			{
+				empty[y] = 1;
+				break;
+			}
+
+			const int a = (last_valid >= 0) ? row[last_valid] : row[x];
+			const int b = (x < width) ? row[x] : a;
+			const int span = x - hole_begin + 1;
+
+			//linear ramp between hole neighbours (flat at row ends)
+			for(int i = hole_begin; i < x; ++i)
+				row[i] = a + (b - a) * (i - hole_begin + 1) / span;
+		}
+	}
+}
+
+void depth_inpainter::fill_empty_rows(uint16_t *data, int width, int height, int stride)
+{
+	int source = -1; //the last filled row
+
+	//copy down from filled row above, rows at top from the first filled row
+	for(int y = 0; y < height; ++y)
+	{
+		if(!empty[y])
+		{
+			source = y;
+			continue;
+		}
+
+		if(source >= 0)
+			memcpy((uint8_t*)data + y * stride, (uint8_t*)data + source * stride, width * sizeof(uint16_t));
+	}
+
+	int first = 0;
+
+	while(first < height && empty[first])
+		++first;
+
+	if(first == height)
+		return; //nothing valid in frame
+
+	for(int y = 0; y < first; ++y)
+		memcpy((uint8_t*)data + y * stride, (uint8_t*)data + first * stride, width * sizeof(uint16_t));
+}
+
+int depth_mask_apply(const uint8_t *mask, int size, uint16_t *data, int width, int height, int stride)
+{
+	int pos = 0;
+
+	for(int y = 0; y < height; ++y)
+	{
+		uint16_t *row = (uint16_t*)((uint8_t*)data + y * stride);
+		bool valid = true;
+
+		for(int x = 0; x < width; valid = !valid)
+		{
+			uint32_t run;
+			const int read = get_varint(mask + pos, size - pos, &run);
+
+			if(!read || run > (uint32_t)(width - x))
+				return -1;
+
+			pos += read;
+
+			if(!valid)
+				memset(row + x, 0, run * sizeof(uint16_t));
+
+			x += run;
+
+			//a row of valid pixels ends with its valid run
+			if(x == width && valid)
+				break;
+		}
+	}
+
+	return pos == size ? 0 : -1;
+}
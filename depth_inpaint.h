@@ -0,0 +1,52 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Invalid depth inpainting with validity mask for the receiver
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef DEPTH_INPAINT_H
+#define DEPTH_INPAINT_H
+
+#include "thread_pool.h"
+
+#include <vector>
+#include <stdint.h>
+
+//zero (invalid) depth makes hard edges, expensive for encoder and ringing around holes
+//holes are filled before encoding (scanline fill):
+//- between valid pixels of row with linear ramp
+//- at row start/end with the nearest valid pixel
+//- rows without valid pixels with the nearest filled row
+//
+//the validity mask is sent along so that receiver restores the holes (depth_mask_apply)
+//mask is run length coded, for each row alternating valid/invalid run lengths
+//(starting with valid, possibly 0) as LEB128 varints summing to width
+class depth_inpainter
+{
+public:
+	explicit depth_inpainter(thread_pool &pool);
+
+	//fills holes in place, returns mask valid until the next call
+	const std::vector<uint8_t> &process(uint16_t *data, int width, int height, int stride);
+
+private:
+	void fill_rows(uint16_t *data, int width, int stride, int row_begin, int row_end);
+	void fill_empty_rows(uint16_t *data, int width, int height, int stride);
+
+	thread_pool &pool;
+	std::vector<std::vector<uint8_t> > row_masks;
+	std::vector<char> empty; //rows without valid depth
+	std::vector<uint8_t> mask;
+};
+
+//zeroes depth not valid in mask (receiving end), returns -1 if mask doesn't match frame
+int depth_mask_apply(const uint8_t *mask, int size, uint16_t *data, int width, int height, int stride);
+
+#endif
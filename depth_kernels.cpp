@@ -0,0 +1,273 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Depth processing kernels (scalar, SSE2, AVX2)
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include "depth_kernels.h"
+
+#include <chrono>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RNHVE_X86 1
+#include <immintrin.h>
+#endif
+
+void depth_rescale_scalar(uint16_t *data, int width, int height, int stride, float multiplier)
+{
+	for(int y = 0; y < height; ++y)
+	{
+		uint16_t *row = (uint16_t*)((uint8_t*)data + y * stride);
+
+		for(int x = 0; x < width; ++x)
+		{
+			uint32_t val = row[x] * multiplier;
+			row[x] = val <= P010LE_MAX ? val : 0;
+		}
+	}
+}
+
+#ifdef RNHVE_X86
+
+//the vector kernels give bit exact results with scalar version:
+//- the same single precision multiplication and truncation
+//- out of int32 range conversion gives INT32_MIN which is also zeroed (like > P010LE_MAX)
+
+__attribute__((target("sse2")))
+static inline __m128i rescale_epi32_sse2(__m128i v, __m128 mul, __m128i max, __m128i zero)
+{
+	__m128i r = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(v), mul));
+	__m128i invalid = _mm_or_si128(_mm_cmpgt_epi32(r, max), _mm_cmplt_epi32(r, zero));
+	return _mm_andnot_si128(invalid, r);
+}
+
+__attribute__((target("sse2")))
+static void depth_rescale_sse2_impl(uint16_t *data, int width, int height, int stride, float multiplier)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 mul = _mm_set1_ps(multiplier);
+	const __m128i max = _mm_set1_epi32(P010LE_MAX);
+	//SSE2 has only signed saturating pack, bias to signed range and back
+	const __m128i bias32 = _mm_set1_epi32(0x8000);
+	const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+
+	for(int y = 0; y < height; ++y)
+	{
+		uint16_t *row = (uint16_t*)((uint8_t*)data + y * stride);
+		int x = 0;
+
+		for(; x + 8 <= width; x += 8)
+		{
+			__m128i v = _mm_loadu_si128((__m128i*)(row + x));
+			__m128i lo = rescale_epi32_sse2(_mm_unpacklo_epi16(v, zero), mul, max, zero);
+			__m128i hi = rescale_epi32_sse2(_mm_unpackhi_epi16(v, zero), mul, max, zero);
+
+			v = _mm_packs_epi32(_mm_sub_epi32(lo, bias32), _mm_sub_epi32(hi, bias32));
+			_mm_storeu_si128((__m128i*)(row + x), _mm_add_epi16(v, bias16));
+		}
+
+		for(; x < width; ++x)
+		{
+			uint32_t val = row[x] * multiplier;
+			row[x] = val <= P010LE_MAX ? val : 0;
+		}
+	}
+}
+
+__attribute__((target("avx2")))
+static inline __m256i rescale_epi32_avx2(__m256i v, __m256 mul, __m256i max, __m256i zero)
+{
+	__m256i r = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(v), mul));
+	__m256i invalid = _mm256_or_si256(_mm256_cmpgt_epi32(r, max), _mm256_cmpgt_epi32(zero, r));
+	return _mm256_andnot_si256(invalid, r);
+}
+
+__attribute__((target("avx2")))
+static void depth_rescale_avx2_impl(uint16_t *data, int width, int height, int stride, float multiplier)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256 mul = _mm256_set1_ps(multiplier);
+	const __m256i max = _mm256_set1_epi32(P010LE_MAX);
+
+	for(int y = 0; y < height; ++y)
+	{
+		uint16_t *row = (uint16_t*)((uint8_t*)data + y * stride);
+		int x = 0;
+
+		for(; x + 16 <= width; x += 16)
+		{
+			__m128i v0 = _mm_loadu_si128((__m128i*)(row + x));
+			__m128i v1 = _mm_loadu_si128((__m128i*)(row + x + 8));
+			__m256i lo = rescale_epi32_avx2(_mm256_cvtepu16_epi32(v0), mul, max, zero);
+			__m256i hi = rescale_epi32_avx2(_mm256_cvtepu16_epi32(v1), mul, max, zero);
+
+			//pack works within 128 bit lanes, restore the order of 64 bit quarters
+			__m256i v = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+			_mm256_storeu_si256((__m256i*)(row + x), v);
+		}
+
+		for(; x < width; ++x)
+		{
+			uint32_t val = row[x] * multiplier;
+			row[x] = val <= P010LE_MAX ? val : 0;
+		}
+	}
+}
+
+depth_rescale_fn depth_rescale_sse2()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2") ? depth_rescale_sse2_impl : NULL;
+}
+
+depth_rescale_fn depth_rescale_avx2()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") ? depth_rescale_avx2_impl : NULL;
+}
+
+#else
+
+depth_rescale_fn depth_rescale_sse2()
+{
+	return NULL;
+}
+
+depth_rescale_fn depth_rescale_avx2()
+{
+	return NULL;
+}
+
+#endif
+
+struct depth_rescale_impl
+{
+	depth_rescale_fn fn;
+	const char *name;
+};
+
+static depth_rescale_impl select_depth_rescale()
+{
+	depth_rescale_impl impl = {depth_rescale_scalar, "scalar"};
+
+	if(depth_rescale_fn fn = depth_rescale_avx2())
+		impl.fn = fn, impl.name = "avx2";
+	else if(depth_rescale_fn fn = depth_rescale_sse2())
+		impl.fn = fn, impl.name = "sse2";
+
+	return impl;
+}
+
+static const depth_rescale_impl &depth_rescale_selected()
+{
+	static const depth_rescale_impl impl = select_depth_rescale();
+	return impl;
+}
+
+void depth_rescale(uint16_t *data, int width, int height, int stride, float multiplier)
+{
+	depth_rescale_selected().fn(data, width, height, stride, multiplier);
+}
+
+const char *depth_rescale_name()
+{
+	return depth_rescale_selected().name;
+}
+
+//one time check if table lookup is faster than arithmetic on this CPU
+//(e.g. Atom/Celeron without AVX2) using depth-like (spatially coherent) data
+static bool depth_lut_is_faster(const depth_lut &lut)
+{
+	using namespace std::chrono;
+
+	const int width = 256, height = 256, stride = width * sizeof(uint16_t);
+	std::vector<uint16_t> sample(width * height), work;
+	uint32_t state = 1, val = 20000;
+
+	for(size_t i = 0; i < sample.size(); ++i)
+	{  //random walk with occasional jumps like object edges
+		state = state * 1664525 + 1013904223;
+		val = (state >> 28) ? (val + (state >> 16) % 64 - 32) & 0xFFFF : state >> 16;
+		sample[i] = val;
+	}
+
+	nanoseconds best_table = hours(1), best_arithmetic = hours(1);
+
+	for(int i = 0; i < 3; ++i)
+	{
+		work = sample;
+		steady_clock::time_point start = steady_clock::now();
+		depth_lut_apply(lut, &work[0], width, height, stride);
+		best_table = std::min<nanoseconds>(best_table, steady_clock::now() - start);
+
+		work = sample;
+		start = steady_clock::now();
+		depth_rescale(&work[0], width, height, stride, lut.multiplier);
+		best_arithmetic = std::min<nanoseconds>(best_arithmetic, steady_clock::now() - start);
+	}
+
+	return best_table < best_arithmetic;
+}
+
+bool depth_lut_update(depth_lut *lut, float multiplier)
+{
+	if(lut->multiplier == multiplier && !lut->table.empty())
+		return false;
+
+	const bool first_build = lut->table.empty();
+
+	lut->table.resize(UINT16_MAX + 1);
+
+	//build with the scalar kernel so that results are exactly the same
+	for(uint32_t i = 0; i <= UINT16_MAX; ++i)
+		lut->table[i] = i;
+
+	depth_rescale_scalar(&lut->table[0], UINT16_MAX + 1, 1, (UINT16_MAX + 1) * sizeof(uint16_t), multiplier);
+
+	lut->multiplier = multiplier;
+
+	if(first_build)
+		lut->use_table = depth_lut_is_faster(*lut);
+
+	return true;
+}
+
+void depth_lut_apply(const depth_lut &lut, uint16_t *data, int width, int height, int stride)
+{
+	const uint16_t *table = &lut.table[0];
+
+	for(int y = 0; y < height; ++y)
+	{
+		uint16_t *row = (uint16_t*)((uint8_t*)data + y * stride);
+		int x = 0;
+
+		//independent lookups, let the CPU overlap the loads
+		for(; x + 4 <= width; x += 4)
+		{
+			const uint16_t a = table[row[x]], b = table[row[x+1]];
+			const uint16_t c = table[row[x+2]], d = table[row[x+3]];
+			row[x] = a, row[x+1] = b, row[x+2] = c, row[x+3] = d;
+		}
+
+		for(; x < width; ++x)
+			row[x] = table[row[x]];
+	}
+}
+
+void depth_rescale(depth_lut *lut, uint16_t *data, int width, int height, int stride, float multiplier)
+{
+	depth_lut_update(lut, multiplier);
+
+	if(lut->use_table)
+		depth_lut_apply(*lut, data, width, height, stride);
+	else
+		depth_rescale(data, width, height, stride, multiplier);
+}
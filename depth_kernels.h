@@ -0,0 +1,56 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Depth processing kernels (scalar, SSE2, AVX2)
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef DEPTH_KERNELS_H
+#define DEPTH_KERNELS_H
+
+#include <stdint.h>
+#include <vector>
+
+const uint16_t P010LE_MAX = 0xFFC0; //in binary 10 ones followed by 6 zeroes
+
+//rescale Z16 depth in place by multiplier, values exceeding P010LE_MAX are zeroed
+//only width pixels of each row are touched, stride padding is skipped
+//stride is in bytes (like Realsense get_stride_in_bytes)
+typedef void (*depth_rescale_fn)(uint16_t *data, int width, int height, int stride, float multiplier);
+
+//the best implementation for this CPU, selected at runtime on first use
+void depth_rescale(uint16_t *data, int width, int height, int stride, float multiplier);
+
+void depth_rescale_scalar(uint16_t *data, int width, int height, int stride, float multiplier);
+//NULL if not supported by CPU (or not compiled for this architecture)
+depth_rescale_fn depth_rescale_sse2();
+depth_rescale_fn depth_rescale_avx2();
+
+//name of the implementation used by depth_rescale (scalar, sse2, avx2)
+const char *depth_rescale_name();
+
+//precomputed uint16 -> uint16 depth_rescale (including P010LE_MAX clamping)
+//the results are exactly the same as with depth_rescale
+struct depth_lut
+{
+	float multiplier = 0.0f; //the table is built for this multiplier, 0 if not built yet
+	bool use_table = false; //table lookup was measured faster than depth_rescale on this CPU
+	std::vector<uint16_t> table;
+};
+
+//rebuilds the table only if multiplier is different from the one table was built for
+//on the first build measures if table lookup beats the vectorized arithmetic
+//returns true if table was rebuilt
+bool depth_lut_update(depth_lut *lut, float multiplier);
+void depth_lut_apply(const depth_lut &lut, uint16_t *data, int width, int height, int stride);
+
+//rescale Z16 depth in place with the method faster on this CPU (table or arithmetic)
+void depth_rescale(depth_lut *lut, uint16_t *data, int width, int height, int stride, float multiplier);
+
+#endif
@@ -0,0 +1,319 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * 8 bit NV12 depth packing for encoders without Main10 (scalar, SSE2)
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include "depth_pack.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RNHVE_X86 1
+#include <immintrin.h>
+#endif
+
+const int PERIOD = DEPTH_PACK_PERIOD;
+const int QUARTER = DEPTH_PACK_PERIOD / 4; //also the wave shift
+const int EIGHTH = DEPTH_PACK_PERIOD / 8;
+const int LUMA_STEP = 256;
+const int WAVE_SHIFT = 3; //half period to 8 bit
+const int QUARTER_SHIFT = 10; //log2(QUARTER)
+
+static inline uint8_t pack_luma(uint16_t d)
+{
+	if(!d)
+		return 0;
+
+	const int y = (d + LUMA_STEP / 2) >> 8;
+	return std::min(std::max(y, 1), 255);
+}
+
+//0 at multiples of period, 256 (saturated to 255) at half period
+static inline uint8_t pack_wave(int d)
+{
+	const int t = d & (PERIOD - 1);
+	const int triangle = std::min(t, PERIOD - t);
+	return std::min((triangle + (1 << (WAVE_SHIFT - 1))) >> WAVE_SHIFT, 255);
+}
+
+void depth_pack_nv12_scalar(const uint16_t *depth, int depth_stride, int width, int height,
+	uint8_t *y, int y_stride, uint8_t *uv, int uv_stride)
+{
+	for(int row = 0; row < height; row += 2)
+	{
+		const uint16_t *top = (const uint16_t*)((const uint8_t*)depth + row * depth_stride);
+		const uint16_t *bottom = (const uint16_t*)((const uint8_t*)top + depth_stride);
+		uint8_t *y_top = y + row * y_stride, *y_bottom = y_top + y_stride;
+		uint8_t *out = uv + row / 2 * uv_stride;
+
+		for(int x = 0; x < width; x += 2)
+		{
+			const uint16_t block[4] = {top[x], top[x+1], bottom[x], bottom[x+1]};
+			int sum = 0, count = 0;
+
+			for(int i = 0; i < 4; ++i)
+			{
+				sum += block[i];
+				count += block[i] != 0;
+			}
+
+			const int mean = count ? (sum + count / 2) / count : 0;
+
+			y_top[x] = pack_luma(top[x]);
+			y_top[x+1] = pack_luma(top[x+1]);
+			y_bottom[x] = pack_luma(bottom[x]);
+			y_bottom[x+1] = pack_luma(bottom[x+1]);
+
+			out[x] = pack_wave(mean);
+			out[x+1] = pack_wave(mean - QUARTER);
+		}
+	}
+}
+
+static inline uint16_t unpack(uint8_t y, uint8_t u, uint8_t v)
+{
+	if(!y)
+		return 0;
+
+	const int l = y << 8;
+	const int k = l - EIGHTH + PERIOD; //kept positive, period multiple doesn't change the result
+	const int m = (k >> QUARTER_SHIFT) & 3; //the linear part of one of the waves
+	const int r = k & (PERIOD - 1);
+
+	const int h = ((m & 1) ? v : u) << WAVE_SHIFT;
+	const int delta = (m & 2) ? PERIOD / 2 - h : h;
+
+	//refined depth is l + diff
+	int diff = delta + m * QUARTER - EIGHTH - r;
+
+	if(diff > EIGHTH || diff < -EIGHTH)
+		diff = 0;
+
+	//valid Y stays valid depth (refinement near 0 may go below 1)
+	return std::min(std::max(l + diff, 1), 65535);
+}
+
+void depth_unpack_nv12_scalar(const uint8_t *y, int y_stride, const uint8_t *uv, int uv_stride,
+	int width, int height, uint16_t *depth, int depth_stride)
+{
+	for(int row = 0; row < height; ++row)
+	{
+		const uint8_t *luma = y + row * y_stride;
+		const uint8_t *chroma = uv + row / 2 * uv_stride;
+		uint16_t *out = (uint16_t*)((uint8_t*)depth + row * depth_stride);
+
+		for(int x = 0; x < width; ++x)
+			out[x] = unpack(luma[x], chroma[x & ~1], chroma[x | 1]);
+	}
+}
+
+#ifdef RNHVE_X86
+
+//8 pixels of 2 rows (4 blocks) to 8 bit luma (in 16 bit lanes)
+//and wave phase (depth & (PERIOD - 1)) of block means in 32 bit lanes
+__attribute__((target("sse2")))
+static inline __m128i pack_luma_sse2(__m128i d)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi16(1);
+
+	__m128i l = _mm_srli_epi16(_mm_adds_epu16(d, _mm_set1_epi16(LUMA_STEP / 2)), 8);
+	//saturated add gives at most 255, valid depth at least 1
+	return _mm_max_epi16(l, _mm_andnot_si128(_mm_cmpeq_epi16(d, zero), one));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i block_mean_sse2(__m128i top, __m128i bottom)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ones = _mm_set1_epi16(1);
+	const __m128i bias = _mm_set1_epi16((short)0x8000);
+
+	//madd is signed, bias values to signed range, each pair sum is then 65536 too small
+	__m128i sum = _mm_add_epi32(_mm_madd_epi16(_mm_xor_si128(top, bias), ones), _mm_madd_epi16(_mm_xor_si128(bottom, bias), ones));
+	sum = _mm_add_epi32(sum, _mm_set1_epi32(2 * 65536));
+
+	//-1 for each zero
+	__m128i zeros = _mm_add_epi32(_mm_madd_epi16(_mm_cmpeq_epi16(top, zero), ones), _mm_madd_epi16(_mm_cmpeq_epi16(bottom, zero), ones));
+	__m128i count = _mm_add_epi32(zeros, _mm_set1_epi32(4));
+
+	//float division is exact here (sum < 2^24, fractional part of quotient at least 1/4 from integer)
+	__m128 num = _mm_cvtepi32_ps(_mm_add_epi32(sum, _mm_srai_epi32(count, 1)));
+	__m128i mean = _mm_cvttps_epi32(_mm_div_ps(num, _mm_cvtepi32_ps(count)));
+
+	//no valid depth in block (division by zero)
+	return _mm_and_si128(mean, _mm_cmpgt_epi32(count, _mm_setzero_si128()));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i pack_wave_sse2(__m128i phase)
+{
+	const __m128i triangle = _mm_min_epi16(phase, _mm_sub_epi16(_mm_set1_epi16(PERIOD), phase));
+	const __m128i h = _mm_srli_epi16(_mm_add_epi16(triangle, _mm_set1_epi16(1 << (WAVE_SHIFT - 1))), WAVE_SHIFT);
+	return _mm_min_epi16(h, _mm_set1_epi16(255));
+}
+
+__attribute__((target("sse2")))
+static void depth_pack_nv12_sse2_impl(const uint16_t *depth, int depth_stride, int width, int height,
+	uint8_t *y, int y_stride, uint8_t *uv, int uv_stride)
+{
+	const __m128i phase_mask = _mm_set1_epi32(PERIOD - 1);
+	const __m128i shift = _mm_set1_epi32(PERIOD - QUARTER);
+
+	for(int row = 0; row < height; row += 2)
+	{
+		const uint16_t *top = (const uint16_t*)((const uint8_t*)depth + row * depth_stride);
+		const uint16_t *bottom = (const uint16_t*)((const uint8_t*)top + depth_stride);
+		uint8_t *y_top = y + row * y_stride, *y_bottom = y_top + y_stride;
+		uint8_t *out = uv + row / 2 * uv_stride;
+		int x = 0;
+
+		for(; x + 16 <= width; x += 16)
+		{
+			const __m128i t0 = _mm_loadu_si128((const __m128i*)(top + x)), t1 = _mm_loadu_si128((const __m128i*)(top + x + 8));
+			const __m128i b0 = _mm_loadu_si128((const __m128i*)(bottom + x)), b1 = _mm_loadu_si128((const __m128i*)(bottom + x + 8));
+
+			_mm_storeu_si128((__m128i*)(y_top + x), _mm_packus_epi16(pack_luma_sse2(t0), pack_luma_sse2(t1)));
+			_mm_storeu_si128((__m128i*)(y_bottom + x), _mm_packus_epi16(pack_luma_sse2(b0), pack_luma_sse2(b1)));
+
+			const __m128i mean0 = block_mean_sse2(t0, b0), mean1 = block_mean_sse2(t1, b1);
+
+			//phases are below PERIOD, signed pack is safe
+			const __m128i u_phase = _mm_packs_epi32(_mm_and_si128(mean0, phase_mask), _mm_and_si128(mean1, phase_mask));
+			const __m128i v_phase = _mm_packs_epi32(_mm_and_si128(_mm_add_epi32(mean0, shift), phase_mask),
+			                                        _mm_and_si128(_mm_add_epi32(mean1, shift), phase_mask));
+
+			//interleave U and V bytes
+			const __m128i u = pack_wave_sse2(u_phase), v = pack_wave_sse2(v_phase);
+			_mm_storeu_si128((__m128i*)(out + x), _mm_or_si128(u, _mm_slli_epi16(v, 8)));
+		}
+
+		//the rest with scalar code
+		if(x < width)
+			depth_pack_nv12_scalar((const uint16_t*)((const uint8_t*)top + x * 2), depth_stride, width - x, 2,
+				y_top + x, y_stride, out + x, uv_stride);
+	}
+}
+
+//8 pixels of luma (16 bit lanes) with u, v for each pixel
+__attribute__((target("sse2")))
+static inline __m128i unpack_sse2(__m128i luma, __m128i u, __m128i v)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i three = _mm_set1_epi16(3), one = _mm_set1_epi16(1), two = _mm_set1_epi16(2);
+	const __m128i eighth = _mm_set1_epi16(EIGHTH), minus_eighth = _mm_set1_epi16(-EIGHTH);
+
+	//16 bit wraparound doesn't change the result (65536 is multiple of PERIOD)
+	const __m128i l = _mm_slli_epi16(luma, 8);
+	const __m128i k = _mm_add_epi16(l, _mm_set1_epi16(PERIOD - EIGHTH));
+	const __m128i m = _mm_and_si128(_mm_srli_epi16(k, QUARTER_SHIFT), three);
+	const __m128i r = _mm_and_si128(k, _mm_set1_epi16(PERIOD - 1));
+
+	const __m128i odd = _mm_cmpeq_epi16(_mm_and_si128(m, one), one);
+	const __m128i h = _mm_slli_epi16(_mm_or_si128(_mm_and_si128(odd, v), _mm_andnot_si128(odd, u)), WAVE_SHIFT);
+	const __m128i falling = _mm_cmpeq_epi16(_mm_and_si128(m, two), two);
+	const __m128i delta = _mm_or_si128(_mm_and_si128(falling, _mm_sub_epi16(_mm_set1_epi16(PERIOD / 2), h)), _mm_andnot_si128(falling, h));
+
+	__m128i diff = _mm_sub_epi16(_mm_add_epi16(delta, _mm_slli_epi16(m, QUARTER_SHIFT)), _mm_add_epi16(eighth, r));
+	const __m128i far = _mm_or_si128(_mm_cmpgt_epi16(diff, eighth), _mm_cmplt_epi16(diff, minus_eighth));
+	diff = _mm_andnot_si128(far, diff);
+
+	//l + diff saturated to 16 bit unsigned
+	__m128i d = _mm_adds_epu16(l, _mm_max_epi16(diff, zero));
+	d = _mm_subs_epu16(d, _mm_max_epi16(_mm_sub_epi16(zero, diff), zero));
+	//at least 1 for valid Y
+	d = _mm_or_si128(d, _mm_and_si128(_mm_cmpeq_epi16(d, zero), one));
+
+	return _mm_andnot_si128(_mm_cmpeq_epi16(luma, zero), d);
+}
+
+//duplicate low (U) or high (V) byte of 16 bit pairs for both pixels of the pair
+__attribute__((target("sse2")))
+static inline void chroma_for_pixels_sse2(__m128i pairs, __m128i *u, __m128i *v)
+{
+	const __m128i low = _mm_and_si128(pairs, _mm_set1_epi32(0xFFFF));
+	const __m128i high = _mm_srli_epi32(pairs, 16);
+
+	*u = _mm_or_si128(low, _mm_slli_epi32(low, 16));
+	*v = _mm_or_si128(high, _mm_slli_epi32(high, 16));
+}
+
+__attribute__((target("sse2")))
+static void depth_unpack_nv12_sse2_impl(const uint8_t *y, int y_stride, const uint8_t *uv, int uv_stride,
+	int width, int height, uint16_t *depth, int depth_stride)
+{
+	const __m128i zero = _mm_setzero_si128();
+
+	for(int row = 0; row < height; ++row)
+	{
+		const uint8_t *luma = y + row * y_stride;
+		const uint8_t *chroma = uv + row / 2 * uv_stride;
+		uint16_t *out = (uint16_t*)((uint8_t*)depth + row * depth_stride);
+		int x = 0;
+
+		for(; x + 16 <= width; x += 16)
+		{
+			const __m128i l = _mm_loadu_si128((const __m128i*)(luma + x));
+			const __m128i c = _mm_loadu_si128((const __m128i*)(chroma + x));
+			__m128i u, v;
+
+			//U V pairs as 16 bit U, 16 bit V
+			chroma_for_pixels_sse2(_mm_unpacklo_epi8(c, zero), &u, &v);
+			_mm_storeu_si128((__m128i*)(out + x), unpack_sse2(_mm_unpacklo_epi8(l, zero), u, v));
+
+			chroma_for_pixels_sse2(_mm_unpackhi_epi8(c, zero), &u, &v);
+			_mm_storeu_si128((__m128i*)(out + x + 8), unpack_sse2(_mm_unpackhi_epi8(l, zero), u, v));
+		}
+
+		for(; x < width; ++x)
+			out[x] = unpack(luma[x], chroma[x & ~1], chroma[x | 1]);
+	}
+}
+
+depth_pack_fn depth_pack_nv12_sse2()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2") ? depth_pack_nv12_sse2_impl : NULL;
+}
+
+depth_unpack_fn depth_unpack_nv12_sse2()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2") ? depth_unpack_nv12_sse2_impl : NULL;
+}
+
+#else
+
+depth_pack_fn depth_pack_nv12_sse2()
+{
+	return NULL;
+}
+
+depth_unpack_fn depth_unpack_nv12_sse2()
+{
+	return NULL;
+}
+
+#endif
+
+void depth_pack_nv12(const uint16_t *depth, int depth_stride, int width, int height,
+	uint8_t *y, int y_stride, uint8_t *uv, int uv_stride)
+{
+	static const depth_pack_fn sse2 = depth_pack_nv12_sse2();
+	(sse2 ? sse2 : depth_pack_nv12_scalar)(depth, depth_stride, width, height, y, y_stride, uv, uv_stride);
+}
+
+void depth_unpack_nv12(const uint8_t *y, int y_stride, const uint8_t *uv, int uv_stride,
+	int width, int height, uint16_t *depth, int depth_stride)
+{
+	static const depth_unpack_fn sse2 = depth_unpack_nv12_sse2();
+	(sse2 ? sse2 : depth_unpack_nv12_scalar)(y, y_stride, uv, uv_stride, width, height, depth, depth_stride);
+}
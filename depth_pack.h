@@ -0,0 +1,54 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * 8 bit NV12 depth packing for encoders without Main10 (scalar, SSE2)
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef DEPTH_PACK_H
+#define DEPTH_PACK_H
+
+#include <stdint.h>
+
+//triangle wave depth coding (Pece, Kautz, Weyrich "Adapting Standard Video Codecs for Depth Streaming")
+//adapted to NV12 where chroma has quarter resolution:
+//- Y is coarse depth, (depth + 128) >> 8 (1 for the smallest valid depth, 0 for no depth)
+//- U and V are two triangle waves of period DEPTH_PACK_PERIOD shifted by quarter period
+//  computed from mean valid depth of 2x2 block (8 bit, 8 depth units per step)
+//
+//decoder selects the linear part of the wave from Y and refines Y with U or V:
+//- with exact planes error is within 4 depth units on flat blocks (more on slopes, chroma is per block)
+//- Y coding error of one step (256 units) is tolerated (DEPTH_PACK_PERIOD / 8 minus half step)
+//- if refinement is further than DEPTH_PACK_PERIOD / 8 from Y (block chroma of different surface) Y is used
+//- non zero Y unpacks to at least 1 (refinement is clamped, depth within error of 0 comes back as 1)
+const int DEPTH_PACK_PERIOD = 4096;
+
+//width and height have to be even, strides are in bytes
+typedef void (*depth_pack_fn)(const uint16_t *depth, int depth_stride, int width, int height,
+	uint8_t *y, int y_stride, uint8_t *uv, int uv_stride);
+typedef void (*depth_unpack_fn)(const uint8_t *y, int y_stride, const uint8_t *uv, int uv_stride,
+	int width, int height, uint16_t *depth, int depth_stride);
+
+//the best implementation for this CPU, selected at runtime on first use
+void depth_pack_nv12(const uint16_t *depth, int depth_stride, int width, int height,
+	uint8_t *y, int y_stride, uint8_t *uv, int uv_stride);
+void depth_unpack_nv12(const uint8_t *y, int y_stride, const uint8_t *uv, int uv_stride,
+	int width, int height, uint16_t *depth, int depth_stride);
+
+void depth_pack_nv12_scalar(const uint16_t *depth, int depth_stride, int width, int height,
+	uint8_t *y, int y_stride, uint8_t *uv, int uv_stride);
+void depth_unpack_nv12_scalar(const uint8_t *y, int y_stride, const uint8_t *uv, int uv_stride,
+	int width, int height, uint16_t *depth, int depth_stride);
+
+//NULL if not supported by CPU (or not compiled for this architecture)
+//bit exact with scalar versions
+depth_pack_fn depth_pack_nv12_sse2();
+depth_unpack_fn depth_unpack_nv12_sse2();
+
+#endif
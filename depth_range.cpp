@@ -0,0 +1,144 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Adaptive depth range from per frame depth histogram
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include "depth_range.h"
+
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+
+using namespace std;
+
+const int SUB_HISTOGRAMS = 4;
+
+const float RANGE_MARGIN = 0.1f; //candidate range widened by this fraction of its width
+const float SHRINK_RATIO = 0.75f; //candidate narrower than this fraction of range...
+const int SHRINK_UPDATES = 15; //...for this many updates shrinks range
+
+static void merge_sub_histograms(const uint32_t (*sub)[DEPTH_HISTOGRAM_BINS], uint32_t *histogram)
+{
+	for(int b = 0; b < DEPTH_HISTOGRAM_BINS; ++b)
+		histogram[b] += sub[0][b] + sub[1][b] + sub[2][b] + sub[3][b];
+}
+
+void depth_histogram(const uint16_t *data, int width, int height, int stride, uint32_t *histogram)
+{
+	uint32_t sub[SUB_HISTOGRAMS][DEPTH_HISTOGRAM_BINS] = { {0} };
+
+	for(int y = 0; y < height; ++y)
+	{
+		const uint16_t *row = (const uint16_t*)((const uint8_t*)data + y * stride);
+		int x = 0;
+
+		for(; x + 4 <= width; x += 4)
+		{
+			++sub[0][row[x] >> DEPTH_HISTOGRAM_SHIFT];
+			++sub[1][row[x+1] >> DEPTH_HISTOGRAM_SHIFT];
+			++sub[2][row[x+2] >> DEPTH_HISTOGRAM_SHIFT];
+			++sub[3][row[x+3] >> DEPTH_HISTOGRAM_SHIFT];
+		}
+
+		for(; x < width; ++x)
+			++sub[0][row[x] >> DEPTH_HISTOGRAM_SHIFT];
+	}
+
+	merge_sub_histograms(sub, histogram);
+}
+
+int depth_range_config_parse(const options &opts, depth_range_config *config)
+{
+	config->interval = options_get_int(opts, "adaptive-range", 0);
+	config->low = options_get_float(opts, "range-low", 0.01f);
+	config->high = options_get_float(opts, "range-high", 0.01f);
+
+	if(config->interval < 0)
+	{
+		cerr << "adaptive range interval has to be non-negative (0 disables)" << endl;
+		return -1;
+	}
+
+	if(config->low < 0.0f || config->high < 0.0f || config->low + config->high >= 1.0f)
+	{
+		cerr << "adaptive range fractions have to be non-negative with sum below 1" << endl;
+		return -1;
+	}
+
+	return 0;
+}
+
+depth_range::depth_range(const depth_range_config &config, float near, float far) :
+	config(config), range_near(near), range_far(far), frame(0), narrower(0)
+{
+}
+
+bool depth_range::update(const uint16_t *data, int width, int height, int stride, float units)
+{
+	if(config.interval <= 0 || frame++ % config.interval)
+		return false;
+
+	memset(histogram, 0, sizeof(histogram));
+	depth_histogram(data, width, height, stride, histogram);
+
+	//bin 0 holds no depth (and valid depth below bin width)
+	uint32_t valid = 0;
+	for(int b = 1; b < DEPTH_HISTOGRAM_BINS; ++b)
+		valid += histogram[b];
+
+	if(!valid)
+		return false;
+
+	const uint32_t below = valid * config.low, above = valid * config.high;
+	int low = 1, high = DEPTH_HISTOGRAM_BINS - 1;
+
+	for(uint32_t count = histogram[low]; count <= below; count += histogram[++low]);
+	for(uint32_t count = histogram[high]; count <= above; count += histogram[--high]);
+
+	//bin edges in meters widened by margin, near stays positive (log/inverse curves)
+	const float bin = units * (1 << DEPTH_HISTOGRAM_SHIFT);
+	const float margin = RANGE_MARGIN * (high + 1 - low) * bin;
+	const float near = max(low * bin - margin, bin);
+	const float far = (high + 1) * bin + margin;
+
+	if(near < range_near || far > range_far)
+	{  //grow immediately to what is needed
+		range_near = min(near, range_near);
+		range_far = max(far, range_far);
+		narrower = 0;
+		return true;
+	}
+
+	if(far - near >= SHRINK_RATIO * (range_far - range_near))
+	{
+		narrower = 0;
+		return false;
+	}
+
+	if(++narrower < SHRINK_UPDATES)
+		return false;
+
+	range_near = near;
+	range_far = far;
+	narrower = 0;
+
+	return true;
+}
+
+float depth_range::near() const
+{
+	return range_near;
+}
+
+float depth_range::far() const
+{
+	return range_far;
+}
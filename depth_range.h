@@ -0,0 +1,65 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Adaptive depth range from per frame depth histogram (scalar, SSE2)
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef DEPTH_RANGE_H
+#define DEPTH_RANGE_H
+
+#include "options.h"
+
+#include <stdint.h>
+
+//Z16 depth histogram, bin is depth >> DEPTH_HISTOGRAM_SHIFT (bin 0 includes no depth)
+const int DEPTH_HISTOGRAM_SHIFT = 8;
+const int DEPTH_HISTOGRAM_BINS = 65536 >> DEPTH_HISTOGRAM_SHIFT;
+
+//adds width pixels of each row to histogram (not cleared), stride is in bytes
+//depth is spatially coherent so neighbours often hit the same bin,
+//counting into interleaved sub-histograms avoids serializing on one counter
+void depth_histogram(const uint16_t *data, int width, int height, int stride, uint32_t *histogram);
+
+struct depth_range_config
+{
+	int interval; //frames between histograms, 0 disables adaptive range
+	float low; //fraction of valid pixels allowed below near
+	float high; //fraction of valid pixels allowed above far
+};
+
+//--adaptive-range=N --range-low=F --range-high=F, returns -1 on invalid input
+int depth_range_config_parse(const options &opts, depth_range_config *config);
+
+//near/far bounds following the scene with hysteresis:
+//- percentile bounds of valid depth widened by margin are the candidate range
+//- range grows immediately when candidate doesn't fit (data would be lost)
+//- range shrinks only after candidate is much narrower for a number of updates
+//  (avoids sending new range and changing depth codes every frame)
+class depth_range
+{
+public:
+	//initial range in meters (e.g. the whole camera range)
+	depth_range(const depth_range_config &config, float near, float far);
+
+	//every interval frames computes histogram, returns true if range changed
+	bool update(const uint16_t *data, int width, int height, int stride, float units);
+
+	float near() const;
+	float far() const;
+
+private:
+	const depth_range_config config;
+	float range_near, range_far;
+	int frame;
+	int narrower; //consecutive updates with much narrower candidate
+	uint32_t histogram[DEPTH_HISTOGRAM_BINS];
+};
+
+#endif
@@ -0,0 +1,150 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Texture region of interest QP offsets from depth
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include "depth_roi.h"
+
+#include <algorithm>
+#include <iostream>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RNHVE_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+//FFmpeg clips offsets to QP range, larger offsets make background unusable anyway
+const int MAX_QP_OFFSET = 25;
+
+int depth_roi_config_parse(const options &opts, depth_roi_config *config)
+{
+	config->qp = options_get_int(opts, "roi", 0);
+	config->near = options_get_float(opts, "roi-near", 1.0f);
+	config->far = options_get_float(opts, "roi-far", 3.0f);
+
+	if(config->qp < 0 || config->qp > MAX_QP_OFFSET)
+	{
+		cerr << "roi QP offset has to be 0 (disabled) to " << MAX_QP_OFFSET << endl;
+		return -1;
+	}
+
+	if(config->near < 0.0f || config->near >= config->far)
+	{
+		cerr << "roi near has to be non-negative and below far" << endl;
+		return -1;
+	}
+
+	return 0;
+}
+
+depth_roi::depth_roi(const depth_roi_config &config) : config(config)
+{
+}
+
+typedef void (*nearest_in_columns_fn)(const uint16_t *data, int width, int rows, int stride, uint16_t *nearest);
+
+//nearest valid depth - 1 in each column of block row (no depth wraps to UINT16_MAX)
+//blocks reduce the columns later
+static void nearest_in_columns_scalar(const uint16_t *data, int width, int rows, int stride, uint16_t *nearest)
+{
+	fill(nearest, nearest + width, UINT16_MAX);
+
+	for(int y = 0; y < rows; ++y)
+	{
+		const uint16_t *row = (const uint16_t*)((const uint8_t*)data + y * stride);
+
+		for(int x = 0; x < width; ++x)
+			nearest[x] = min<uint16_t>(nearest[x], row[x] - 1);
+	}
+}
+
+#ifdef RNHVE_X86
+
+//SSE2 has no unsigned 16 bit minimum, min(a, b) = a - saturated(a - b)
+__attribute__((target("sse2")))
+static void nearest_in_columns_sse2(const uint16_t *data, int width, int rows, int stride, uint16_t *nearest)
+{
+	const __m128i one = _mm_set1_epi16(1);
+	int x = 0;
+
+	for(; x + 8 <= width; x += 8)
+	{
+		__m128i m = _mm_set1_epi16(-1);
+
+		for(int y = 0; y < rows; ++y)
+		{
+			const uint16_t *row = (const uint16_t*)((const uint8_t*)data + y * stride);
+			const __m128i d = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(row + x)), one);
+			m = _mm_sub_epi16(m, _mm_subs_epu16(m, d));
+		}
+
+		_mm_storeu_si128((__m128i*)(nearest + x), m);
+	}
+
+	nearest_in_columns_scalar(data + x, width - x, rows, stride, nearest + x);
+}
+
+static nearest_in_columns_fn nearest_in_columns_best()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2") ? nearest_in_columns_sse2 : nearest_in_columns_scalar;
+}
+
+#else
+
+static nearest_in_columns_fn nearest_in_columns_best()
+{
+	return nearest_in_columns_scalar;
+}
+
+#endif
+
+const vector<sw_encoder_roi> &depth_roi::process(const uint16_t *data, int width, int height, int stride, float units)
+{
+	const int blocks_x = (width + DEPTH_ROI_BLOCK - 1) / DEPTH_ROI_BLOCK;
+	const int blocks_y = (height + DEPTH_ROI_BLOCK - 1) / DEPTH_ROI_BLOCK;
+	const float scale = config.qp / (config.far - config.near);
+	static const nearest_in_columns_fn nearest_in_columns = nearest_in_columns_best();
+
+	nearest.resize(width);
+	regions.clear();
+
+	for(int by = 0; by < blocks_y; ++by)
+	{
+		const int top = by * DEPTH_ROI_BLOCK, bottom = min(top + DEPTH_ROI_BLOCK, height);
+		const uint16_t *rows = (const uint16_t*)((const uint8_t*)data + top * stride);
+
+		nearest_in_columns(rows, width, bottom - top, stride, &nearest[0]);
+
+		for(int bx = 0; bx < blocks_x; ++bx)
+		{
+			const int left = bx * DEPTH_ROI_BLOCK, right = min(left + DEPTH_ROI_BLOCK, width);
+			const uint16_t block = *min_element(nearest.begin() + left, nearest.begin() + right);
+			const float z = (block + 1.0f) * units;
+			const int offset = (block == UINT16_MAX) ? config.qp :
+				min(config.qp, max(0, (int)lround((z - config.near) * scale)));
+
+			//continue the run of the same offset or start the next region
+			if(bx > 0 && regions.back().qp_offset == offset)
+				regions.back().right = right;
+			else
+			{
+				sw_encoder_roi r = {left, top, right, bottom, offset};
+				regions.push_back(r);
+			}
+		}
+	}
+
+	return regions;
+}
@@ -0,0 +1,54 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Texture region of interest QP offsets from depth
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef DEPTH_ROI_H
+#define DEPTH_ROI_H
+
+#include "options.h"
+#include "sw_encoder.h"
+
+#include <vector>
+#include <stdint.h>
+
+//block size in pixels of the QP offset map (multiple of H.264 macroblock and HEVC quantization group)
+const int DEPTH_ROI_BLOCK = 32;
+
+struct depth_roi_config
+{
+	int qp; //QP offset of far background, 0 disables
+	float near; //meters, full quality up to
+	float far; //meters, the whole offset from
+};
+
+//--roi=N --roi-near=M --roi-far=M, returns -1 on invalid input
+int depth_roi_config_parse(const options &opts, depth_roi_config *config);
+
+//coarse texture QP offset map from depth in texture geometry (aligned or the same sensor)
+//- block depth is the nearest valid pixel (small or partially covered near objects keep quality)
+//- offset grows linearly from 0 at near to qp at far, blocks without depth are background
+//- blocks with the same offset are merged into horizontal runs (fewer regions for encoder)
+class depth_roi
+{
+public:
+	explicit depth_roi(const depth_roi_config &config);
+
+	//depth in units (Z16 or rescaled P010LE), regions valid until the next call
+	const std::vector<sw_encoder_roi> &process(const uint16_t *data, int width, int height, int stride, float units);
+
+private:
+	const depth_roi_config config;
+	std::vector<uint16_t> nearest; //per column of block row depth - 1, UINT16_MAX without depth
+	std::vector<sw_encoder_roi> regions;
+};
+
+#endif
@@ -0,0 +1,318 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Coarse + fine depth split for two Main10 streams (scalar, SSE2, AVX2)
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include "depth_split.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RNHVE_X86 1
+#include <immintrin.h>
+#endif
+
+const uint16_t COARSE_MASK = 0xFFC0; //P010LE_MAX
+const int COARSE_ROUND = 32; //half of coarse step
+const int COARSE_MIN = 64; //valid depth never becomes no data
+const int FINE_SHIFT = 8; //fine in 8 most significant bits
+const int FINE_ROUND = 1 << (FINE_SHIFT - 1);
+
+static inline uint16_t split_coarse(uint16_t d)
+{
+	if(!d)
+		return 0;
+
+	const uint16_t c = std::min(d + COARSE_ROUND, 0xFFFF) & COARSE_MASK;
+	return c ? c : COARSE_MIN;
+}
+
+static inline uint16_t merge(uint16_t coarse, uint16_t fine)
+{
+	const int c = coarse & COARSE_MASK;
+
+	if(!c)
+		return 0;
+
+	const int f = (uint16_t)(fine + FINE_ROUND) >> FINE_SHIFT;
+	//fine minus coarse modulo period, centered around 0
+	const int delta = (((f - c) & (DEPTH_SPLIT_PERIOD - 1)) ^ (DEPTH_SPLIT_PERIOD / 2)) - DEPTH_SPLIT_PERIOD / 2;
+
+	return std::min(std::max(c + delta, 0), 0xFFFF);
+}
+
+void depth_split_scalar(const uint16_t *depth, int depth_stride, int width, int height,
+	uint16_t *coarse, int coarse_stride, uint16_t *fine, int fine_stride)
+{
+	for(int y = 0; y < height; ++y)
+	{
+		const uint16_t *in = (const uint16_t*)((const uint8_t*)depth + y * depth_stride);
+		uint16_t *c = (uint16_t*)((uint8_t*)coarse + y * coarse_stride);
+		uint16_t *f = (uint16_t*)((uint8_t*)fine + y * fine_stride);
+
+		for(int x = 0; x < width; ++x)
+		{
+			c[x] = split_coarse(in[x]);
+			f[x] = in[x] << FINE_SHIFT;
+		}
+	}
+}
+
+void depth_merge_scalar(const uint16_t *coarse, int coarse_stride, const uint16_t *fine, int fine_stride,
+	int width, int height, uint16_t *depth, int depth_stride)
+{
+	for(int y = 0; y < height; ++y)
+	{
+		const uint16_t *c = (const uint16_t*)((const uint8_t*)coarse + y * coarse_stride);
+		const uint16_t *f = (const uint16_t*)((const uint8_t*)fine + y * fine_stride);
+		uint16_t *out = (uint16_t*)((uint8_t*)depth + y * depth_stride);
+
+		for(int x = 0; x < width; ++x)
+			out[x] = merge(c[x], f[x]);
+	}
+}
+
+#ifdef RNHVE_X86
+
+//saturating add of 32 keeps the top of range at COARSE_MASK (like scalar min)
+__attribute__((target("sse2")))
+static inline __m128i split_coarse_sse2(__m128i d)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i c = _mm_and_si128(_mm_adds_epu16(d, _mm_set1_epi16(COARSE_ROUND)), _mm_set1_epi16((short)COARSE_MASK));
+	//valid depth rounded to 0 becomes COARSE_MIN
+	__m128i lifted = _mm_andnot_si128(_mm_cmpeq_epi16(d, zero), _mm_cmpeq_epi16(c, zero));
+	return _mm_or_si128(c, _mm_and_si128(lifted, _mm_set1_epi16(COARSE_MIN)));
+}
+
+__attribute__((target("sse2")))
+static void depth_split_sse2_impl(const uint16_t *depth, int depth_stride, int width, int height,
+	uint16_t *coarse, int coarse_stride, uint16_t *fine, int fine_stride)
+{
+	for(int y = 0; y < height; ++y)
+	{
+		const uint16_t *in = (const uint16_t*)((const uint8_t*)depth + y * depth_stride);
+		uint16_t *c = (uint16_t*)((uint8_t*)coarse + y * coarse_stride);
+		uint16_t *f = (uint16_t*)((uint8_t*)fine + y * fine_stride);
+		int x = 0;
+
+		for(; x + 8 <= width; x += 8)
+		{
+			__m128i d = _mm_loadu_si128((const __m128i*)(in + x));
+			_mm_storeu_si128((__m128i*)(c + x), split_coarse_sse2(d));
+			_mm_storeu_si128((__m128i*)(f + x), _mm_slli_epi16(d, FINE_SHIFT));
+		}
+
+		for(; x < width; ++x)
+		{
+			c[x] = split_coarse(in[x]);
+			f[x] = in[x] << FINE_SHIFT;
+		}
+	}
+}
+
+//16 bit lanes, the sign of delta decides between saturating add and subtract
+__attribute__((target("sse2")))
+static inline __m128i merge_sse2(__m128i coarse, __m128i fine)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i half = _mm_set1_epi16(DEPTH_SPLIT_PERIOD / 2);
+
+	__m128i c = _mm_and_si128(coarse, _mm_set1_epi16((short)COARSE_MASK));
+	__m128i f = _mm_srli_epi16(_mm_add_epi16(fine, _mm_set1_epi16(FINE_ROUND)), FINE_SHIFT);
+	__m128i delta = _mm_and_si128(_mm_sub_epi16(f, c), _mm_set1_epi16(DEPTH_SPLIT_PERIOD - 1));
+	delta = _mm_sub_epi16(_mm_xor_si128(delta, half), half);
+
+	__m128i up = _mm_max_epi16(delta, zero);
+	__m128i down = _mm_max_epi16(_mm_sub_epi16(zero, delta), zero);
+	__m128i d = _mm_subs_epu16(_mm_adds_epu16(c, up), down);
+
+	return _mm_andnot_si128(_mm_cmpeq_epi16(c, zero), d);
+}
+
+__attribute__((target("sse2")))
+static void depth_merge_sse2_impl(const uint16_t *coarse, int coarse_stride, const uint16_t *fine, int fine_stride,
+	int width, int height, uint16_t *depth, int depth_stride)
+{
+	for(int y = 0; y < height; ++y)
+	{
+		const uint16_t *c = (const uint16_t*)((const uint8_t*)coarse + y * coarse_stride);
+		const uint16_t *f = (const uint16_t*)((const uint8_t*)fine + y * fine_stride);
+		uint16_t *out = (uint16_t*)((uint8_t*)depth + y * depth_stride);
+		int x = 0;
+
+		for(; x + 8 <= width; x += 8)
+		{
+			__m128i vc = _mm_loadu_si128((const __m128i*)(c + x));
+			__m128i vf = _mm_loadu_si128((const __m128i*)(f + x));
+			_mm_storeu_si128((__m128i*)(out + x), merge_sse2(vc, vf));
+		}
+
+		for(; x < width; ++x)
+			out[x] = merge(c[x], f[x]);
+	}
+}
+
+__attribute__((target("avx2")))
+static inline __m256i split_coarse_avx2(__m256i d)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i c = _mm256_and_si256(_mm256_adds_epu16(d, _mm256_set1_epi16(COARSE_ROUND)), _mm256_set1_epi16((short)COARSE_MASK));
+	__m256i lifted = _mm256_andnot_si256(_mm256_cmpeq_epi16(d, zero), _mm256_cmpeq_epi16(c, zero));
+	return _mm256_or_si256(c, _mm256_and_si256(lifted, _mm256_set1_epi16(COARSE_MIN)));
+}
+
+__attribute__((target("avx2")))
+static void depth_split_avx2_impl(const uint16_t *depth, int depth_stride, int width, int height,
+	uint16_t *coarse, int coarse_stride, uint16_t *fine, int fine_stride)
+{
+	for(int y = 0; y < height; ++y)
+	{
+		const uint16_t *in = (const uint16_t*)((const uint8_t*)depth + y * depth_stride);
+		uint16_t *c = (uint16_t*)((uint8_t*)coarse + y * coarse_stride);
+		uint16_t *f = (uint16_t*)((uint8_t*)fine + y * fine_stride);
+		int x = 0;
+
+		for(; x + 16 <= width; x += 16)
+		{
+			__m256i d = _mm256_loadu_si256((const __m256i*)(in + x));
+			_mm256_storeu_si256((__m256i*)(c + x), split_coarse_avx2(d));
+			_mm256_storeu_si256((__m256i*)(f + x), _mm256_slli_epi16(d, FINE_SHIFT));
+		}
+
+		for(; x < width; ++x)
+		{
+			c[x] = split_coarse(in[x]);
+			f[x] = in[x] << FINE_SHIFT;
+		}
+	}
+}
+
+__attribute__((target("avx2")))
+static inline __m256i merge_avx2(__m256i coarse, __m256i fine)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i half = _mm256_set1_epi16(DEPTH_SPLIT_PERIOD / 2);
+
+	__m256i c = _mm256_and_si256(coarse, _mm256_set1_epi16((short)COARSE_MASK));
+	__m256i f = _mm256_srli_epi16(_mm256_add_epi16(fine, _mm256_set1_epi16(FINE_ROUND)), FINE_SHIFT);
+	__m256i delta = _mm256_and_si256(_mm256_sub_epi16(f, c), _mm256_set1_epi16(DEPTH_SPLIT_PERIOD - 1));
+	delta = _mm256_sub_epi16(_mm256_xor_si256(delta, half), half);
+
+	__m256i up = _mm256_max_epi16(delta, zero);
+	__m256i down = _mm256_max_epi16(_mm256_sub_epi16(zero, delta), zero);
+	__m256i d = _mm256_subs_epu16(_mm256_adds_epu16(c, up), down);
+
+	return _mm256_andnot_si256(_mm256_cmpeq_epi16(c, zero), d);
+}
+
+__attribute__((target("avx2")))
+static void depth_merge_avx2_impl(const uint16_t *coarse, int coarse_stride, const uint16_t *fine, int fine_stride,
+	int width, int height, uint16_t *depth, int depth_stride)
+{
+	for(int y = 0; y < height; ++y)
+	{
+		const uint16_t *c = (const uint16_t*)((const uint8_t*)coarse + y * coarse_stride);
+		const uint16_t *f = (const uint16_t*)((const uint8_t*)fine + y * fine_stride);
+		uint16_t *out = (uint16_t*)((uint8_t*)depth + y * depth_stride);
+		int x = 0;
+
+		for(; x + 16 <= width; x += 16)
+		{
+			__m256i vc = _mm256_loadu_si256((const __m256i*)(c + x));
+			__m256i vf = _mm256_loadu_si256((const __m256i*)(f + x));
+			_mm256_storeu_si256((__m256i*)(out + x), merge_avx2(vc, vf));
+		}
+
+		for(; x < width; ++x)
+			out[x] = merge(c[x], f[x]);
+	}
+}
+
+depth_split_fn depth_split_sse2()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2") ? depth_split_sse2_impl : NULL;
+}
+
+depth_split_fn depth_split_avx2()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") ? depth_split_avx2_impl : NULL;
+}
+
+depth_merge_fn depth_merge_sse2()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2") ? depth_merge_sse2_impl : NULL;
+}
+
+depth_merge_fn depth_merge_avx2()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") ? depth_merge_avx2_impl : NULL;
+}
+
+#else
+
+depth_split_fn depth_split_sse2()
+{
+	return NULL;
+}
+
+depth_split_fn depth_split_avx2()
+{
+	return NULL;
+}
+
+depth_merge_fn depth_merge_sse2()
+{
+	return NULL;
+}
+
+depth_merge_fn depth_merge_avx2()
+{
+	return NULL;
+}
+
+#endif
+
+static depth_split_fn select_depth_split()
+{
+	if(depth_split_fn fn = depth_split_avx2())
+		return fn;
+	if(depth_split_fn fn = depth_split_sse2())
+		return fn;
+	return depth_split_scalar;
+}
+
+static depth_merge_fn select_depth_merge()
+{
+	if(depth_merge_fn fn = depth_merge_avx2())
+		return fn;
+	if(depth_merge_fn fn = depth_merge_sse2())
+		return fn;
+	return depth_merge_scalar;
+}
+
+void depth_split(const uint16_t *depth, int depth_stride, int width, int height,
+	uint16_t *coarse, int coarse_stride, uint16_t *fine, int fine_stride)
+{
+	static const depth_split_fn fn = select_depth_split();
+	fn(depth, depth_stride, width, height, coarse, coarse_stride, fine, fine_stride);
+}
+
+void depth_merge(const uint16_t *coarse, int coarse_stride, const uint16_t *fine, int fine_stride,
+	int width, int height, uint16_t *depth, int depth_stride)
+{
+	static const depth_merge_fn fn = select_depth_merge();
+	fn(coarse, coarse_stride, fine, fine_stride, width, height, depth, depth_stride);
+}
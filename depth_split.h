@@ -0,0 +1,55 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Coarse + fine depth split for two Main10 streams (scalar, SSE2, AVX2)
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef DEPTH_SPLIT_H
+#define DEPTH_SPLIT_H
+
+#include <stdint.h>
+
+//P010LE keeps 10 most significant bits of depth, split keeps all 16 in two P010LE Y planes:
+//- coarse is depth rounded to 10 bits (P010LE_MAX at most, 64 depth units per step)
+//  this is what single stream depth decodes to, receivers may ignore the fine stream
+//- fine is depth modulo DEPTH_SPLIT_PERIOD in 8 most significant bits (2 spare bits for codec error)
+//
+//merge takes the depth with decoded fine part nearest to decoded coarse:
+//- exact when fine decodes within 1.5 (10 bit) steps and coarse within one step (64 units)
+//- only the 0/DEPTH_SPLIT_PERIOD wrap edges of fine plane are hard for codec (sawtooth)
+//zero depth (no data) stays zero in both planes and after merge
+const int DEPTH_SPLIT_PERIOD = 256;
+
+//width pixels of each row, strides are in bytes
+//coarse and fine are P010LE Y planes (10 bits in the most significant bits)
+typedef void (*depth_split_fn)(const uint16_t *depth, int depth_stride, int width, int height,
+	uint16_t *coarse, int coarse_stride, uint16_t *fine, int fine_stride);
+typedef void (*depth_merge_fn)(const uint16_t *coarse, int coarse_stride, const uint16_t *fine, int fine_stride,
+	int width, int height, uint16_t *depth, int depth_stride);
+
+//the best implementation for this CPU, selected at runtime on first use
+void depth_split(const uint16_t *depth, int depth_stride, int width, int height,
+	uint16_t *coarse, int coarse_stride, uint16_t *fine, int fine_stride);
+void depth_merge(const uint16_t *coarse, int coarse_stride, const uint16_t *fine, int fine_stride,
+	int width, int height, uint16_t *depth, int depth_stride);
+
+void depth_split_scalar(const uint16_t *depth, int depth_stride, int width, int height,
+	uint16_t *coarse, int coarse_stride, uint16_t *fine, int fine_stride);
+void depth_merge_scalar(const uint16_t *coarse, int coarse_stride, const uint16_t *fine, int fine_stride,
+	int width, int height, uint16_t *depth, int depth_stride);
+
+//NULL if not supported by CPU (or not compiled for this architecture)
+//bit exact with scalar versions
+depth_split_fn depth_split_sse2();
+depth_split_fn depth_split_avx2();
+depth_merge_fn depth_merge_sse2();
+depth_merge_fn depth_merge_avx2();
+
+#endif
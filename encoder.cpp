@@ -0,0 +1,275 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Hardware (VAAPI) or software (libx264/libx265) encoding and streaming
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include "encoder.h"
+
+// Hardware Video Encoder (NHVE submodule)
+#include "hve.h"
+
+#include <iostream>
+
+using namespace std;
+
+int encoder_config_parse(const options &opts, encoder_config *config)
+{
+	const string backend = options_get(opts, "encoder", "auto");
+
+	if(backend == "auto")
+		config->backend = ENCODER_AUTO;
+	else if(backend == "vaapi")
+		config->backend = ENCODER_VAAPI;
+	else if(backend == "software")
+		config->backend = ENCODER_SOFTWARE;
+	else if(backend == "null")
+		config->backend = ENCODER_NULL;
+	else
+	{
+		cerr << "unknown encoder '" << backend << "', valid encoders: 'auto', 'vaapi', 'software', 'null'" << endl;
+		return -1;
+	}
+
+	config->software.threads = options_get_int(opts, "encoder-threads", 0);
+	config->software.preset = options_get(opts, "encoder-preset", "");
+	config->software.roi = false;
+	config->roi_subframe = -1;
+
+	if(udp_batch_parse(opts, &config->batch) < 0)
+		return -1;
+
+	if(config->software.threads < 0)
+	{
+		cerr << "encoder threads has to be non-negative (0 for automatic)" << endl;
+		return -1;
+	}
+
+	return 0;
+}
+
+//encoded streams go as MLSP frames with unchanged subframe indices, returns -1 on failure
+static int encoder_init_network(struct encoder *e, const nhve_net_config *net_config, int subframes, UdpBatch batch)
+{
+	if(batch == UDP_BATCH_OFF)
+		return (e->streamer = nhve_init(net_config, NULL, 0, subframes)) ? 0 : -1;
+
+	e->sender = new mlsp_sender(batch, subframes);
+
+	return e->sender->open(*net_config);
+}
+
+static struct encoder *encoder_init_software(const nhve_net_config *net_config, const nhve_hw_config *hw_config,
+                                             int hw_size, int aux_size, const encoder_config &config)
+{
+	encoder *e = new encoder();
+	e->hw_size = hw_size;
+	e->sent_bytes.resize(hw_size + aux_size, -1);
+
+	for(int i = 0; i < hw_size; ++i)
+	{
+		sw_encoder_config software = config.software;
+		software.roi = (i == config.roi_subframe);
+
+		sw_encoder *sw = sw_encoder_init(&hw_config[i], &software);
+
+		if(!sw)
+		{
+			encoder_close(e);
+			return NULL;
+		}
+
+		e->software.push_back(sw);
+	}
+
+	if(encoder_init_network(e, net_config, hw_size + aux_size, config.batch) < 0)
+	{
+		encoder_close(e);
+		return NULL;
+	}
+
+	return e;
+}
+
+//HVE per stream instead of NHVE hardware encoders, so streams may be encoded concurrently
+static struct encoder *encoder_init_vaapi(const nhve_net_config *net_config, const nhve_hw_config *hw_config,
+                                          int hw_size, int aux_size, const encoder_config &config)
+{
+	encoder *e = new encoder();
+	e->hw_size = hw_size;
+	e->sent_bytes.resize(hw_size + aux_size, -1);
+
+	for(int i = 0; i < hw_size; ++i)
+	{
+		hve_config hw = {0};
+		hw.width = hw_config[i].width;
+		hw.height = hw_config[i].height;
+		hw.framerate = hw_config[i].framerate;
+		hw.device = hw_config[i].device;
+		hw.encoder = hw_config[i].encoder;
+		hw.pixel_format = hw_config[i].pixel_format;
+		hw.profile = hw_config[i].profile;
+		hw.max_b_frames = hw_config[i].max_b_frames;
+		hw.bit_rate = hw_config[i].bit_rate;
+		hw.qp = hw_config[i].qp;
+		hw.gop_size = hw_config[i].gop_size;
+		hw.compression_level = hw_config[i].compression_level;
+
+		hve *h = hve_init(&hw);
+
+		if(!h)
+		{
+			encoder_close(e);
+			return NULL;
+		}
+
+		e->hardware.push_back(h);
+	}
+
+	if(encoder_init_network(e, net_config, hw_size + aux_size, config.batch) < 0)
+	{
+		encoder_close(e);
+		return NULL;
+	}
+
+	return e;
+}
+
+struct encoder *encoder_init(const nhve_net_config *net_config, const nhve_hw_config *hw_config,
+                             int hw_size, int aux_size, const encoder_config &config)
+{
+	if(config.backend == ENCODER_SOFTWARE)
+		return encoder_init_software(net_config, hw_config, hw_size, aux_size, config);
+
+	if(config.backend == ENCODER_NULL)
+	{
+		encoder *e = new encoder();
+		e->hw_size = hw_size;
+		e->sent_bytes.resize(hw_size + aux_size, 0);
+		cout << "Null encoder, frames are discarded" << endl;
+		return e;
+	}
+
+	encoder *e = encoder_init_vaapi(net_config, hw_config, hw_size, aux_size, config);
+
+	if(e || config.backend == ENCODER_VAAPI)
+		return e;
+
+	cerr << "WARNING - VAAPI initialization failed, falling back to software encoding" << endl;
+
+	return encoder_init_software(net_config, hw_config, hw_size, aux_size, config);
+}
+
+//encoded packet of subframe as MLSP frame, one send at a time
+static int encoder_send_packet(struct encoder *e, uint8_t *data, int size, uint8_t subframe)
+{
+	nhve_frame packet = { {data}, {size} };
+	lock_guard<mutex> lock(e->send_mutex);
+
+	if(e->sender ? e->sender->send(data, size, subframe) != NHVE_OK : nhve_send(e->streamer, &packet, subframe) != NHVE_OK)
+		return NHVE_ERROR;
+
+	e->sent_bytes[subframe] += size;
+
+	return NHVE_OK;
+}
+
+static int encoder_send_vaapi(struct encoder *e, const nhve_frame *frame, uint8_t subframe)
+{
+	hve *h = e->hardware[subframe];
+	hve_frame video = { {NULL}, {0} };
+	e->sent_bytes[subframe] = 0;
+
+	for(int i = 0; frame && i < NHVE_NUM_DATA_POINTERS; ++i)
+	{
+		video.data[i] = frame->data[i];
+		video.linesize[i] = frame->linesize[i];
+	}
+
+	if(hve_send_frame(h, frame ? &video : NULL) != HVE_OK)
+		return NHVE_ERROR;
+
+	AVPacket *packet;
+	int failed;
+
+	while( (packet = hve_receive_packet(h, &failed)) )
+		if(encoder_send_packet(e, packet->data, packet->size, subframe) != NHVE_OK)
+			return NHVE_ERROR;
+
+	//NULL packet with error is failure during encoding
+	return failed == HVE_OK ? NHVE_OK : NHVE_ERROR;
+}
+
+int encoder_send(struct encoder *e, const nhve_frame *frame, uint8_t subframe)
+{
+	if(!e->streamer && !e->sender)
+		return NHVE_OK; //null encoder
+
+	if(subframe >= e->hw_size && e->sender)
+	{  //auxiliary data is sent as is, nothing to flush
+		e->sent_bytes[subframe] = 0;
+		return frame ? encoder_send_packet(e, frame->data[0], frame->linesize[0], subframe) : NHVE_OK;
+	}
+
+	if(subframe >= e->hw_size)
+	{  //auxiliary data is sent as is
+		e->sent_bytes[subframe] = frame ? frame->linesize[0] : 0;
+		lock_guard<mutex> lock(e->send_mutex);
+		return nhve_send(e->streamer, frame, subframe);
+	}
+
+	if(!e->hardware.empty())
+		return encoder_send_vaapi(e, frame, subframe);
+
+	sw_encoder *sw = e->software[subframe];
+	e->sent_bytes[subframe] = 0;
+
+	if(sw_encoder_send_frame(sw, frame) != NHVE_OK)
+		return NHVE_ERROR;
+
+	nhve_frame packet;
+	int received;
+
+	while( (received = sw_encoder_receive_packet(sw, &packet)) == 1 )
+		if(encoder_send_packet(e, packet.data[0], packet.linesize[0], subframe) != NHVE_OK)
+			return NHVE_ERROR;
+
+	return received == 0 ? NHVE_OK : NHVE_ERROR;
+}
+
+bool encoder_set_roi(struct encoder *e, uint8_t subframe, const vector<sw_encoder_roi> &roi)
+{
+	//HVE doesn't take frame side data, VAAPI encodes without it
+	if(subframe >= e->software.size())
+		return false;
+
+	sw_encoder_set_roi(e->software[subframe], roi);
+
+	return true;
+}
+
+void encoder_close(struct encoder *e)
+{
+	if(!e)
+		return;
+
+	for(size_t i = 0; i < e->hardware.size(); ++i)
+		hve_close(e->hardware[i]);
+
+	for(size_t i = 0; i < e->software.size(); ++i)
+		sw_encoder_close(e->software[i]);
+
+	if(e->streamer)
+		nhve_close(e->streamer);
+
+	delete e->sender;
+
+	delete e;
+}
@@ -0,0 +1,71 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Hardware (VAAPI) or software (libx264/libx265) encoding and streaming
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef ENCODER_H
+#define ENCODER_H
+
+// Network Hardware Video Encoder
+#include "nhve.h"
+
+#include "options.h"
+#include "sw_encoder.h"
+#include "udp_sender.h"
+
+#include <vector>
+#include <mutex>
+
+struct hve;
+
+//- VAAPI encodes with HVE (NHVE's hardware encoder), one encoder per stream
+//- software encodes with libx264/libx265
+//- both send packets as MLSP frames with the same subframe indices (receiving end gets the same bitstream format)
+//  batched by mlsp_sender with --udp-batch=mmsg/gso, otherwise through NHVE auxiliary channels
+//- auto tries VAAPI and falls back to software if it fails to initialize
+//- null discards frames without encoding and sending (measuring the rest of pipeline)
+enum EncoderBackend {ENCODER_AUTO, ENCODER_VAAPI, ENCODER_SOFTWARE, ENCODER_NULL};
+
+struct encoder_config
+{
+	EncoderBackend backend;
+	sw_encoder_config software;
+	int roi_subframe; //-1 for none, software encoder of this subframe gets regions of interest (sw_encoder_config roi)
+	UdpBatch batch;
+};
+
+//--encoder=auto/vaapi/software/null --encoder-threads=N --encoder-preset=P --udp-batch=B, returns -1 on invalid input
+int encoder_config_parse(const options &opts, encoder_config *config);
+
+struct encoder
+{
+	nhve *streamer; //NULL for null encoder and with sender
+	mlsp_sender *sender; //NULL for null encoder and with --udp-batch=off
+	int hw_size;
+	std::vector<hve*> hardware; //one per hw_config with VAAPI
+	std::vector<sw_encoder*> software; //one per hw_config with software encoding
+	std::vector<int> sent_bytes; //encoded bytes sent by the last encoder_send per subframe, -1 if not known
+	std::mutex send_mutex; //NHVE has one socket, packet buffer and frame counter, sends go one at a time
+};
+
+//the same as nhve_init, returns NULL on failure
+struct encoder *encoder_init(const nhve_net_config *net_config, const nhve_hw_config *hw_config,
+                             int hw_size, int aux_size, const encoder_config &config);
+//the same as nhve_send, NULL frame flushes encoder
+//may be called concurrently for different subframes, encoding runs in parallel
+//and only network sends are serialized
+int encoder_send(struct encoder *e, const nhve_frame *frame, uint8_t subframe);
+//regions of interest for the following frames of subframe (software encoding only)
+//returns false if not supported by the backend (ignored)
+bool encoder_set_roi(struct encoder *e, uint8_t subframe, const std::vector<sw_encoder_roi> &roi);
+void encoder_close(struct encoder *e);
+
+#endif
@@ -0,0 +1,106 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Bounded queue between capture and encoding threads
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef FRAME_RING_H
+#define FRAME_RING_H
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+
+//what to do when producer is faster than consumer
+//- drop the oldest item (consumer always gets the latest data, minimal latency)
+//- block producer until consumer makes room (no data is lost)
+enum RingPolicy {RING_DROP_OLDEST, RING_BLOCK};
+
+template<class T>
+class frame_ring
+{
+public:
+	frame_ring(size_t capacity, RingPolicy policy) :
+		capacity(capacity ? capacity : 1), policy(policy), closed(false), dropped_count(0)
+	{}
+
+	//false if ring was closed
+	bool push(T item)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+
+		if(policy == RING_BLOCK)
+			not_full.wait(lock, [this]{ return closed || items.size() < capacity; });
+
+		if(closed)
+			return false;
+
+		if(items.size() >= capacity)
+		{
+			items.pop_front();
+			++dropped_count;
+		}
+
+		items.push_back(std::move(item));
+		lock.unlock();
+
+		not_empty.notify_one();
+		return true;
+	}
+
+	//false if ring was closed and there is nothing more to pop
+	bool pop(T *item)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+
+		not_empty.wait(lock, [this]{ return closed || !items.empty(); });
+
+		if(items.empty())
+			return false;
+
+		*item = std::move(items.front());
+		items.pop_front();
+		lock.unlock();
+
+		not_full.notify_one();
+		return true;
+	}
+
+	//wakes up producer and consumer, further pushes fail
+	void close()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closed = true;
+		}
+		not_empty.notify_all();
+		not_full.notify_all();
+	}
+
+	uint64_t dropped() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return dropped_count;
+	}
+
+private:
+	const size_t capacity;
+	const RingPolicy policy;
+
+	mutable std::mutex mutex;
+	std::condition_variable not_empty;
+	std::condition_variable not_full;
+	std::deque<T> items;
+	bool closed;
+	uint64_t dropped_count;
+};
+
+#endif
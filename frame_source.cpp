@@ -0,0 +1,416 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Frame sources - live camera, recording playback, synthetic frames
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include "frame_source.h"
+
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <cmath>
+#include <stdexcept>
+#include <sstream>
+#include <algorithm>
+
+using namespace std;
+using namespace std::chrono;
+
+//number of distinct synthetic frames played in loop
+const int SYNTHETIC_LOOP_FRAMES = 16;
+//depth units reported by synthetic depth sensor (like D435 default)
+const float SYNTHETIC_DEPTH_UNITS = 0.001f;
+
+int frame_source_config_parse(const options &opts, frame_source_config *config)
+{
+	const string source = options_get(opts, "source", "live");
+
+	config->type = SOURCE_LIVE;
+
+	if(source == "synthetic")
+		config->type = SOURCE_SYNTHETIC;
+	else if(source != "live")
+	{
+		config->type = SOURCE_BAG;
+		config->file = source;
+	}
+
+	config->realtime = options_get_int(opts, "realtime", 1) != 0;
+	config->serial.clear();
+
+	return 0;
+}
+
+vector<string> frame_source_serials()
+{
+	rs2::context context;
+	rs2::device_list devices = context.query_devices();
+	vector<string> serials;
+
+	for(size_t i = 0; i < devices.size(); ++i)
+		if(devices[i].supports(RS2_CAMERA_INFO_SERIAL_NUMBER))
+			serials.push_back(devices[i].get_info(RS2_CAMERA_INFO_SERIAL_NUMBER));
+
+	return serials;
+}
+
+int frame_source_cameras_parse(const options &opts, const frame_source_config &config, vector<string> *serials)
+{
+	const string cameras = options_get(opts, "cameras", "");
+
+	serials->clear();
+
+	if(cameras.empty())
+		return 0;
+
+	if(config.type != SOURCE_LIVE)
+	{
+		cerr << "--cameras works only with live source" << endl;
+		return -1;
+	}
+
+	const vector<string> connected = frame_source_serials();
+
+	if(cameras == "all")
+		*serials = connected;
+	else
+	{
+		stringstream list(cameras);
+		string serial;
+
+		while(getline(list, serial, ','))
+		{
+			if(serial.empty())
+				continue;
+
+			//the same device can't be opened twice
+			if(find(serials->begin(), serials->end(), serial) != serials->end())
+			{
+				cerr << "camera " << serial << " is listed more than once in --cameras" << endl;
+				return -1;
+			}
+
+			serials->push_back(serial);
+		}
+	}
+
+	if(serials->empty())
+	{
+		cerr << "no cameras connected" << endl;
+		return -1;
+	}
+
+	for(const string &serial : *serials)
+		if(find(connected.begin(), connected.end(), serial) == connected.end())
+		{
+			cerr << "camera " << serial << " is not connected, connected cameras:";
+			for(const string &c : connected)
+				cerr << " " << c;
+			cerr << endl;
+			return -1;
+		}
+
+	return 0;
+}
+
+static int bytes_per_pixel(rs2_format format)
+{
+	switch(format)
+	{
+		case RS2_FORMAT_Y8: return 1;
+		case RS2_FORMAT_Z16: case RS2_FORMAT_YUYV: case RS2_FORMAT_UYVY: return 2;
+		case RS2_FORMAT_RGBA8: return 4;
+		default: return 0;
+	}
+}
+
+//pinhole camera roughly like D435 (87 deg depth/infrared and 69 deg color horizontal fov)
+static rs2_intrinsics synthetic_intrinsics(rs2_stream stream, int width, int height)
+{
+	const float hfov = (stream == RS2_STREAM_COLOR ? 69.0f : 87.0f) * M_PI / 180.0f;
+	const float f = width / (2.0f * tan(hfov / 2.0f));
+
+	rs2_intrinsics i = {width, height, width / 2.0f, height / 2.0f, f, f, RS2_DISTORTION_NONE, {0, 0, 0, 0, 0}};
+
+	if(stream == RS2_STREAM_COLOR)
+		i.model = RS2_DISTORTION_INVERSE_BROWN_CONRADY;
+
+	return i;
+}
+
+//tilted background plane with a sphere moving in front of it, invalid band on the left
+static void synthetic_depth(uint16_t *data, int w, int h, int frame)
+{
+	const float t = 2.0f * M_PI * frame / SYNTHETIC_LOOP_FRAMES;
+	const float cx = w * (0.5f + 0.3f * sin(t)), cy = h * 0.5f, r = h * 0.25f;
+
+	for(int y = 0; y < h; ++y)
+		for(int x = 0; x < w; ++x)
+		{
+			float z = 2.0f + 1.5f * y / h;
+			const float dx = x - cx, dy = y - cy, d2 = dx*dx + dy*dy;
+
+			if(d2 < r*r)
+				z = 1.0f - 0.3f * sqrt(1.0f - d2 / (r*r));
+
+			//invalid band (like left edge of stereo depth) and dropouts at sphere edge
+			const bool invalid = x < w / 25 || fabs(sqrt(d2) - r) < 1.0f;
+
+			data[y*w + x] = invalid ? 0 : (uint16_t)(z / SYNTHETIC_DEPTH_UNITS);
+		}
+}
+
+//moving diagonal gradient with checkerboard
+static uint8_t synthetic_intensity(int x, int y, int frame)
+{
+	const int checker = ((x / 32) + (y / 32)) & 1;
+	return (uint8_t)((x + y + frame * 8) / 4 + checker * 64);
+}
+
+static void synthetic_texture(uint8_t *data, rs2_format format, int w, int h, int frame)
+{
+	for(int y = 0; y < h; ++y)
+		for(int x = 0; x < w; ++x)
+		{
+			const uint8_t i = synthetic_intensity(x, y, frame);
+			const uint8_t u = 128 + (x * 64) / w - 32, v = 128 + (y * 64) / h - 32;
+
+			if(format == RS2_FORMAT_Y8)
+				data[y*w + x] = i;
+			else if(format == RS2_FORMAT_RGBA8)
+			{
+				uint8_t *p = data + (y*w + x) * 4;
+				p[0] = i, p[1] = 255 - i, p[2] = u, p[3] = 255;
+			}
+			else //YUYV/UYVY
+			{
+				uint8_t *p = data + (y*w + x) * 2;
+				const bool yuyv = format == RS2_FORMAT_YUYV;
+				p[yuyv ? 0 : 1] = i;
+				p[yuyv ? 1 : 0] = (x & 1) ? v : u;
+			}
+		}
+}
+
+frame_source::frame_source(const frame_source_config &config) :
+	config(config), produced(0), consumed(0), stopping(false), framerate(0)
+{
+	if(config.type == SOURCE_BAG)
+		cfg.enable_device_from_file(config.file, true);
+	else if(config.type == SOURCE_LIVE && !config.serial.empty())
+		cfg.enable_device(config.serial);
+}
+
+frame_source::~frame_source()
+{
+	stop();
+}
+
+void frame_source::enable_stream(rs2_stream stream, int width, int height, rs2_format format, int framerate)
+{
+	if(config.type != SOURCE_SYNTHETIC)
+		return cfg.enable_stream(stream, width, height, format, framerate);
+
+	synthetic_stream s;
+	s.stream = {stream, 0, (int)streams.size(), width, height, framerate, bytes_per_pixel(format), format,
+		synthetic_intrinsics(stream, width, height)};
+
+	this->framerate = framerate;
+	streams.push_back(s);
+}
+
+void frame_source::start()
+{
+	if(config.type == SOURCE_SYNTHETIC)
+		return start_synthetic();
+
+	profile = pipe.start(cfg);
+
+	if(config.type == SOURCE_BAG)
+	{
+		rs2::playback playback = profile.get_device().as<rs2::playback>();
+		playback.set_real_time(config.realtime);
+		cout << "Playing " << config.file << (config.realtime ? " in real time" : " as fast as possible") << endl;
+	}
+}
+
+void frame_source::start_synthetic()
+{
+	if(sensors.empty())
+	{  //first start, build software device
+		device.register_info(RS2_CAMERA_INFO_NAME, "Synthetic");
+		device.register_info(RS2_CAMERA_INFO_SERIAL_NUMBER, "000000000000");
+
+		for(synthetic_stream &s : streams)
+		{
+			rs2::software_sensor sensor = device.add_sensor(s.stream.type == RS2_STREAM_DEPTH ? "Depth" : "Texture");
+
+			if(s.stream.type == RS2_STREAM_DEPTH)
+				sensor.add_read_only_option(RS2_OPTION_DEPTH_UNITS, SYNTHETIC_DEPTH_UNITS);
+
+			s.profile = sensor.add_video_stream(s.stream, true);
+			sensors.push_back(sensor);
+
+			const int size = s.stream.width * s.stream.height * s.stream.bpp;
+
+			for(int f = 0; f < SYNTHETIC_LOOP_FRAMES; ++f)
+			{
+				vector<uint8_t> data(size);
+
+				if(s.stream.fmt == RS2_FORMAT_Z16)
+					synthetic_depth((uint16_t*)&data[0], s.stream.width, s.stream.height, f);
+				else
+					synthetic_texture(&data[0], s.stream.fmt, s.stream.width, s.stream.height, f);
+
+				s.loop.push_back(data);
+			}
+		}
+
+		//depth-texture baseline like D435 (color is 15 mm to the right, infrared is left imager)
+		for(synthetic_stream &s : streams)
+			for(synthetic_stream &other : streams)
+			{
+				rs2_extrinsics extrinsics = { {1,0,0, 0,1,0, 0,0,1}, {0,0,0} };
+
+				if(s.stream.type == RS2_STREAM_DEPTH && other.stream.type == RS2_STREAM_COLOR)
+					extrinsics.translation[0] = 0.015f;
+				else if(s.stream.type == RS2_STREAM_COLOR && other.stream.type == RS2_STREAM_DEPTH)
+					extrinsics.translation[0] = -0.015f;
+
+				if(&s != &other)
+					s.profile.register_extrinsics_to(other.profile, extrinsics);
+			}
+
+		device.create_matcher(RS2_MATCHER_DEFAULT);
+	}
+
+	for(size_t i = 0; i < sensors.size(); ++i)
+	{
+		sensors[i].open(streams[i].profile);
+		sensors[i].start(sync);
+	}
+
+	stopping = false;
+	generator = thread(&frame_source::generate, this);
+
+	cout << "Generating synthetic frames" << (config.realtime ? " in real time" : " as fast as possible") << endl;
+}
+
+void frame_source::generate()
+{
+	const steady_clock::time_point start = steady_clock::now();
+	const nanoseconds period = nanoseconds(1000000000LL / (framerate ? framerate : 30));
+
+	for(int frame_number = 0; ; ++frame_number)
+	{
+		{
+			unique_lock<mutex> lock(generator_mutex);
+			//don't run ahead of consumer, as fast as possible means as fast as consumed
+			//(consumer is capture thread, with blocking ring it waits for encoding)
+			consumed_cv.wait(lock, [this]{ return stopping || config.realtime || produced - consumed < 2; });
+
+			if(stopping)
+				return;
+
+			++produced;
+		}
+
+		if(config.realtime)
+			this_thread::sleep_until(start + period * frame_number);
+
+		//host synchronized timestamps make sensor to sent latency meaningful
+		const double timestamp = duration<double, milli>(system_clock::now().time_since_epoch()).count();
+
+		for(size_t i = 0; i < streams.size(); ++i)
+		{
+			const synthetic_stream &s = streams[i];
+			const vector<uint8_t> &src = s.loop[frame_number % SYNTHETIC_LOOP_FRAMES];
+
+			//downstream processing may modify frames in place, each frame needs its own copy
+			uint8_t *pixels = new uint8_t[src.size()];
+			memcpy(pixels, &src[0], src.size());
+
+			sensors[i].on_video_frame({pixels, [](void *p){ delete [] (uint8_t*)p; },
+				s.stream.width * s.stream.bpp, s.stream.bpp, timestamp,
+				RS2_TIMESTAMP_DOMAIN_SYSTEM_TIME, frame_number, s.profile,
+				s.stream.fmt == RS2_FORMAT_Z16 ? SYNTHETIC_DEPTH_UNITS : 0.0f});
+		}
+	}
+}
+
+void frame_source::stop()
+{
+	if(config.type != SOURCE_SYNTHETIC)
+	{
+		if(profile)
+			pipe.stop();
+		profile = rs2::pipeline_profile();
+		return;
+	}
+
+	if(!generator.joinable())
+		return;
+
+	{
+		lock_guard<mutex> lock(generator_mutex);
+		stopping = true;
+	}
+	consumed_cv.notify_all();
+
+	generator.join();
+
+	for(size_t i = 0; i < sensors.size(); ++i)
+	{
+		sensors[i].stop();
+		sensors[i].close();
+	}
+}
+
+rs2::frameset frame_source::wait_for_frames()
+{
+	if(config.type != SOURCE_SYNTHETIC)
+		return pipe.wait_for_frames();
+
+	rs2::frameset frameset = sync.wait_for_frames();
+
+	{
+		lock_guard<mutex> lock(generator_mutex);
+		++consumed;
+	}
+	consumed_cv.notify_one();
+
+	return frameset;
+}
+
+rs2::device frame_source::get_device() const
+{
+	if(config.type == SOURCE_SYNTHETIC)
+		return device;
+
+	return profile.get_device();
+}
+
+rs2::stream_profile frame_source::get_stream(rs2_stream stream) const
+{
+	if(config.type != SOURCE_SYNTHETIC)
+		return profile.get_stream(stream);
+
+	for(const synthetic_stream &s : streams)
+		if(s.stream.type == stream)
+			return s.profile;
+
+	throw runtime_error("stream not enabled in synthetic source");
+}
+
+bool frame_source::is_live() const
+{
+	return config.type == SOURCE_LIVE;
+}
@@ -0,0 +1,104 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Frame sources - live camera, recording playback, synthetic frames
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef FRAME_SOURCE_H
+#define FRAME_SOURCE_H
+
+#include "options.h"
+
+// Realsense API
+#include <librealsense2/rs.hpp>
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//- live Realsense camera
+//- .bag recording played back through librealsense
+//- procedurally generated frames through librealsense software device
+//
+//all sources give regular librealsense frames (depth units, intrinsics, extrinsics)
+//so that post-processing, alignment and encoding run unchanged
+enum FrameSourceType {SOURCE_LIVE, SOURCE_BAG, SOURCE_SYNTHETIC};
+
+struct frame_source_config
+{
+	FrameSourceType type;
+	std::string file; //recording for SOURCE_BAG
+	std::string serial; //camera for SOURCE_LIVE, empty for any
+	bool realtime; //false - playback/generate as fast as consumed (needs blocking capture ring)
+};
+
+//--source=live/synthetic/recording.bag --realtime=0/1, returns -1 on invalid input
+int frame_source_config_parse(const options &opts, frame_source_config *config);
+
+//serial numbers of connected cameras
+std::vector<std::string> frame_source_serials();
+
+//--cameras=all or --cameras=SERIAL,SERIAL,... (live source only)
+//serials are empty without the option, returns -1 on invalid input (e.g. duplicate serial) or camera not connected
+int frame_source_cameras_parse(const options &opts, const frame_source_config &config, std::vector<std::string> *serials);
+
+struct synthetic_stream
+{
+	rs2_video_stream stream;
+	rs2::stream_profile profile;
+	std::vector<std::vector<uint8_t> > loop; //pregenerated frames
+};
+
+class frame_source
+{
+public:
+	explicit frame_source(const frame_source_config &config);
+	~frame_source();
+
+	void enable_stream(rs2_stream stream, int width, int height, rs2_format format, int framerate);
+
+	void start();
+	void stop();
+
+	rs2::frameset wait_for_frames();
+
+	rs2::device get_device() const;
+	rs2::stream_profile get_stream(rs2_stream stream) const;
+
+	//camera settings (depth units, advanced mode, json) may be changed only for live source
+	bool is_live() const;
+
+private:
+	void start_synthetic();
+	void generate();
+
+	const frame_source_config config;
+
+	//live camera and recording playback
+	rs2::pipeline pipe;
+	rs2::config cfg;
+	rs2::pipeline_profile profile;
+
+	//synthetic frames
+	rs2::software_device device;
+	std::vector<rs2::software_sensor> sensors;
+	std::vector<synthetic_stream> streams;
+	rs2::syncer sync;
+	std::thread generator;
+	std::mutex generator_mutex;
+	std::condition_variable consumed_cv;
+	unsigned long long produced, consumed;
+	bool stopping;
+	int framerate;
+};
+
+#endif
@@ -0,0 +1,45 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * MLSP datagram header
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include "mlsp_packet.h"
+
+#include <cstring>
+
+void mlsp_header_write(const mlsp_header &header, uint8_t *data)
+{
+	memcpy(data, &header.framenumber, 2);
+	data[2] = header.subframes;
+	data[3] = header.subframe;
+	memcpy(data + 4, &header.packets, 2);
+	memcpy(data + 6, &header.packet, 2);
+}
+
+bool mlsp_header_read(const uint8_t *data, int size, mlsp_header *header)
+{
+	if(size < MLSP_HEADER)
+		return false;
+
+	memcpy(&header->framenumber, data, 2);
+	header->subframes = data[2];
+	header->subframe = data[3];
+	memcpy(&header->packets, data + 4, 2);
+	memcpy(&header->packet, data + 6, 2);
+
+	return header->subframe < header->subframes && header->packet < header->packets;
+}
+
+bool mlsp_subframe_end(const uint8_t *data, int size)
+{
+	mlsp_header header;
+	return mlsp_header_read(data, size, &header) && header.packet == header.packets - 1;
+}
@@ -0,0 +1,46 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * MLSP datagram header
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef MLSP_PACKET_H
+#define MLSP_PACKET_H
+
+#include <stdint.h>
+
+//every MLSP datagram starts with header (host byte order like MLSP):
+//- framenumber (2 bytes)
+//- subframes in frame (1 byte)
+//- subframe (1 byte), the stream (e.g. depth, texture)
+//- packets of subframe (2 bytes)
+//- packet index (2 bytes)
+//followed by up to MLSP_MAX_PAYLOAD bytes of encoded subframe
+const int MLSP_HEADER = 8;
+const int MLSP_MAX_PAYLOAD = 1400;
+
+struct mlsp_header
+{
+	uint16_t framenumber;
+	uint8_t subframes;
+	uint8_t subframe;
+	uint16_t packets;
+	uint16_t packet;
+};
+
+void mlsp_header_write(const mlsp_header &header, uint8_t *data);
+
+//false if datagram is too short or header is not consistent
+bool mlsp_header_read(const uint8_t *data, int size, mlsp_header *header);
+
+//true for the last datagram of subframe (sender moves on to the next subframe or frame)
+bool mlsp_subframe_end(const uint8_t *data, int size);
+
+#endif
@@ -0,0 +1,64 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Optional --name=value command line arguments
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include "options.h"
+
+#include <cstring>
+#include <cstdlib>
+
+int options_parse(int argc, char *argv[], options *opts)
+{
+	int positional = 1;
+
+	for(int i = 1; i < argc; ++i)
+	{
+		if(strncmp(argv[i], "--", 2) != 0)
+		{
+			argv[positional++] = argv[i];
+			continue;
+		}
+
+		std::string arg(argv[i] + 2);
+		size_t eq = arg.find('=');
+
+		if(eq == std::string::npos)
+			opts->values[arg] = "";
+		else
+			opts->values[arg.substr(0, eq)] = arg.substr(eq + 1);
+	}
+
+	argv[positional] = NULL;
+
+	return positional;
+}
+
+bool options_has(const options &opts, const std::string &name)
+{
+	return opts.values.find(name) != opts.values.end();
+}
+
+std::string options_get(const options &opts, const std::string &name, const std::string &def)
+{
+	std::map<std::string, std::string>::const_iterator it = opts.values.find(name);
+	return it == opts.values.end() ? def : it->second;
+}
+
+int options_get_int(const options &opts, const std::string &name, int def)
+{
+	return options_has(opts, name) ? atoi(options_get(opts, name, "").c_str()) : def;
+}
+
+float options_get_float(const options &opts, const std::string &name, float def)
+{
+	return options_has(opts, name) ? strtof(options_get(opts, name, "").c_str(), NULL) : def;
+}
@@ -0,0 +1,36 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Optional --name=value command line arguments
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <map>
+#include <string>
+
+//optional arguments may appear anywhere on the command line as:
+//--name=value or --name (for flags, value is then empty)
+struct options
+{
+	std::map<std::string, std::string> values;
+};
+
+//extracts optional arguments from argv leaving positional arguments in order
+//argv stays NULL terminated, returns the new argc
+int options_parse(int argc, char *argv[], options *opts);
+
+bool options_has(const options &opts, const std::string &name);
+std::string options_get(const options &opts, const std::string &name, const std::string &def);
+int options_get_int(const options &opts, const std::string &name, int def);
+float options_get_float(const options &opts, const std::string &name, float def);
+
+#endif
@@ -0,0 +1,153 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Pixel format conversions for software encoding
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include "pixel_convert.h"
+
+#include <cstring>
+
+//the loops are simple enough for compiler to vectorize in optimized build
+
+void pixel_convert_p010le(const nhve_frame &src, int width, int height, nhve_frame *dst)
+{
+	for(int y = 0; y < height; ++y)
+	{
+		const uint16_t *in = (const uint16_t*)(src.data[0] + y * src.linesize[0]);
+		uint16_t *out = (uint16_t*)(dst->data[0] + y * dst->linesize[0]);
+
+		for(int x = 0; x < width; ++x)
+			out[x] = in[x] >> 6;
+	}
+
+	for(int y = 0; y < height / 2; ++y)
+	{
+		const uint16_t *in = (const uint16_t*)(src.data[1] + y * src.linesize[1]);
+		uint16_t *u = (uint16_t*)(dst->data[1] + y * dst->linesize[1]);
+		uint16_t *v = (uint16_t*)(dst->data[2] + y * dst->linesize[2]);
+
+		for(int x = 0; x < width / 2; ++x)
+		{
+			u[x] = in[2*x] >> 6;
+			v[x] = in[2*x+1] >> 6;
+		}
+	}
+}
+
+void pixel_convert_nv12(const nhve_frame &src, int width, int height, nhve_frame *dst)
+{
+	for(int y = 0; y < height; ++y)
+		memcpy(dst->data[0] + y * dst->linesize[0], src.data[0] + y * src.linesize[0], width);
+
+	for(int y = 0; y < height / 2; ++y)
+	{
+		const uint8_t *in = src.data[1] + y * src.linesize[1];
+		uint8_t *u = dst->data[1] + y * dst->linesize[1];
+		uint8_t *v = dst->data[2] + y * dst->linesize[2];
+
+		for(int x = 0; x < width / 2; ++x)
+		{
+			u[x] = in[2*x];
+			v[x] = in[2*x+1];
+		}
+	}
+}
+
+//packed 4:2:2 with luma at byte offset luma and U/V at chroma, chroma + 2
+static void packed422_to_yuv420p(const nhve_frame &src, int width, int height, nhve_frame *dst, int luma, int chroma)
+{
+	for(int y = 0; y < height; y += 2)
+	{
+		const uint8_t *in0 = src.data[0] + y * src.linesize[0];
+		const uint8_t *in1 = in0 + src.linesize[0];
+		uint8_t *y0 = dst->data[0] + y * dst->linesize[0];
+		uint8_t *y1 = y0 + dst->linesize[0];
+		uint8_t *u = dst->data[1] + y / 2 * dst->linesize[1];
+		uint8_t *v = dst->data[2] + y / 2 * dst->linesize[2];
+
+		for(int x = 0; x < width; ++x)
+		{
+			y0[x] = in0[2*x + luma];
+			y1[x] = in1[2*x + luma];
+		}
+
+		for(int x = 0; x < width / 2; ++x)
+		{
+			u[x] = (in0[4*x + chroma] + in1[4*x + chroma] + 1) >> 1;
+			v[x] = (in0[4*x + chroma + 2] + in1[4*x + chroma + 2] + 1) >> 1;
+		}
+	}
+}
+
+void pixel_convert_yuyv422(const nhve_frame &src, int width, int height, nhve_frame *dst)
+{
+	packed422_to_yuv420p(src, width, height, dst, 0, 1);
+}
+
+void pixel_convert_uyvy422(const nhve_frame &src, int width, int height, nhve_frame *dst)
+{
+	packed422_to_yuv420p(src, width, height, dst, 1, 0);
+}
+
+static inline uint8_t rgb_to_y(int r, int g, int b)
+{
+	return ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+}
+
+void pixel_convert_rgb0(const nhve_frame &src, int width, int height, nhve_frame *dst)
+{
+	for(int y = 0; y < height; y += 2)
+	{
+		const uint8_t *in0 = src.data[0] + y * src.linesize[0];
+		const uint8_t *in1 = in0 + src.linesize[0];
+		uint8_t *y0 = dst->data[0] + y * dst->linesize[0];
+		uint8_t *y1 = y0 + dst->linesize[0];
+		uint8_t *u = dst->data[1] + y / 2 * dst->linesize[1];
+		uint8_t *v = dst->data[2] + y / 2 * dst->linesize[2];
+
+		for(int x = 0; x < width; ++x)
+		{
+			y0[x] = rgb_to_y(in0[4*x], in0[4*x+1], in0[4*x+2]);
+			y1[x] = rgb_to_y(in1[4*x], in1[4*x+1], in1[4*x+2]);
+		}
+
+		for(int x = 0; x < width / 2; ++x)
+		{  //average of 2x2 block (sum is 4x the average)
+			const int r = in0[8*x] + in0[8*x+4] + in1[8*x] + in1[8*x+4];
+			const int g = in0[8*x+1] + in0[8*x+5] + in1[8*x+1] + in1[8*x+5];
+			const int b = in0[8*x+2] + in0[8*x+6] + in1[8*x+2] + in1[8*x+6];
+
+			u[x] = ((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128;
+			v[x] = ((112 * r - 94 * g - 18 * b + 512) >> 10) + 128;
+		}
+	}
+}
+
+pixel_convert_fn pixel_convert_find(const char *pixel_format, int *bit_depth)
+{
+	*bit_depth = 8;
+
+	if(!strcmp(pixel_format, "p010le"))
+	{
+		*bit_depth = 10;
+		return pixel_convert_p010le;
+	}
+	if(!strcmp(pixel_format, "nv12"))
+		return pixel_convert_nv12;
+	if(!strcmp(pixel_format, "yuyv422"))
+		return pixel_convert_yuyv422;
+	if(!strcmp(pixel_format, "uyvy422"))
+		return pixel_convert_uyvy422;
+	if(!strcmp(pixel_format, "rgb0"))
+		return pixel_convert_rgb0;
+
+	return NULL;
+}
@@ -0,0 +1,41 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Pixel format conversions for software encoding
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef PIXEL_CONVERT_H
+#define PIXEL_CONVERT_H
+
+// Network Hardware Video Encoder
+#include "nhve.h"
+
+//VAAPI takes our formats directly (converting in hardware if needed)
+//while libx264/libx265 want planar 4:2:0, those do the conversion on CPU
+//
+//src is laid out like for nhve_send, dst is planar (Y, U, V)
+//width and height have to be even
+typedef void (*pixel_convert_fn)(const nhve_frame &src, int width, int height, nhve_frame *dst);
+
+//P010LE -> YUV420P10LE, exact (10 significant bits are shifted down)
+void pixel_convert_p010le(const nhve_frame &src, int width, int height, nhve_frame *dst);
+//NV12 -> YUV420P
+void pixel_convert_nv12(const nhve_frame &src, int width, int height, nhve_frame *dst);
+//YUYV422/UYVY422 -> YUV420P, chroma of row pairs is averaged
+void pixel_convert_yuyv422(const nhve_frame &src, int width, int height, nhve_frame *dst);
+void pixel_convert_uyvy422(const nhve_frame &src, int width, int height, nhve_frame *dst);
+//RGB0 -> YUV420P, BT.601 limited range (like Intel VAAPI color conversion)
+void pixel_convert_rgb0(const nhve_frame &src, int width, int height, nhve_frame *dst);
+
+//conversion for FFmpeg pixel format name used with VAAPI (e.g. "p010le")
+//NULL if not supported, bit_depth is set to 8 or 10
+pixel_convert_fn pixel_convert_find(const char *pixel_format, int *bit_depth);
+
+#endif
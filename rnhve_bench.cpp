@@ -0,0 +1,1470 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Microbenchmarks of the CPU work done per frame
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include "depth_kernels.h"
+#include "pixel_convert.h"
+#include "frame_source.h"
+#include "capture.h"
+#include "encoder.h"
+#include "stream_workers.h"
+#include "options.h"
+#include "depth_align.h"
+#include "chroma_plane.h"
+#include "sw_encoder.h"
+#include "depth_pack.h"
+#include "depth_split.h"
+#include "depth_curve.h"
+#include "depth_range.h"
+#include "depth_inpaint.h"
+#include "depth_denoise.h"
+#include "depth_roi.h"
+#include "rnhve_bench.h"
+
+// Realsense API
+#include <librealsense2/rs.hpp>
+
+// decoding for quality measurements
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+
+using namespace std;
+
+struct resolution
+{
+	int width;
+	int height;
+};
+
+const resolution RESOLUTIONS[] = { {640, 480}, {848, 480}, {1024, 768}, {1280, 720} };
+const int ALIGN_ITERATIONS = 60;
+const int END_TO_END_FRAMESETS = 300;
+const int ENCODE_FRAMESETS = 90;
+const int ENCODE_QP = 24;
+const int CURVE_BIT_RATE = 2000000;
+const depth_roi_config ROI = {10, 1.0f, 3.0f};
+
+//single measurement, time is median over iterations (robust against scheduling noise)
+struct bench_result
+{
+	string name;
+	string variant;
+	int width;
+	int height;
+	double ms;
+	int exact; //1 matches reference, 0 mismatch, -1 not checked
+};
+
+vector<bench_result> results;
+
+void add_result(const string &name, const string &variant, int width, int height, double ms, int exact)
+{
+	bench_result r = {name, variant, width, height, ms, exact};
+	results.push_back(r);
+
+	cout << "  " << setw(20) << left << name << setw(26) << variant << right
+		<< setw(4) << width << "x" << setw(4) << left << height << right
+		<< " " << fixed << setprecision(3) << setw(8) << ms << " ms"
+		<< (exact == 0 ? " MISMATCH" : "") << endl;
+}
+
+double bench(int iterations, const function<void()> &setup, const function<void()> &run)
+{
+	vector<double> times;
+
+	for(int i = 0; i < iterations; ++i)
+	{
+		setup();
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		run();
+		times.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+	}
+
+	sort(times.begin(), times.end());
+
+	return times[times.size() / 2];
+}
+
+void fill_random(uint8_t *data, size_t size)
+{
+	uint32_t state = 12345;
+
+	for(size_t i = 0; i < size; ++i)
+	{
+		state = state * 1664525 + 1013904223;
+		data[i] = state >> 24;
+	}
+}
+
+//deterministic pseudo random depth, some of it out of range after rescaling
+void fill_depth(vector<uint16_t> &depth)
+{
+	fill_random((uint8_t*)&depth[0], depth.size() * sizeof(uint16_t));
+}
+
+void bench_depth_rescale()
+{
+	const char *names[] = {"scalar", "sse2", "avx2"};
+	depth_rescale_fn fns[] = {depth_rescale_scalar, depth_rescale_sse2(), depth_rescale_avx2()};
+
+	cout << "depth_rescale (runtime selected: " << depth_rescale_name() << ")" << endl;
+
+	for(const resolution &r : RESOLUTIONS)
+	{
+		//Realsense may pad rows, benchmark with some padding
+		const int stride = (r.width + 32) * sizeof(uint16_t);
+		vector<uint16_t> input(stride / 2 * r.height), work(input.size()), reference(input.size());
+
+		fill_depth(input);
+
+		reference = input;
+		depth_rescale_scalar(&reference[0], r.width, r.height, stride, 2.5f);
+
+		auto restore = [&]{ memcpy(&work[0], &input[0], input.size() * sizeof(uint16_t)); };
+
+		for(int i = 0; i < 3; ++i)
+		{
+			if(!fns[i])
+			{
+				cout << "  " << r.width << "x" << r.height << " " << names[i] << " not supported" << endl;
+				continue;
+			}
+
+			double ms = bench(ITERATIONS, restore, [&]{ fns[i](&work[0], r.width, r.height, stride, 2.5f); });
+			add_result("depth_rescale", names[i], r.width, r.height, ms, work == reference);
+		}
+
+		depth_lut lut;
+		depth_lut_update(&lut, 2.5f);
+
+		double ms = bench(ITERATIONS, restore, [&]{ depth_lut_apply(lut, &work[0], r.width, r.height, stride); });
+		add_result("depth_rescale", "lut", r.width, r.height, ms, work == reference);
+
+		//what process_depth_data does (table or arithmetic, whichever is faster)
+		ms = bench(ITERATIONS, restore, [&]{ depth_rescale(&lut, &work[0], r.width, r.height, stride, 2.5f); });
+		add_result("process_depth_data", lut.use_table ? "table" : "arithmetic", r.width, r.height, ms, work == reference);
+	}
+
+	depth_lut lut;
+	double ms = bench(1, []{}, [&]{ depth_lut_update(&lut, 2.5f); });
+	add_result("depth_lut_build", "with calibration", 0, 0, ms, -1);
+
+	float multiplier = 1.0f;
+	ms = bench(20, [&]{ multiplier += 0.125f; }, [&]{ depth_lut_update(&lut, multiplier); });
+	add_result("depth_lut_build", "rebuild", 0, 0, ms, -1);
+}
+
+//dummy U/V plane for P010LE depth and NV12 infrared
+void bench_dummy_chroma()
+{
+	cout << "dummy chroma plane" << endl;
+
+	for(const resolution &r : RESOLUTIONS)
+	{
+		const int stride = r.width * sizeof(uint16_t);
+		const int size = stride / 2 * r.height / 2;
+		vector<uint16_t> p010(size), reference(size, UINT16_MAX / 2);
+		vector<uint8_t> nv12(r.width * r.height / 2);
+
+		double ms = bench(ITERATIONS, [&]{ p010.assign(size, 0); }, [&]{
+			for(int i = 0; i < size; ++i)
+				p010[i] = UINT16_MAX / 2;
+		});
+		add_result("dummy_chroma", "p010 loop", r.width, r.height, ms, p010 == reference);
+
+		ms = bench(ITERATIONS, [&]{ p010.assign(size, 0); }, [&]{ fill_n(p010.begin(), size, UINT16_MAX / 2); });
+		add_result("dummy_chroma", "p010 fill_n", r.width, r.height, ms, p010 == reference);
+
+		ms = bench(ITERATIONS, []{}, [&]{ memset(&nv12[0], 128, nv12.size()); });
+		add_result("dummy_chroma", "nv12 memset", r.width, r.height, ms, -1);
+
+		//what the programs do per frame (after the first frame of the size)
+		const uint8_t *plane = chroma_plane_p010le(stride, r.height);
+		ms = bench(ITERATIONS, []{}, [&]{ plane = chroma_plane_p010le(stride, r.height); });
+		add_result("dummy_chroma", "p010 shared plane", r.width, r.height, ms, memcmp(plane, &reference[0], size * 2) == 0);
+
+		vector<uint8_t> ir(r.width * r.height);
+		fill_random(&ir[0], ir.size());
+
+		ms = bench(ITERATIONS, []{}, [&]{ chroma_plane_pack_ir(&ir[0], r.width, r.width, r.height, &p010[0], stride); });
+		add_result("dummy_chroma", "p010 ir packing", r.width, r.height, ms, -1);
+	}
+}
+
+//16 bit depth to 8 bit NV12 for H.264 and back (receiving end)
+void bench_depth_pack()
+{
+	const char *names[] = {"scalar", "sse2"};
+	depth_pack_fn packs[] = {depth_pack_nv12_scalar, depth_pack_nv12_sse2()};
+	depth_unpack_fn unpacks[] = {depth_unpack_nv12_scalar, depth_unpack_nv12_sse2()};
+
+	cout << "depth_pack" << endl;
+
+	for(const resolution &r : RESOLUTIONS)
+	{
+		vector<uint16_t> depth(r.width * r.height), unpacked(depth.size()), reference_unpacked(depth.size());
+		vector<uint8_t> nv12(r.width * r.height * 3 / 2), reference(nv12.size());
+
+		fill_depth(depth);
+		depth_pack_nv12_scalar(&depth[0], r.width * 2, r.width, r.height, &reference[0], r.width, &reference[r.width * r.height], r.width);
+		depth_unpack_nv12_scalar(&reference[0], r.width, &reference[r.width * r.height], r.width,
+			r.width, r.height, &reference_unpacked[0], r.width * 2);
+
+		for(int i = 0; i < 2; ++i)
+		{
+			if(packs[i] == NULL)
+				continue;
+
+			double ms = bench(ITERATIONS, []{}, [&]{
+				packs[i](&depth[0], r.width * 2, r.width, r.height, &nv12[0], r.width, &nv12[r.width * r.height], r.width);
+			});
+			add_result("depth_pack", names[i], r.width, r.height, ms, nv12 == reference);
+
+			ms = bench(ITERATIONS, []{}, [&]{
+				unpacks[i](&reference[0], r.width, &reference[r.width * r.height], r.width,
+					r.width, r.height, &unpacked[0], r.width * 2);
+			});
+			add_result("depth_unpack", names[i], r.width, r.height, ms, unpacked == reference_unpacked);
+		}
+	}
+}
+
+//coarse + fine depth for two Main10 streams and back (receiving end)
+void bench_depth_split()
+{
+	const char *names[] = {"scalar", "sse2", "avx2"};
+	depth_split_fn splits[] = {depth_split_scalar, depth_split_sse2(), depth_split_avx2()};
+	depth_merge_fn merges[] = {depth_merge_scalar, depth_merge_sse2(), depth_merge_avx2()};
+
+	cout << "depth_split" << endl;
+
+	for(const resolution &r : RESOLUTIONS)
+	{
+		const int size = r.width * r.height;
+		const int stride = r.width * 2;
+		vector<uint16_t> depth(size), coarse(size), fine(size), merged(size);
+
+		fill_depth(depth);
+
+		for(int i = 0; i < 3; ++i)
+		{
+			if(splits[i] == NULL)
+				continue;
+
+			double ms = bench(ITERATIONS, []{}, [&]{
+				splits[i](&depth[0], stride, r.width, r.height, &coarse[0], stride, &fine[0], stride);
+			});
+			add_result("depth_split", names[i], r.width, r.height, ms, -1);
+
+			//without codec merge restores depth exactly
+			ms = bench(ITERATIONS, [&]{ merged.assign(size, 0); }, [&]{
+				merges[i](&coarse[0], stride, &fine[0], stride, r.width, r.height, &merged[0], stride);
+			});
+			add_result("depth_merge", names[i], r.width, r.height, ms, merged == depth);
+		}
+	}
+}
+
+//adaptive depth range histogram, one counter array vs interleaved sub-histograms
+void bench_depth_histogram()
+{
+	cout << "depth_histogram" << endl;
+
+	for(const resolution &r : RESOLUTIONS)
+	{
+		vector<uint16_t> depth(r.width * r.height);
+		vector<uint32_t> histogram(DEPTH_HISTOGRAM_BINS), reference(DEPTH_HISTOGRAM_BINS);
+
+		//spatially coherent like real depth (neighbours in the same bin)
+		for(int y = 0; y < r.height; ++y)
+			for(int x = 0; x < r.width; ++x)
+				depth[y * r.width + x] = 5000 + x * 10 + y;
+
+		for(uint16_t d : depth)
+			++reference[d >> DEPTH_HISTOGRAM_SHIFT];
+
+		double ms = bench(ITERATIONS, [&]{ histogram.assign(DEPTH_HISTOGRAM_BINS, 0); }, [&]{
+			for(uint16_t d : depth)
+				++histogram[d >> DEPTH_HISTOGRAM_SHIFT];
+		});
+		add_result("depth_histogram", "one histogram", r.width, r.height, ms, histogram == reference);
+
+		ms = bench(ITERATIONS, [&]{ histogram.assign(DEPTH_HISTOGRAM_BINS, 0); }, [&]{
+			depth_histogram(&depth[0], r.width, r.height, r.width * 2, &histogram[0]);
+		});
+		add_result("depth_histogram", "sub-histograms", r.width, r.height, ms, histogram == reference);
+	}
+}
+
+//conversions done for software encoding
+void bench_pixel_convert()
+{
+	struct conversion
+	{
+		const char *name;
+		int bytes_per_pixel; //of the packed or luma plane
+		int planes;
+	};
+
+	const conversion conversions[] = { {"p010le", 2, 2}, {"nv12", 1, 2}, {"yuyv422", 2, 1}, {"uyvy422", 2, 1}, {"rgb0", 4, 1} };
+
+	cout << "pixel_convert" << endl;
+
+	for(const resolution &r : RESOLUTIONS)
+		for(const conversion &c : conversions)
+		{
+			int bit_depth;
+			pixel_convert_fn convert = pixel_convert_find(c.name, &bit_depth);
+			const int out_bpp = bit_depth > 8 ? 2 : 1;
+
+			vector<uint8_t> in(r.width * r.height * c.bytes_per_pixel * 2), out(r.width * r.height * out_bpp * 2);
+			fill_random(&in[0], in.size());
+
+			nhve_frame src = { {0}, {0} }, dst = { {0}, {0} };
+			src.data[0] = &in[0];
+			src.linesize[0] = r.width * c.bytes_per_pixel;
+			src.data[1] = (c.planes == 2) ? &in[0] + src.linesize[0] * r.height : NULL;
+			src.linesize[1] = (c.planes == 2) ? src.linesize[0] : 0;
+
+			dst.data[0] = &out[0];
+			dst.linesize[0] = r.width * out_bpp;
+			dst.data[1] = dst.data[0] + dst.linesize[0] * r.height;
+			dst.data[2] = dst.data[1] + dst.linesize[0] / 2 * r.height / 2;
+			dst.linesize[1] = dst.linesize[2] = dst.linesize[0] / 2;
+
+			double ms = bench(ITERATIONS, []{}, [&]{ convert(src, r.width, r.height, &dst); });
+			add_result("pixel_convert", c.name, r.width, r.height, ms, -1);
+		}
+}
+
+frame_source_config synthetic_source()
+{
+	frame_source_config config;
+	config.type = SOURCE_SYNTHETIC;
+	config.realtime = false;
+	return config;
+}
+
+//fraction of identical pixels and max byte difference (for depth max depth difference)
+void compare_aligned(const aligned_image &image, const rs2::video_frame &reference, bool depth)
+{
+	const int bpp = reference.get_bytes_per_pixel();
+	const int stride = reference.get_stride_in_bytes();
+	const uint8_t *data = (const uint8_t*)reference.get_data();
+	int same = 0, max_diff = 0;
+
+	for(int y = 0; y < image.height; ++y)
+	{
+		const uint8_t *a = image.data + y * image.stride, *b = data + y * stride;
+
+		for(int x = 0; x < image.width; ++x, a += bpp, b += bpp)
+		{
+			if(memcmp(a, b, bpp) == 0)
+			{
+				++same;
+				continue;
+			}
+
+			if(depth)
+				max_diff = max(max_diff, abs(*(uint16_t*)a - *(uint16_t*)b));
+			else
+				for(int i = 0; i < bpp; ++i)
+					max_diff = max(max_diff, abs(a[i] - b[i]));
+		}
+	}
+
+	//the same math in different order, rounding at pixel boundaries rarely differs
+	cout << "  " << setw(46) << left << "depth_aligner vs rs2::align" << right << fixed << setprecision(3) <<
+		100.0 * same / (image.width * image.height) << "% identical pixels, max difference " << max_diff << endl;
+}
+
+//rs2::align and depth_aligner in both directions on synthetic D435 like frames
+void bench_align()
+{
+	const resolution depth = {848, 480}, color = {1280, 720};
+	thread_pool pool(0), single(1);
+
+	cout << "alignment (synthetic frames, " << pool.size() << " threads)" << endl;
+
+	for(int to_color = 1; to_color >= 0; --to_color)
+	{
+		frame_source source(synthetic_source());
+		//librealsense can't align YUYV to depth
+		source.enable_stream(RS2_STREAM_DEPTH, depth.width, depth.height, RS2_FORMAT_Z16, 30);
+		source.enable_stream(RS2_STREAM_COLOR, color.width, color.height, to_color ? RS2_FORMAT_YUYV : RS2_FORMAT_RGBA8, 30);
+		source.start();
+
+		rs2::align aligner(to_color ? RS2_STREAM_COLOR : RS2_STREAM_DEPTH);
+		rs2::frameset frameset, aligned;
+
+		//the first frames initialize aligner (intrinsics, extrinsics, tables)
+		for(int i = 0; i < 3; ++i)
+			aligned = aligner.process(source.wait_for_frames());
+
+		double ms = bench(ALIGN_ITERATIONS, [&]{ frameset = source.wait_for_frames(); }, [&]{ aligned = aligner.process(frameset); });
+
+		const resolution &target = to_color ? color : depth;
+		const string variant = to_color ? "depth to color" : "color to depth";
+		add_result("rs2_align", variant, target.width, target.height, ms, -1);
+
+		depth_aligner mapped(to_color ? ALIGN_TO_COLOR : ALIGN_TO_DEPTH, pool), mapped_single(to_color ? ALIGN_TO_COLOR : ALIGN_TO_DEPTH, single);
+		aligned_image image;
+
+		//the first call builds the mapping
+		mapped.process(frameset.get_depth_frame(), frameset.get_color_frame());
+		mapped_single.process(frameset.get_depth_frame(), frameset.get_color_frame());
+
+		ms = bench(ALIGN_ITERATIONS, []{}, [&]{ mapped_single.process(frameset.get_depth_frame(), frameset.get_color_frame()); });
+		add_result("depth_aligner", variant + " 1 thread", target.width, target.height, ms, -1);
+
+		ms = bench(ALIGN_ITERATIONS, []{}, [&]{ image = mapped.process(frameset.get_depth_frame(), frameset.get_color_frame()); });
+		add_result("depth_aligner", variant, target.width, target.height, ms, -1);
+
+		if(to_color)
+		{  //depth units conversion fused into alignment (instead of separate pass over aligned depth)
+			depth_aligner fused(ALIGN_TO_COLOR, pool);
+			fused.set_depth_units(frameset.get_depth_frame().get_units() / 2.5f);
+			fused.process(frameset.get_depth_frame(), frameset.get_color_frame());
+
+			ms = bench(ALIGN_ITERATIONS, []{}, [&]{ fused.process(frameset.get_depth_frame(), frameset.get_color_frame()); });
+			add_result("depth_aligner", variant + " + rescale", target.width, target.height, ms, -1);
+		}
+
+		//the same input frameset as the last rs2::align
+		if(to_color)
+			compare_aligned(image, aligned.get_depth_frame(), true);
+		else
+			compare_aligned(image, aligned.get_color_frame(), false);
+
+		source.stop();
+	}
+
+	//native sensor format, not supported by rs2::align
+	frame_source source(synthetic_source());
+	source.enable_stream(RS2_STREAM_DEPTH, depth.width, depth.height, RS2_FORMAT_Z16, 30);
+	source.enable_stream(RS2_STREAM_COLOR, color.width, color.height, RS2_FORMAT_YUYV, 30);
+	source.start();
+
+	rs2::frameset frameset = source.wait_for_frames();
+	depth_aligner mapped(ALIGN_TO_DEPTH, pool);
+	mapped.process(frameset.get_depth_frame(), frameset.get_color_frame());
+
+	double ms = bench(ALIGN_ITERATIONS, []{}, [&]{ mapped.process(frameset.get_depth_frame(), frameset.get_color_frame()); });
+	add_result("depth_aligner", "yuyv to depth", depth.width, depth.height, ms, -1);
+
+	source.stop();
+}
+
+//capture, alignment to color with post-processing, chroma planes, null encoder
+void bench_end_to_end()
+{
+	const resolution r = {848, 480};
+
+	cout << "end to end (synthetic frames, null encoder)" << endl;
+
+	frame_source source(synthetic_source());
+	source.enable_stream(RS2_STREAM_DEPTH, r.width, r.height, RS2_FORMAT_Z16, 30);
+	source.enable_stream(RS2_STREAM_COLOR, r.width, r.height, RS2_FORMAT_YUYV, 30);
+	source.start();
+
+	encoder_config config;
+	config.backend = ENCODER_NULL;
+	config.software.threads = 0;
+	config.software.roi = false;
+	config.roi_subframe = -1;
+	config.batch = UDP_BATCH_OFF;
+
+	nhve_net_config net_config = {0};
+	nhve_hw_config hw_config[2] = { {0}, {0} };
+	encoder *streamer = encoder_init(&net_config, hw_config, 2, 0, config);
+
+	capture_config capture_cfg = {2, RING_BLOCK};
+	chrono::steady_clock::time_point start;
+
+	{
+		frame_capture capture(source, capture_cfg);
+		captured_frameset captured;
+		stream_workers workers(streamer, 2, false, NULL);
+		thread_pool pool(0);
+		depth_aligner aligner(ALIGN_TO_COLOR, pool);
+		nhve_frame frame[2] = { {0}, {0} };
+
+		for(int f = -3; f < END_TO_END_FRAMESETS; ++f)
+		{
+			if(f == 0) //after warm up
+				start = chrono::steady_clock::now();
+
+			capture.wait_for_frames(&captured);
+
+			rs2::depth_frame depth = captured.frameset.get_depth_frame();
+			rs2::video_frame color = captured.frameset.get_color_frame();
+
+			//the same units as synthetic source, still the rescaling work is done (fused with alignment)
+			aligner.set_depth_units(depth.get_units());
+			aligned_image image = aligner.process(depth, color);
+
+			frame[0].linesize[0] = frame[0].linesize[1] = image.stride;
+			frame[0].data[0] = image.data;
+			frame[0].data[1] = chroma_plane_p010le(image.stride, image.height);
+			frame[1].linesize[0] = color.get_stride_in_bytes();
+			frame[1].data[0] = (uint8_t*)color.get_data();
+
+			workers.send(frame);
+		}
+	}
+
+	const double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / END_TO_END_FRAMESETS;
+
+	//throughput limited by the slower of synthetic frame generation and pipeline
+	add_result("end_to_end", "depth-color to color", r.width, r.height, ms, -1);
+
+	encoder_close(streamer);
+	source.stop();
+}
+
+//software encoder standing in for VAAPI (hevc_vaapi selects libx265, h264_vaapi libx264)
+nhve_hw_config software_hw(const char *encoder, int profile, const char *pixel_format, int width, int height, int framerate, int qp)
+{
+	nhve_hw_config hw = {0};
+	hw.width = width;
+	hw.height = height;
+	hw.framerate = framerate;
+	hw.encoder = encoder;
+	hw.qp = qp;
+	hw.profile = profile;
+	hw.pixel_format = pixel_format;
+	return hw;
+}
+
+//depth as P010LE luma with dummy chroma
+nhve_frame p010le_frame(const vector<uint16_t> &depth, int width, int height)
+{
+	nhve_frame frame = { {(uint8_t*)&depth[0], chroma_plane_p010le(width * 2, height)}, {width * 2, width * 2} };
+	return frame;
+}
+
+//software encodes framesets (one encoder per hw config) one after another like stream_workers
+//- before_frame (untimed) is called with encoder and frameset index, e.g. to set regions of interest
+//- encoders are flushed (not timed) and packets (per encoder) are kept if requested
+//returns median ms per frameset and total bytes, -1 if encoder is not available (reported)
+double encode_framesets(const vector<nhve_hw_config> &hw, bool roi, const vector<vector<nhve_frame> > &framesets,
+	long long *bytes, vector<vector<vector<uint8_t> > > *packets = NULL,
+	const function<void(sw_encoder *encoder, size_t f)> &before_frame = NULL)
+{
+	sw_encoder_config config;
+	config.threads = 0;
+	config.roi = roi;
+
+	vector<sw_encoder*> encoders;
+	bool available = true;
+
+	for(const nhve_hw_config &h : hw)
+	{
+		encoders.push_back(sw_encoder_init(&h, &config));
+
+		if(!encoders.back() && available)
+		{
+			cout << "  " << (strncmp(h.encoder, "hevc", 4) == 0 ? "libx265" : "libx264") << " not available, skipping" << endl;
+			available = false;
+		}
+	}
+
+	size_t f = 0;
+	double ms = -1;
+	*bytes = 0;
+
+	if(packets)
+		packets->assign(encoders.size(), vector<vector<uint8_t> >());
+
+	auto receive = [&](size_t i)
+	{
+		nhve_frame packet;
+
+		while(sw_encoder_receive_packet(encoders[i], &packet) == 1)
+		{
+			*bytes += packet.linesize[0];
+			if(packets)
+				(*packets)[i].push_back(vector<uint8_t>(packet.data[0], packet.data[0] + packet.linesize[0]));
+		}
+	};
+
+	if(available)
+	{
+		ms = bench(framesets.size(), [&]
+		{
+			for(size_t i = 0; before_frame && i < encoders.size(); ++i)
+				before_frame(encoders[i], f);
+		}, [&]
+		{
+			for(size_t i = 0; i < encoders.size(); ++i)
+			{
+				sw_encoder_send_frame(encoders[i], &framesets[f][i]);
+				receive(i);
+			}
+			++f;
+		});
+
+		for(size_t i = 0; i < encoders.size(); ++i)
+		{
+			sw_encoder_send_frame(encoders[i], NULL);
+			receive(i);
+		}
+	}
+
+	for(sw_encoder *e : encoders)
+		sw_encoder_close(e);
+
+	return ms;
+}
+
+//depth + infrared as two streams (P010LE with dummy chroma, NV12)
+//and as one stream with infrared in depth chroma (--ir-in-chroma)
+//software HEVC with constant qp so that sizes are comparable, VAAPI should be compared on target
+void bench_ir_in_chroma()
+{
+	const resolution r = {848, 480};
+	const int framerate = 30;
+
+	cout << "ir in chroma (synthetic frames, software HEVC qp " << ENCODE_QP << ")" << endl;
+
+	frame_source source(synthetic_source());
+	source.enable_stream(RS2_STREAM_DEPTH, r.width, r.height, RS2_FORMAT_Z16, framerate);
+	source.enable_stream(RS2_STREAM_INFRARED, r.width, r.height, RS2_FORMAT_Y8, framerate);
+	source.start();
+
+	//copy the data, librealsense frames go back to pool
+	vector<vector<uint16_t> > depth(ENCODE_FRAMESETS), uv(ENCODE_FRAMESETS);
+	vector<vector<uint8_t> > ir(ENCODE_FRAMESETS);
+
+	for(int i = 0; i < ENCODE_FRAMESETS; ++i)
+	{
+		rs2::frameset frameset = source.wait_for_frames();
+		const uint16_t *d = (const uint16_t*)frameset.get_depth_frame().get_data();
+		const uint8_t *y8 = (const uint8_t*)frameset.get_infrared_frame().get_data();
+
+		depth[i].assign(d, d + r.width * r.height);
+		ir[i].assign(y8, y8 + r.width * r.height);
+		uv[i].resize(r.width * r.height / 2);
+		chroma_plane_pack_ir(&ir[i][0], r.width, r.width, r.height, &uv[i][0], r.width * 2);
+	}
+
+	source.stop();
+
+	vector<vector<nhve_frame> > two(ENCODE_FRAMESETS, vector<nhve_frame>(2)), one(ENCODE_FRAMESETS, vector<nhve_frame>(1));
+
+	for(int i = 0; i < ENCODE_FRAMESETS; ++i)
+	{
+		nhve_frame d = p010le_frame(depth[i], r.width, r.height);
+		nhve_frame y8 = { {&ir[i][0], chroma_plane_nv12(r.width, r.height)}, {r.width, r.width} };
+
+		two[i][0] = d;
+		two[i][1] = y8;
+
+		d.data[1] = (uint8_t*)&uv[i][0];
+		one[i][0] = d;
+	}
+
+	const nhve_hw_config depth_hw = software_hw("hevc_vaapi", FF_PROFILE_HEVC_MAIN_10, "p010le", r.width, r.height, framerate, ENCODE_QP);
+	const nhve_hw_config ir_hw = software_hw("hevc_vaapi", FF_PROFILE_HEVC_MAIN, "nv12", r.width, r.height, framerate, ENCODE_QP);
+
+	for(int single = 0; single <= 1; ++single)
+	{
+		vector<nhve_hw_config> hw(1, depth_hw);
+
+		if(!single)
+			hw.push_back(ir_hw);
+
+		long long bytes;
+		const double ms = encode_framesets(hw, false, single ? one : two, &bytes);
+
+		if(ms < 0)
+			return;
+
+		add_result("ir_in_chroma", single ? "one encoder" : "two encoders", r.width, r.height, ms, -1);
+		cout << "  " << setw(46) << left << "" << right << fixed << setprecision(1) <<
+			bytes * 8.0 * framerate / ENCODE_FRAMESETS / 1000 << " kbit/s at " << framerate << " fps" << endl;
+	}
+}
+
+//depth error after pack + unpack (without codec), max and rms in depth units over valid pixels
+void depth_pack_error(const vector<uint16_t> &depth, int width, int height, int *max_error, double *rms)
+{
+	vector<uint8_t> nv12(width * height * 3 / 2);
+	vector<uint16_t> unpacked(depth.size());
+
+	depth_pack_nv12(&depth[0], width * 2, width, height, &nv12[0], width, &nv12[width * height], width);
+	depth_unpack_nv12(&nv12[0], width, &nv12[width * height], width, width, height, &unpacked[0], width * 2);
+
+	double sum = 0;
+	int valid = 0;
+	*max_error = 0;
+
+	for(size_t i = 0; i < depth.size(); ++i)
+	{
+		if(depth[i] == 0)
+			continue;
+
+		const int e = abs(unpacked[i] - depth[i]);
+		*max_error = max(*max_error, e);
+		sum += (double)e * e;
+		++valid;
+	}
+
+	*rms = valid ? sqrt(sum / valid) : 0;
+}
+
+//decodes packets with FFmpeg decoder by name, frame_ready is called for every decoded frame
+//false if FFmpeg has no such decoder, decoding fails or not every packet gives a frame
+bool decode_frames(const char *decoder, const vector<vector<uint8_t> > &packets, const function<void(const AVFrame*)> &frame_ready)
+{
+	const AVCodec *codec = avcodec_find_decoder_by_name(decoder);
+	AVCodecContext *context = codec ? avcodec_alloc_context3(codec) : NULL;
+	AVPacket *packet = av_packet_alloc();
+	AVFrame *frame = av_frame_alloc();
+	bool ok = context && packet && frame && avcodec_open2(context, codec, NULL) == 0;
+	size_t frames = 0;
+
+	for(size_t i = 0; ok && i <= packets.size(); ++i)
+	{
+		//the last iteration flushes the decoder
+		packet->data = (i < packets.size()) ? (uint8_t*)&packets[i][0] : NULL;
+		packet->size = (i < packets.size()) ? packets[i].size() : 0;
+
+		ok = avcodec_send_packet(context, packet) == 0;
+
+		while(ok && avcodec_receive_frame(context, frame) == 0)
+		{
+			frame_ready(frame);
+			++frames;
+		}
+	}
+
+	av_frame_free(&frame);
+	av_packet_free(&packet);
+	avcodec_free_context(&context);
+
+	return ok && frames == packets.size();
+}
+
+//decodes HEVC packets and returns Y planes as P010LE (10 bits in most significant bits)
+//Main10 luma is returned in P010LE layout (10 most significant bits), Main luma as is
+//false if FFmpeg has no HEVC decoder or decoding fails
+bool decode_hevc_luma(const vector<vector<uint8_t> > &packets, int width, int height, vector<vector<uint16_t> > *luma)
+{
+	return decode_frames("hevc", packets, [&](const AVFrame *frame)
+	{
+		vector<uint16_t> y(width * height);
+
+		//yuv420p10le has the value in 10 least significant bits
+		for(int row = 0; row < height; ++row)
+		{
+			const uint8_t *in8 = frame->data[0] + row * frame->linesize[0];
+			const uint16_t *in = (const uint16_t*)in8;
+
+			for(int x = 0; x < width; ++x)
+				y[row * width + x] = (frame->format == AV_PIX_FMT_YUV420P) ? in8[x] : in[x] << 6;
+		}
+
+		luma->push_back(y);
+	});
+}
+
+//decodes H.264 packets and returns NV12 frames (Y plane followed by interleaved UV, width stride)
+//FFmpeg decodes 8 bit H.264 to planar YUV420P, chroma planes are interleaved here
+//false if FFmpeg has no H.264 decoder or decoding fails
+bool decode_h264_nv12(const vector<vector<uint8_t> > &packets, int width, int height, vector<vector<uint8_t> > *nv12)
+{
+	return decode_frames("h264", packets, [&](const AVFrame *frame)
+	{
+		vector<uint8_t> out(width * height * 3 / 2);
+		uint8_t *uv = &out[width * height];
+
+		for(int row = 0; row < height; ++row)
+			memcpy(&out[row * width], frame->data[0] + row * frame->linesize[0], width);
+
+		for(int row = 0; row < height / 2; ++row)
+			for(int x = 0; x < width / 2; ++x)
+			{
+				uv[row * width + 2 * x] = frame->data[1][row * frame->linesize[1] + x];
+				uv[row * width + 2 * x + 1] = frame->data[2][row * frame->linesize[2] + x];
+			}
+
+		nv12->push_back(out);
+	});
+}
+
+//depth as HEVC Main10 P010LE (dummy chroma) and as H.264 NV12 packing (rnhve_h264 depth)
+//software encoders with constant qp, both streams are decoded and compared with source depth
+//error includes P010LE truncation (HEVC) and packing (H.264), packing error alone is reported without codec
+void bench_h264_depth()
+{
+	const resolution r = {848, 480};
+	const int framerate = 30;
+
+	cout << "h264 depth packing (synthetic frames, software encoding qp " << ENCODE_QP << ")" << endl;
+
+	frame_source source(synthetic_source());
+	source.enable_stream(RS2_STREAM_DEPTH, r.width, r.height, RS2_FORMAT_Z16, framerate);
+	source.start();
+
+	vector<vector<uint16_t> > depth(ENCODE_FRAMESETS);
+	vector<vector<uint8_t> > nv12(ENCODE_FRAMESETS);
+	int max_error = 0;
+	double rms = 0;
+
+	for(int i = 0; i < ENCODE_FRAMESETS; ++i)
+	{
+		rs2::frameset frameset = source.wait_for_frames();
+		const uint16_t *d = (const uint16_t*)frameset.get_depth_frame().get_data();
+
+		depth[i].assign(d, d + r.width * r.height);
+		nv12[i].resize(r.width * r.height * 3 / 2);
+		depth_pack_nv12(d, r.width * 2, r.width, r.height, &nv12[i][0], r.width, &nv12[i][r.width * r.height], r.width);
+
+		int e;
+		double s;
+		depth_pack_error(depth[i], r.width, r.height, &e, &s);
+		max_error = max(max_error, e);
+		rms += s / ENCODE_FRAMESETS;
+	}
+
+	source.stop();
+
+	vector<vector<nhve_frame> > p010(ENCODE_FRAMESETS, vector<nhve_frame>(1)), packed(ENCODE_FRAMESETS, vector<nhve_frame>(1));
+
+	for(int i = 0; i < ENCODE_FRAMESETS; ++i)
+	{
+		nhve_frame p = { {&nv12[i][0], &nv12[i][r.width * r.height]}, {r.width, r.width} };
+
+		p010[i][0] = p010le_frame(depth[i], r.width, r.height);
+		packed[i][0] = p;
+	}
+
+	const nhve_hw_config hevc_hw = software_hw("hevc_vaapi", FF_PROFILE_HEVC_MAIN_10, "p010le", r.width, r.height, framerate, ENCODE_QP);
+	const nhve_hw_config h264_hw = software_hw("h264_vaapi", FF_PROFILE_H264_HIGH, "nv12", r.width, r.height, framerate, ENCODE_QP);
+
+	for(int h264 = 0; h264 <= 1; ++h264)
+	{
+		long long bytes;
+		vector<vector<vector<uint8_t> > > packets;
+		const double ms = encode_framesets(vector<nhve_hw_config>(1, h264 ? h264_hw : hevc_hw), false, h264 ? packed : p010, &bytes, &packets);
+
+		if(ms < 0)
+			continue;
+
+		add_result("h264_depth", h264 ? "h264 nv12 packing" : "hevc main10 p010", r.width, r.height, ms, -1);
+		cout << "  " << setw(46) << left << "" << right << fixed << setprecision(1) <<
+			bytes * 8.0 * framerate / ENCODE_FRAMESETS / 1000 << " kbit/s at " << framerate << " fps";
+
+		//decoded depth, P010LE luma as is or unpacked from NV12
+		vector<vector<uint16_t> > decoded;
+		vector<vector<uint8_t> > decoded_nv12;
+
+		if(h264 ? !decode_h264_nv12(packets[0], r.width, r.height, &decoded_nv12) : !decode_hevc_luma(packets[0], r.width, r.height, &decoded))
+		{
+			cout << endl << "  " << (h264 ? "H.264" : "HEVC") << " decoder not available, skipping quality" << endl;
+			continue;
+		}
+
+		for(const vector<uint8_t> &n : decoded_nv12)
+		{
+			decoded.push_back(vector<uint16_t>(r.width * r.height));
+			depth_unpack_nv12(&n[0], r.width, &n[r.width * r.height], r.width, r.width, r.height, &decoded.back()[0], r.width * 2);
+		}
+
+		int codec_max = 0;
+		double sum = 0, count = 0;
+
+		for(int i = 0; i < ENCODE_FRAMESETS; ++i)
+			for(int p = 0; p < r.width * r.height; ++p)
+				if(depth[i][p])
+				{
+					const int e = abs(decoded[i][p] - depth[i][p]);
+					codec_max = max(codec_max, e);
+					sum += (double)e * e;
+					++count;
+				}
+
+		cout << ", valid depth error max " << codec_max << " rms " << setprecision(2) <<
+			(count ? sqrt(sum / count) : 0.0) << " units" << endl;
+	}
+
+	cout << "  " << setw(46) << left << "" << right << "packing error without codec: max " << max_error <<
+		" rms " << fixed << setprecision(2) << rms << " depth units" << endl;
+}
+
+//depth error vs distance for quantization curves at fixed bitrate
+//software HEVC Main10 with bitrate (not qp) so that curves compete for the same bits
+//synthetic ramp from near to far across the width with moving ripples
+void bench_depth_curves()
+{
+	const resolution r = {848, 480};
+	const int framerate = 30;
+	const float units = 0.0001f;
+	const float near = 0.3f, far = 6.0f;
+	const float bins[] = {0.3f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f};
+	const int BINS = sizeof(bins) / sizeof(bins[0]) - 1;
+
+	cout << "depth curves (synthetic ramp " << near << "-" << far << " m, software HEVC Main10 " <<
+		CURVE_BIT_RATE / 1000 << " kbit/s), rms error in mm" << endl;
+
+	cout << "  " << setw(20) << left << "" << setw(10) << "curve" << right;
+	for(int b = 0; b < BINS; ++b)
+		cout << setw(5) << setprecision(1) << fixed << bins[b] << "-" << setw(3) << left << bins[b+1] << right;
+	cout << endl;
+
+	//ground truth in device units
+	vector<vector<uint16_t> > depth(ENCODE_FRAMESETS, vector<uint16_t>(r.width * r.height));
+
+	for(int f = 0; f < ENCODE_FRAMESETS; ++f)
+		for(int y = 0; y < r.height; ++y)
+			for(int x = 0; x < r.width; ++x)
+			{
+				const float z = near + (far - near) * x / (r.width - 1) + 0.02f * sinf(2 * M_PI * (y / 40.0f + f / 30.0f));
+				depth[f][y * r.width + x] = min(max(z, near), far) / units;
+			}
+
+	vector<nhve_hw_config> hw(1, software_hw("hevc_vaapi", FF_PROFILE_HEVC_MAIN_10, "p010le", r.width, r.height, framerate, 0));
+	hw[0].bit_rate = CURVE_BIT_RATE;
+
+	const DepthCurveType types[] = {DEPTH_CURVE_NONE, DEPTH_CURVE_LINEAR, DEPTH_CURVE_INVERSE, DEPTH_CURVE_LOG, DEPTH_CURVE_PIECEWISE};
+
+	for(DepthCurveType type : types)
+	{
+		depth_curve curve = {type, 0.2f, 6.5f, 1.0f};
+		depth_lut lut;
+		vector<vector<uint16_t> > coded(depth);
+
+		if(type != DEPTH_CURVE_NONE)
+		{
+			depth_curve_lut_update(&lut, curve, units);
+			for(vector<uint16_t> &c : coded)
+				depth_lut_apply(lut, &c[0], r.width, r.height, r.width * 2);
+		}
+
+		vector<vector<nhve_frame> > framesets;
+		for(const vector<uint16_t> &c : coded)
+			framesets.push_back(vector<nhve_frame>(1, p010le_frame(c, r.width, r.height)));
+
+		long long bytes;
+		vector<vector<vector<uint8_t> > > packets;
+
+		if(encode_framesets(hw, false, framesets, &bytes, &packets) < 0)
+			return;
+
+		vector<vector<uint16_t> > decoded;
+
+		if(!decode_hevc_luma(packets[0], r.width, r.height, &decoded))
+		{
+			cout << "  HEVC decoder not available, skipping" << endl;
+			return;
+		}
+
+		vector<double> sum(BINS), count(BINS);
+
+		for(int f = 0; f < ENCODE_FRAMESETS; ++f)
+			for(int i = 0; i < r.width * r.height; ++i)
+			{
+				const float z = depth[f][i] * units;
+				const float z_decoded = (type == DEPTH_CURVE_NONE) ? (decoded[f][i] & P010LE_MAX) * units : depth_curve_decode(curve, decoded[f][i]);
+				const int b = min<int>(upper_bound(bins, bins + BINS, z) - bins - 1, BINS - 1);
+
+				sum[b] += (z - z_decoded) * (z - z_decoded);
+				++count[b];
+			}
+
+		cout << "  " << setw(20) << left << "depth_curve" << setw(10) << depth_curve_name(type) << right;
+		for(int b = 0; b < BINS; ++b)
+			cout << setw(9) << setprecision(1) << (count[b] ? sqrt(sum[b] / count[b]) * 1000 : 0.0);
+		cout << endl;
+	}
+}
+
+//bitrate with and without inpainting at the same qp (about the same quality)
+//quality is reported as rms error of valid depth after decoding (holes restored with mask)
+//recording (--recording=file.bag) or synthetic frames (invalid band and dropouts at sphere edge)
+//ENCODE_FRAMESETS depth frames from recording (synthetic frames if empty) as width * 2 stride copies
+void capture_depth(const string &recording, int framerate, vector<vector<uint16_t> > *depth, int *width, int *height)
+{
+	frame_source_config config = synthetic_source();
+
+	if(!recording.empty())
+	{
+		config.type = SOURCE_BAG;
+		config.file = recording;
+	}
+
+	frame_source source(config);
+
+	//recording plays streams as recorded
+	if(recording.empty())
+		source.enable_stream(RS2_STREAM_DEPTH, 848, 480, RS2_FORMAT_Z16, framerate);
+
+	source.start();
+
+	depth->resize(ENCODE_FRAMESETS);
+
+	for(int i = 0; i < ENCODE_FRAMESETS; ++i)
+	{
+		rs2::depth_frame frame = source.wait_for_frames().get_depth_frame();
+		const int w = *width = frame.get_width(), h = *height = frame.get_height();
+		(*depth)[i].resize(w * h);
+
+		for(int y = 0; y < h; ++y)
+			memcpy(&(*depth)[i][y * w], (const uint8_t*)frame.get_data() + y * frame.get_stride_in_bytes(), w * 2);
+	}
+
+	source.stop();
+}
+
+//software HEVC Main10 at ENCODE_QP, returns encoded bytes or -1 if libx265 is not available (reported)
+long long encode_hevc_depth(const vector<vector<uint16_t> > &frames, int w, int h, int framerate, vector<vector<uint8_t> > *packets)
+{
+	vector<vector<nhve_frame> > framesets;
+	for(const vector<uint16_t> &f : frames)
+		framesets.push_back(vector<nhve_frame>(1, p010le_frame(f, w, h)));
+
+	const vector<nhve_hw_config> hw(1, software_hw("hevc_vaapi", FF_PROFILE_HEVC_MAIN_10, "p010le", w, h, framerate, ENCODE_QP));
+	vector<vector<vector<uint8_t> > > encoded;
+	long long bytes;
+
+	if(encode_framesets(hw, false, framesets, &bytes, &encoded) < 0)
+		return -1;
+
+	if(packets)
+		*packets = encoded[0];
+
+	return bytes;
+}
+
+void bench_inpaint(const string &recording)
+{
+	const int framerate = 30;
+
+	cout << "inpaint (" << (recording.empty() ? "synthetic frames" : recording) << ", software HEVC Main10 qp " << ENCODE_QP << ")" << endl;
+
+	vector<vector<uint16_t> > depth, inpainted(ENCODE_FRAMESETS);
+	vector<vector<uint8_t> > masks(ENCODE_FRAMESETS);
+	int w = 0, h = 0;
+
+	capture_depth(recording, framerate, &depth, &w, &h);
+
+	thread_pool pool(0);
+	depth_inpainter inpainter(pool);
+	int f = 0;
+
+	double ms = bench(ENCODE_FRAMESETS, [&]{ inpainted[f] = depth[f]; }, [&]{
+		masks[f] = inpainter.process(&inpainted[f][0], w, h, w * 2);
+		++f;
+	});
+	add_result("inpaint", "all cores", w, h, ms, -1);
+
+	for(int inpaint = 0; inpaint <= 1; ++inpaint)
+	{
+		vector<vector<uint8_t> > packets;
+		const long long bytes = encode_hevc_depth(inpaint ? inpainted : depth, w, h, framerate, &packets);
+
+		if(bytes < 0)
+			return;
+
+		long long mask_bytes = 0;
+
+		if(inpaint)
+			for(const vector<uint8_t> &m : masks)
+				mask_bytes += m.size();
+
+		cout << "  " << setw(46) << left << (inpaint ? "inpainted + mask" : "with holes") << right << fixed << setprecision(1) <<
+			(bytes + mask_bytes) * 8.0 * framerate / ENCODE_FRAMESETS / 1000 << " kbit/s";
+		if(inpaint)
+			cout << " (mask " << mask_bytes * 8.0 * framerate / ENCODE_FRAMESETS / 1000 << ")";
+
+		vector<vector<uint16_t> > decoded;
+
+		if(!decode_hevc_luma(packets, w, h, &decoded))
+		{
+			cout << endl << "  HEVC decoder not available, skipping quality" << endl;
+			continue;
+		}
+
+		double sum = 0, count = 0;
+
+		for(int i = 0; i < ENCODE_FRAMESETS; ++i)
+		{
+			if(inpaint)
+				depth_mask_apply(&masks[i][0], masks[i].size(), &decoded[i][0], w, h, w * 2);
+
+			for(int p = 0; p < w * h; ++p)
+				if(depth[i][p])
+				{
+					const double e = (double)decoded[i][p] - (depth[i][p] & P010LE_MAX);
+					sum += e * e;
+					++count;
+				}
+		}
+
+		cout << ", valid depth rms error " << setprecision(2) << (count ? sqrt(sum / count) : 0.0) << " units" << endl;
+	}
+}
+
+//denoising CPU time (scalar vs SSE2, single thread vs all cores)
+void bench_depth_denoise()
+{
+	const char *names[] = {"scalar 1 thread", "simd 1 thread", "simd all cores"};
+	thread_pool single(1), all(0);
+
+	cout << "depth_denoise" << endl;
+
+	for(const resolution &r : RESOLUTIONS)
+	{
+		const int size = r.width * r.height;
+		vector<uint16_t> depth(size);
+		vector<uint8_t> noise(size);
+
+		//spatially coherent with 1% noise and some holes like real depth
+		fill_random(&noise[0], size);
+
+		for(int i = 0; i < size; ++i)
+			depth[i] = (noise[i] < 8) ? 0 : 10000 + (i % r.width) * 20 + (noise[i] - 128) * 100 / 128;
+
+		for(int strength = 1; strength <= 3; ++strength)
+		{
+			//output depends on history, compare the third frame of the same input
+			depth_denoiser reference(strength, single, false);
+			const uint16_t *expected = NULL;
+
+			for(int frame = 0; frame < 3; ++frame)
+				expected = reference.process(&depth[0], r.width, r.height, r.width * 2);
+
+			for(int i = 0; i < 3; ++i)
+			{
+				depth_denoiser denoiser(strength, i < 2 ? single : all, i > 0);
+				const uint16_t *out = NULL;
+
+				for(int frame = 0; frame < 3; ++frame)
+					out = denoiser.process(&depth[0], r.width, r.height, r.width * 2);
+
+				const bool exact = equal(out, out + size, expected);
+
+				double ms = bench(ITERATIONS, []{}, [&]{
+					denoiser.process(&depth[0], r.width, r.height, r.width * 2);
+				});
+				add_result("depth_denoise " + to_string(strength), names[i], r.width, r.height, ms, exact);
+			}
+		}
+	}
+}
+
+//texture QP offset map from depth
+void bench_depth_roi()
+{
+	cout << "depth_roi" << endl;
+
+	for(const resolution &r : RESOLUTIONS)
+	{
+		vector<uint16_t> depth(r.width * r.height);
+
+		//background plane with near object in the middle and invalid band like synthetic frames
+		for(int y = 0; y < r.height; ++y)
+			for(int x = 0; x < r.width; ++x)
+			{
+				const int dx = x - r.width / 2, dy = y - r.height / 2;
+				const bool near = dx * dx + dy * dy < r.height * r.height / 16;
+				depth[y * r.width + x] = (x < r.width / 25) ? 0 : (near ? 800 : 2000 + 1500 * y / r.height);
+			}
+
+		depth_roi roi(ROI);
+
+		double ms = bench(ITERATIONS, []{}, [&]{
+			roi.process(&depth[0], r.width, r.height, r.width * 2, 0.001f);
+		});
+		add_result("depth_roi", "regions " + to_string(roi.process(&depth[0], r.width, r.height, r.width * 2, 0.001f).size()), r.width, r.height, ms, -1);
+	}
+}
+
+//bitrate saving on noisy depth
+void bench_denoise(const string &recording)
+{
+	const int framerate = 30;
+
+	cout << "denoise (" << (recording.empty() ? "synthetic frames + 1% noise" : recording) << ", software HEVC Main10 qp " << ENCODE_QP << ")" << endl;
+
+	vector<vector<uint16_t> > depth, denoised(ENCODE_FRAMESETS);
+	int w = 0, h = 0;
+
+	capture_depth(recording, framerate, &depth, &w, &h);
+
+	//synthetic frames are noiseless, recordings have sensor noise
+	if(recording.empty())
+	{
+		vector<uint8_t> noise(w * h);
+
+		for(int i = 0; i < ENCODE_FRAMESETS; ++i)
+		{
+			fill_random(&noise[0], w * h);
+			rotate(noise.begin(), noise.begin() + i * 7919 % (w * h), noise.end()); //different per frame
+
+			for(int p = 0; p < w * h; ++p)
+				if(depth[i][p])
+					depth[i][p] = min(max(1, depth[i][p] + (noise[p] - 128) * (depth[i][p] / 100) / 128), 0xFFFF);
+		}
+	}
+
+	thread_pool pool(0);
+
+	for(int strength = 0; strength <= 3; ++strength)
+	{
+		if(strength)
+		{
+			depth_denoiser denoiser(strength, pool);
+			int f = 0;
+
+			double ms = bench(ENCODE_FRAMESETS, []{}, [&]{
+				const uint16_t *out = denoiser.process(&depth[f][0], w, h, w * 2);
+				denoised[f].assign(out, out + w * h);
+				++f;
+			});
+			add_result("denoise " + to_string(strength), "all cores", w, h, ms, -1);
+		}
+
+		const long long bytes = encode_hevc_depth(strength ? denoised : depth, w, h, framerate, NULL);
+
+		if(bytes < 0)
+			return;
+
+		cout << "  " << setw(46) << left << (strength ? "strength " + to_string(strength) : string("not denoised")) << right << fixed << setprecision(1) <<
+			bytes * 8.0 * framerate / ENCODE_FRAMESETS / 1000 << " kbit/s" << endl;
+	}
+}
+
+//infrared encoded with and without depth driven QP offsets, quality of near and far pixels
+//software HEVC with default CRF and adaptive quantization (x265 ignores offsets without them),
+//ROI raises qp of background (VAAPI doesn't take ROI through NHVE)
+void bench_roi()
+{
+	const resolution r = {848, 480};
+	const int framerate = 30;
+	const float units = 0.001f; //synthetic depth sensor
+
+	cout << "roi (synthetic frames, software HEVC crf with aq, roi " << ROI.qp <<
+		" qp from " << ROI.near << " to " << ROI.far << " m)" << endl;
+
+	frame_source source(synthetic_source());
+	source.enable_stream(RS2_STREAM_DEPTH, r.width, r.height, RS2_FORMAT_Z16, framerate);
+	source.enable_stream(RS2_STREAM_INFRARED, r.width, r.height, RS2_FORMAT_Y8, framerate);
+	source.start();
+
+	vector<vector<uint16_t> > depth(ENCODE_FRAMESETS);
+	vector<vector<uint8_t> > ir(ENCODE_FRAMESETS);
+
+	for(int i = 0; i < ENCODE_FRAMESETS; ++i)
+	{
+		rs2::frameset frameset = source.wait_for_frames();
+		const uint16_t *d = (const uint16_t*)frameset.get_depth_frame().get_data();
+		const uint8_t *y8 = (const uint8_t*)frameset.get_infrared_frame().get_data();
+
+		depth[i].assign(d, d + r.width * r.height);
+		ir[i].assign(y8, y8 + r.width * r.height);
+	}
+
+	source.stop();
+
+	vector<vector<nhve_frame> > framesets;
+
+	for(vector<uint8_t> &y8 : ir)
+	{
+		nhve_frame frame = { {&y8[0], chroma_plane_nv12(r.width, r.height)}, {r.width, r.width} };
+		framesets.push_back(vector<nhve_frame>(1, frame));
+	}
+
+	//no qp and bit_rate - default CRF, x265 ignores QP offsets with constant QP
+	const vector<nhve_hw_config> hw(1, software_hw("hevc_vaapi", FF_PROFILE_HEVC_MAIN, "nv12", r.width, r.height, framerate, 0));
+	vector<vector<uint8_t> > uniform;
+
+	for(int with_roi = 0; with_roi <= 1; ++with_roi)
+	{
+		depth_roi roi(ROI);
+		long long bytes;
+		vector<vector<vector<uint8_t> > > encoded;
+
+		//both encodes with adaptive quantization (needed for ROI), only the second gets offsets
+		auto set_roi = [&](sw_encoder *encoder, size_t f)
+		{
+			if(with_roi)
+				sw_encoder_set_roi(encoder, roi.process(&depth[f][0], r.width, r.height, r.width * 2, units));
+		};
+
+		if(encode_framesets(hw, true, framesets, &bytes, &encoded, set_roi) < 0)
+			return;
+
+		const vector<vector<uint8_t> > &packets = encoded[0];
+
+		if(!with_roi)
+			uniform = packets;
+		else if(packets == uniform)
+		{
+			cout << "  roi encode is identical to uniform, offsets were not applied" << endl;
+			return;
+		}
+
+		cout << "  " << setw(46) << left << (with_roi ? "roi" : "uniform") << right << fixed << setprecision(1) <<
+			bytes * 8.0 * framerate / ENCODE_FRAMESETS / 1000 << " kbit/s";
+
+		vector<vector<uint16_t> > decoded;
+
+		if(!decode_hevc_luma(packets, r.width, r.height, &decoded))
+		{
+			cout << endl << "  HEVC decoder not available, skipping quality" << endl;
+			continue;
+		}
+
+		//near is valid depth up to roi near, the rest is far
+		double sse[2] = {0, 0}, count[2] = {0, 0};
+
+		for(int i = 0; i < ENCODE_FRAMESETS; ++i)
+			for(int p = 0; p < r.width * r.height; ++p)
+			{
+				const int far = !(depth[i][p] && depth[i][p] * units <= ROI.near);
+				const double e = (double)decoded[i][p] - ir[i][p];
+				sse[far] += e * e;
+				++count[far];
+			}
+
+		cout << ", psnr near " << setprecision(2) << 10 * log10(255.0 * 255.0 * count[0] / max(sse[0], 1.0)) <<
+			" dB, far " << 10 * log10(255.0 * 255.0 * count[1] / max(sse[1], 1.0)) << " dB" << endl;
+	}
+}
+
+string cpu_model()
+{
+	ifstream cpuinfo("/proc/cpuinfo");
+	string line;
+
+	while(getline(cpuinfo, line))
+		if(line.compare(0, 10, "model name") == 0)
+			return line.substr(line.find(':') + 2);
+
+	return "unknown";
+}
+
+string json_escape(const string &s)
+{
+	string out;
+
+	for(char c : s)
+	{
+		if(c == '"' || c == '\\')
+			out += '\\';
+		out += c;
+	}
+
+	return out;
+}
+
+int write_json(const string &file)
+{
+	ofstream json(file);
+
+	if(!json)
+	{
+		cerr << "unable to open " << file << endl;
+		return -1;
+	}
+
+	json << fixed << setprecision(4);
+	json << "{" << endl;
+	json << "  \"cpu\": \"" << json_escape(cpu_model()) << "\"," << endl;
+	json << "  \"depth_rescale\": \"" << depth_rescale_name() << "\"," << endl;
+	json << "  \"results\": [" << endl;
+
+	for(size_t i = 0; i < results.size(); ++i)
+	{
+		const bench_result &r = results[i];
+
+		json << "    {\"name\": \"" << r.name << "\", \"variant\": \"" << r.variant << "\", \"width\": " << r.width <<
+			", \"height\": " << r.height << ", \"ms\": " << r.ms;
+
+		if(r.exact >= 0)
+			json << ", \"exact\": " << (r.exact ? "true" : "false");
+
+		json << "}" << (i + 1 < results.size() ? "," : "") << endl;
+	}
+
+	json << "  ]" << endl;
+	json << "}" << endl;
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	options opts;
+	argc = options_parse(argc, argv, &opts);
+
+	if(argc > 1)
+	{
+		cerr << "Usage: " << argv[0] << " [--json=FILE] [--no-realsense] [--recording=FILE.bag]" << endl << endl;
+		cerr << "--json=FILE      write results to json file" << endl;
+		cerr << "--recording=F    depth recording for inpainting and denoising (default synthetic frames)" << endl;
+		cerr << "--no-realsense   skip benchmarks running librealsense (alignment, end to end, encoding)" << endl;
+		return 1;
+	}
+
+	bench_depth_rescale();
+	bench_dummy_chroma();
+	bench_depth_pack();
+	bench_depth_split();
+	bench_depth_histogram();
+	bench_depth_denoise();
+	bench_depth_roi();
+	bench_pixel_convert();
+	bench_fec_xor();
+	bench_send();
+	bench_fanout();
+	bench_pacing();
+	bench_fec();
+
+	if(!options_has(opts, "no-realsense"))
+	{
+		bench_align();
+		bench_end_to_end();
+		bench_ir_in_chroma();
+		bench_h264_depth();
+		bench_depth_curves();
+		bench_inpaint(options_get(opts, "recording", ""));
+		bench_denoise(options_get(opts, "recording", ""));
+		bench_roi();
+	}
+
+	if(options_has(opts, "json") && write_json(options_get(opts, "json", "")) != 0)
+		return 1;
+
+	//e.g. SIMD kernel not matching scalar or FEC overhead above limit
+	for(const bench_result &r : results)
+		if(r.exact == 0)
+			return 1;
+
+	return 0;
+}
@@ -0,0 +1,40 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Microbenchmarks of the CPU work done per frame, shared helpers
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef RNHVE_BENCH_H
+#define RNHVE_BENCH_H
+
+#include <functional>
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+const int ITERATIONS = 200;
+
+//records result (median ms) and prints it, exact is 1 matches reference, 0 mismatch, -1 not checked
+void add_result(const std::string &name, const std::string &variant, int width, int height, double ms, int exact);
+
+//median time in ms of run, setup is called (untimed) before each run
+double bench(int iterations, const std::function<void()> &setup, const std::function<void()> &run);
+
+//deterministic pseudo random bytes
+void fill_random(uint8_t *data, size_t size);
+
+//network benchmarks (rnhve_bench_net.cpp), relay on loopback
+void bench_fec_xor();
+void bench_send();
+void bench_fanout();
+void bench_pacing();
+void bench_fec();
+
+#endif
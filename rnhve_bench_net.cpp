@@ -0,0 +1,581 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Microbenchmarks of the relay (fanout, pacing, FEC) on loopback
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include "rnhve_bench.h"
+#include "udp_relay.h"
+#include "udp_fec.h"
+#include "mlsp_packet.h"
+#include "udp_sender.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <ctime>
+#include <numeric>
+#include <thread>
+#include <atomic>
+
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+const int NET_FRAMES = 300;
+const int NET_PACKETS = 40; //per frame, ~56 kB keyframe-ish frame
+const int NET_DATAGRAM = 1400;
+const int PACING_FRAMERATE = 30;
+const int PACING_FRAMES = 90; //3 keyframes
+const int PACING_KEYFRAME = 43; //datagrams, 60 kB
+const int PACING_PFRAME = 4;
+const double LINK_RATE = 2500000; //bytes/s, 20 Mbit/s bottleneck stand-in
+const double LINK_BUFFER = 32000; //bytes queued at bottleneck before it drops
+const int FEC_FRAMES = 300;
+const int FEC_SPACING_US = 20; //between datagrams of frame, the relay catches up between them like with NHVE
+
+//XOR of keyframe datagrams into parity
+void bench_fec_xor()
+{
+	cout << "fec_xor" << endl;
+
+	const int size = PACING_KEYFRAME * NET_DATAGRAM;
+	vector<uint8_t> src(size), dst(size), reference(size), input(size);
+
+	fill_random(&src[0], size);
+	fill_random(&input[0], size);
+	reverse(input.begin(), input.end());
+
+	reference = input;
+	fec_xor_scalar(&reference[0], &src[0], size);
+
+	const fec_xor_fn fns[] = {fec_xor_scalar, fec_xor_sse2(), fec_xor_avx2()};
+	const char *names[] = {"scalar", "sse2", "avx2"};
+
+	for(int i = 0; i < 3; ++i)
+	{
+		if(!fns[i])
+		{
+			cout << "  " << names[i] << " not supported" << endl;
+			continue;
+		}
+
+		double ms = bench(ITERATIONS, [&]{ dst = input; }, [&]{ fns[i](&dst[0], &src[0], size); });
+		add_result("fec_xor", string(names[i]) + " " + to_string(size / 1000) + " kB", 0, 0, ms, dst == reference);
+	}
+}
+
+//UDP socket bound to loopback on any free port, returns port
+int loopback_socket(int *fd, int receive_buffer)
+{
+	sockaddr_in address = {0};
+	socklen_t size = sizeof(address);
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	*fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+	if(receive_buffer)
+		setsockopt(*fd, SOL_SOCKET, SO_RCVBUF, &receive_buffer, sizeof(receive_buffer));
+
+	bind(*fd, (sockaddr*)&address, sizeof(address));
+	getsockname(*fd, (sockaddr*)&address, &size);
+
+	return ntohs(address.sin_port);
+}
+
+//counts datagrams until stop
+void loopback_receive(int fd, const atomic<bool> &stop, long long *packets)
+{
+	vector<uint8_t> buffer(65536);
+	pollfd p = {fd, POLLIN, 0};
+
+	while(!stop)
+		if(poll(&p, 1, 10) > 0)
+			while(recv(fd, &buffer[0], buffer.size(), MSG_DONTWAIT) > 0)
+				++*packets;
+}
+
+//thread CPU time in ms
+double thread_cpu_ms()
+{
+	timespec t;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+	return t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+}
+
+//encoded frames to single receiver as MLSP datagrams without relay
+//batch off sends datagram per syscall like NHVE, mmsg and gso send whole frame with a few syscalls
+void bench_send(UdpBatch batch, const string &variant)
+{
+	int fd;
+	const int port = loopback_socket(&fd, 8 * 1024 * 1024);
+	nhve_net_config net_config = {"127.0.0.1", (uint16_t)port};
+
+	atomic<bool> stop(false);
+	long long received = 0;
+	thread receiver(loopback_receive, fd, ref(stop), &received);
+
+	mlsp_sender sender(batch, 1);
+	sender.open(net_config);
+
+	vector<uint8_t> frame(NET_PACKETS * MLSP_MAX_PAYLOAD - MLSP_MAX_PAYLOAD / 2);
+	fill_random(&frame[0], frame.size());
+
+	vector<double> times;
+	double cpu = 0;
+
+	for(int f = 0; f < NET_FRAMES; ++f)
+	{
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		const double cpu_start = thread_cpu_ms();
+
+		sender.send(&frame[0], frame.size(), 0);
+
+		cpu += thread_cpu_ms() - cpu_start;
+		times.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+
+		//frame interval like encoder would
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+
+	this_thread::sleep_for(chrono::milliseconds(50));
+	stop = true;
+	receiver.join();
+	close(fd);
+
+	sort(times.begin(), times.end());
+
+	const long long sent = (long long)NET_FRAMES * NET_PACKETS;
+
+	add_result("send " + variant, "receiver " + to_string(received * 100 / sent) + "%", 0, 0, times[times.size() / 2], received == sent);
+	add_result("send " + variant, "sender CPU per frame", 0, 0, cpu / NET_FRAMES, -1);
+	cout << "    " << fixed << setprecision(0) << sent / (cpu / 1000) << " packets/s of CPU, "
+		<< setprecision(1) << (double)sender.syscalls() / NET_FRAMES << " sends per frame" << endl;
+}
+
+void bench_send()
+{
+	cout << "send (loopback, single receiver without relay, " << NET_FRAMES << " frames x " << NET_PACKETS << " MLSP datagrams)" << endl;
+
+	bench_send(UDP_BATCH_OFF, "per datagram");
+	bench_send(UDP_BATCH_MMSG, "sendmmsg");
+	bench_send(UDP_BATCH_GSO, "gso");
+}
+
+//2 receivers reading everything and 1 slow receiver (tiny buffer, never reading while streaming)
+//- direct is the baseline without relay, the sender sends every datagram to each receiver itself
+//- otherwise the sender sends once to relay on loopback (like NHVE) and relay sends to receivers
+//CPU and sends per frame are the sender and relay together
+void bench_fanout(bool direct, UdpBatch batch, const string &variant)
+{
+	int fast[2], slow;
+	const int fast_port[2] = {loopback_socket(&fast[0], 4 * 1024 * 1024), loopback_socket(&fast[1], 4 * 1024 * 1024)};
+	const int slow_port = loopback_socket(&slow, 65536);
+
+	udp_relay_config config = {{"127.0.0.1:" + to_string(fast_port[1]), "127.0.0.1:" + to_string(slow_port)}, 1, batch, 0.0f, 30, 0, 1};
+	nhve_net_config net_config = {"127.0.0.1", (uint16_t)fast_port[0]};
+	udp_relay relay(config);
+
+	if(!direct && relay.start(&net_config, 0) < 0)
+		return;
+
+	atomic<bool> stop(false);
+	long long received[3] = {0, 0, 0};
+	thread receivers[2] = {	thread(loopback_receive, fast[0], ref(stop), &received[0]),
+							thread(loopback_receive, fast[1], ref(stop), &received[1]) };
+
+	//what encoder does, send to net_config (relay unless direct)
+	const int ports[3] = {net_config.port, fast_port[1], slow_port};
+	const int destinations = direct ? 3 : 1;
+	int sender = socket(AF_INET, SOCK_DGRAM, 0);
+	sockaddr_in to[3];
+
+	for(int i = 0; i < destinations; ++i)
+	{
+		to[i] = sockaddr_in();
+		to[i].sin_family = AF_INET;
+		to[i].sin_port = htons(ports[i]);
+		inet_pton(AF_INET, net_config.ip, &to[i].sin_addr);
+	}
+
+	vector<uint8_t> datagram(NET_DATAGRAM);
+	fill_random(&datagram[0], datagram.size());
+
+	vector<double> times;
+	double sender_cpu = 0;
+
+	for(int f = 0; f < NET_FRAMES; ++f)
+	{
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		const double cpu_start = thread_cpu_ms();
+
+		for(int p = 0; p < NET_PACKETS; ++p)
+			for(int i = 0; i < destinations; ++i)
+				sendto(sender, &datagram[0], datagram.size(), 0, (sockaddr*)&to[i], sizeof(to[i]));
+
+		sender_cpu += thread_cpu_ms() - cpu_start;
+		times.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+
+		//give the relay frame interval like encoder would
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+
+	relay.stop(); //not started with direct (no relay CPU and sends)
+	this_thread::sleep_for(chrono::milliseconds(50));
+	stop = true;
+
+	for(thread &t : receivers)
+		t.join();
+
+	//whatever fit in the slow receiver buffer
+	pollfd p = {slow, POLLIN, 0};
+	vector<uint8_t> buffer(65536);
+	while(poll(&p, 1, 0) > 0 && recv(slow, &buffer[0], buffer.size(), MSG_DONTWAIT) > 0)
+		++received[2];
+
+	sort(times.begin(), times.end());
+
+	const long long sent = (long long)NET_FRAMES * NET_PACKETS;
+	const char *names[3] = {"receiver", "fanout receiver", "slow receiver"};
+
+	for(int i = 0; i < 3; ++i)
+		add_result("fanout " + variant, string(names[i]) + " " + to_string(received[i] * 100 / sent) + "%", 0, 0, times[times.size() / 2], i == 2 ? -1 : received[i] == sent);
+
+	//work per frame for 3 destinations, packets out per CPU second
+	long long syscalls = (long long)NET_FRAMES * NET_PACKETS * destinations;
+	const double cpu = sender_cpu + relay.cpu_ms();
+
+	for(const udp_relay_destination &d : relay.destinations())
+		syscalls += d.syscalls;
+
+	add_result("fanout " + variant, "sender + relay CPU per frame", 0, 0, cpu / NET_FRAMES, -1);
+	cout << "    " << fixed << setprecision(0) << 3 * sent / (cpu / 1000) << " packets/s of CPU, "
+		<< setprecision(1) << (double)syscalls / NET_FRAMES << " sends per frame" << endl;
+
+	close(sender);
+	close(slow);
+	close(fast[0]);
+	close(fast[1]);
+}
+
+void bench_fanout()
+{
+	cout << "fanout (loopback, " << NET_FRAMES << " frames x " << NET_PACKETS << " x " << NET_DATAGRAM << " B datagrams)" << endl;
+
+	bench_fanout(true, UDP_BATCH_OFF, "direct");
+	bench_fanout(false, UDP_BATCH_OFF, "relay send");
+	bench_fanout(false, UDP_BATCH_MMSG, "relay sendmmsg");
+	bench_fanout(false, UDP_BATCH_GSO, "relay gso");
+}
+
+//datagram arrivals with frame number and packet index from payload
+struct arrival
+{
+	double time; //seconds
+	uint32_t frame;
+};
+
+void pacing_receive(int fd, const atomic<bool> &stop, chrono::steady_clock::time_point start, vector<arrival> *arrivals)
+{
+	vector<uint8_t> buffer(65536);
+	pollfd p = {fd, POLLIN, 0};
+
+	while(!stop)
+		if(poll(&p, 1, 10) > 0)
+			for(int size; (size = recv(fd, &buffer[0], buffer.size(), MSG_DONTWAIT)) > 0; )
+			{
+				arrival a = {chrono::duration<double>(chrono::steady_clock::now() - start).count(), 0};
+				memcpy(&a.frame, &buffer[0], sizeof(a.frame));
+				arrivals->push_back(a);
+			}
+}
+
+//keyframe bursts through shallow buffered bottleneck (Wi-Fi, switch) with and without pacing
+//the bottleneck is simulated on loopback arrival times, drops what doesn't fit in its buffer
+void bench_pacing(float pacing)
+{
+	int fd;
+	const int port = loopback_socket(&fd, 4 * 1024 * 1024);
+
+	udp_relay_config config = {{}, 1, UDP_BATCH_GSO, pacing, PACING_FRAMERATE, 0, 1};
+	nhve_net_config net_config = {"127.0.0.1", (uint16_t)port};
+	udp_relay relay(config);
+
+	if(relay.start(&net_config, 0) < 0)
+		return;
+
+	const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	const chrono::duration<double> interval(1.0 / PACING_FRAMERATE);
+
+	atomic<bool> stop(false);
+	vector<arrival> arrivals;
+	thread receiver(pacing_receive, fd, ref(stop), start, &arrivals);
+
+	int sender = socket(AF_INET, SOCK_DGRAM, 0);
+	sockaddr_in to = {0};
+	to.sin_family = AF_INET;
+	to.sin_port = htons(net_config.port);
+	inet_pton(AF_INET, net_config.ip, &to.sin_addr);
+
+	vector<uint8_t> datagram(NET_DATAGRAM);
+	fill_random(&datagram[0], datagram.size());
+	vector<int> packets(PACING_FRAMES);
+
+	for(uint32_t f = 0; f < PACING_FRAMES; ++f)
+	{
+		this_thread::sleep_until(start + chrono::duration_cast<chrono::steady_clock::duration>(interval * f));
+
+		packets[f] = (f % PACING_FRAMERATE == 0) ? PACING_KEYFRAME : PACING_PFRAME;
+		memcpy(&datagram[0], &f, sizeof(f));
+
+		for(int p = 0; p < packets[f]; ++p)
+			sendto(sender, &datagram[0], datagram.size(), 0, (sockaddr*)&to, sizeof(to));
+	}
+
+	relay.stop();
+	this_thread::sleep_for(chrono::milliseconds(50));
+	stop = true;
+	receiver.join();
+	close(sender);
+	close(fd);
+
+	//bottleneck queue drained at link rate, per frame delivered datagrams and last delivery time
+	vector<int> delivered(PACING_FRAMES, 0);
+	vector<double> latency(PACING_FRAMES, 0);
+	double queue = 0, last = 0;
+	int lost = 0;
+
+	for(const arrival &a : arrivals)
+	{
+		queue = max(0.0, queue - LINK_RATE * (a.time - last));
+		last = a.time;
+
+		if(a.frame >= PACING_FRAMES || queue + NET_DATAGRAM > LINK_BUFFER)
+		{
+			++lost;
+			continue;
+		}
+
+		queue += NET_DATAGRAM;
+		++delivered[a.frame];
+		latency[a.frame] = max(latency[a.frame], 1000 * (a.time + queue / LINK_RATE - a.frame * interval.count()));
+	}
+
+	int frames = 0, keyframes = 0;
+	double keyframe_latency = 0;
+
+	for(int f = 0; f < PACING_FRAMES; ++f)
+	{
+		const bool complete = delivered[f] == packets[f];
+		const bool keyframe = packets[f] == PACING_KEYFRAME;
+
+		frames += complete;
+		keyframes += complete && keyframe;
+
+		if(keyframe)
+			keyframe_latency = max(keyframe_latency, latency[f]);
+	}
+
+	sort(latency.begin(), latency.end());
+
+	const string variant = pacing > 0.0f ? to_string((int)(pacing * 100)) + "% of interval" : "burst";
+
+	add_result("pacing " + variant, "keyframes " + to_string(keyframes) + "/" + to_string(PACING_FRAMES / PACING_FRAMERATE), 0, 0, keyframe_latency, -1);
+	add_result("pacing " + variant, "frames " + to_string(frames) + "/" + to_string(PACING_FRAMES), 0, 0, latency[latency.size() / 2], -1);
+	cout << "    lost " << lost << " of " << arrivals.size() << " datagrams at bottleneck" << endl;
+}
+
+void bench_pacing()
+{
+	cout << "pacing (" << PACING_FRAMERATE << " fps, " << PACING_KEYFRAME << "/" << PACING_PFRAME << " datagram key/P frames, "
+		<< LINK_RATE * 8 / 1000000 << " Mbit/s bottleneck with " << LINK_BUFFER / 1000 << " kB buffer)" << endl;
+	cout << "  time is the worst keyframe / median frame latency including bottleneck queue" << endl;
+
+	bench_pacing(0.0f);
+	bench_pacing(0.5f);
+	bench_pacing(0.9f);
+}
+
+//MLSP datagram of frame (single subframe), the rest pseudo random, the last of frame shorter
+void fec_payload(uint16_t frame, uint16_t index, uint16_t packets, vector<uint8_t> *payload)
+{
+	const mlsp_header header = {frame, 1, 0, packets, index};
+	uint32_t state = frame * 1000 + index;
+
+	payload->resize(index == packets - 1 ? MLSP_HEADER + MLSP_MAX_PAYLOAD / 2 : MLSP_HEADER + MLSP_MAX_PAYLOAD);
+
+	for(size_t i = 0; i < payload->size(); ++i)
+	{
+		state = state * 1664525 + 1013904223;
+		(*payload)[i] = state >> 24;
+	}
+
+	mlsp_header_write(header, &(*payload)[0]);
+}
+
+//Gilbert-Elliott channel, random loss is the special case without bad state
+struct loss_model
+{
+	string name;
+	double good_to_bad;
+	double bad_to_good;
+	double loss_good;
+	double loss_bad;
+};
+
+//frames sent through relay with FEC on loopback, loss simulated in front of decoder
+void bench_fec(int group, int interleave)
+{
+	int fd;
+	const int port = loopback_socket(&fd, 8 * 1024 * 1024);
+
+	udp_relay_config config = {{}, 1, UDP_BATCH_GSO, 0.0f, PACING_FRAMERATE, group, interleave};
+	nhve_net_config net_config = {"127.0.0.1", (uint16_t)port};
+	udp_relay relay(config);
+
+	if(relay.start(&net_config, 0) < 0)
+		return;
+
+	atomic<bool> stop(false);
+	vector<vector<uint8_t> > datagrams;
+	thread receiver([&]{
+		vector<uint8_t> buffer(65536);
+		pollfd p = {fd, POLLIN, 0};
+
+		while(!stop)
+			if(poll(&p, 1, 10) > 0)
+				for(int size; (size = recv(fd, &buffer[0], buffer.size(), MSG_DONTWAIT)) > 0; )
+					datagrams.push_back(vector<uint8_t>(buffer.begin(), buffer.begin() + size));
+	});
+
+	int sender = socket(AF_INET, SOCK_DGRAM, 0);
+	sockaddr_in to = {0};
+	to.sin_family = AF_INET;
+	to.sin_port = htons(net_config.port);
+	inet_pton(AF_INET, net_config.ip, &to.sin_addr);
+
+	vector<int> packets(FEC_FRAMES);
+	vector<uint8_t> payload;
+
+	for(uint16_t f = 0; f < FEC_FRAMES; ++f)
+	{
+		packets[f] = (f % PACING_FRAMERATE == 0) ? PACING_KEYFRAME : PACING_PFRAME;
+
+		for(uint16_t p = 0; p < packets[f]; ++p)
+		{
+			fec_payload(f, p, packets[f], &payload);
+			sendto(sender, &payload[0], payload.size(), 0, (sockaddr*)&to, sizeof(to));
+			this_thread::sleep_for(chrono::microseconds(FEC_SPACING_US));
+		}
+
+		//encoder pause between frames, relay closes FEC groups
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+
+	relay.stop();
+	this_thread::sleep_for(chrono::milliseconds(50));
+	stop = true;
+	receiver.join();
+	close(sender);
+	close(fd);
+
+	const loss_model models[] = { {"random 1%", 0, 1, 0.01, 0}, {"random 5%", 0, 1, 0.05, 0},
+								{"burst 3%", 0.01, 0.3, 0, 1} }; //mean burst 3.3 datagrams
+
+	const string variant = group ? "fec " + to_string(group) + (interleave > 1 ? " x" + to_string(interleave) : "") : "no fec";
+
+	//groups are closed at frame end, each of up to interleave groups open then may be short
+	const int sent = accumulate(packets.begin(), packets.end(), 0);
+	double parity_limit = 0;
+
+	for(int f = 0; group && f < FEC_FRAMES; ++f)
+		parity_limit += (double)packets[f] / group + min(interleave, packets[f]);
+
+	const bool overhead_ok = datagrams.size() - sent <= parity_limit;
+
+	for(const loss_model &m : models)
+	{
+		uint32_t state = 777;
+		bool bad = false;
+		auto random = [&]{ state = state * 1664525 + 1013904223; return (state >> 8) / 16777216.0; };
+
+		vector<vector<bool> > delivered(FEC_FRAMES);
+		for(int f = 0; f < FEC_FRAMES; ++f)
+			delivered[f].resize(packets[f], false);
+
+		int lost = 0;
+		bool exact = true;
+
+		fec_decoder decoder;
+
+		auto deliver = [&](const uint8_t *data, int size)
+		{
+			mlsp_header h;
+
+			if(!mlsp_header_read(data, size, &h) || h.framenumber >= FEC_FRAMES || h.packet >= packets[h.framenumber])
+			{
+				exact = false;
+				return;
+			}
+
+			fec_payload(h.framenumber, h.packet, packets[h.framenumber], &payload);
+			exact = exact && size == (int)payload.size() && memcmp(data, &payload[0], size) == 0;
+			delivered[h.framenumber][h.packet] = true;
+		};
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+		for(const vector<uint8_t> &d : datagrams)
+		{
+			bad = bad ? random() >= m.bad_to_good : random() < m.good_to_bad;
+
+			if(random() < (bad ? m.loss_bad : m.loss_good))
+			{
+				++lost;
+				continue;
+			}
+
+			if(group)
+				decoder.receive(&d[0], d.size(), deliver);
+			else
+				deliver(&d[0], d.size());
+		}
+
+		const double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / FEC_FRAMES;
+
+		int frames = 0;
+
+		for(const vector<bool> &frame : delivered)
+			frames += find(frame.begin(), frame.end(), false) == frame.end();
+
+		add_result(variant, m.name + " frames " + to_string(frames * 100 / FEC_FRAMES) + "%", 0, 0, ms, exact && overhead_ok);
+		cout << "    lost " << lost << " of " << datagrams.size() << " datagrams, recovered " << decoder.stats().recovered
+			<< ", overhead " << (datagrams.size() - sent) * 100 / sent << "% (at most " << (int)(parity_limit * 100 / sent) << "%)" << endl;
+	}
+}
+
+void bench_fec()
+{
+	cout << "fec (loopback relay, " << FEC_FRAMES << " frames, " << PACING_KEYFRAME << "/" << PACING_PFRAME << " datagram key/P frames)" << endl;
+	cout << "  time is decoding per frame, frames are complete frames after recovery, MISMATCH if overhead is above limit" << endl;
+
+	bench_fec(0, 1);
+	bench_fec(8, 1);
+	bench_fec(4, 1);
+	bench_fec(4, 4);
+	bench_fec(10, 4);
+}
@@ -16,6 +16,36 @@
 // Network Hardware Video Encoder
 #include "nhve.h"
 
+// depth processing kernels
+#include "depth_kernels.h"
+
+// live camera, recording or synthetic frames
+#include "frame_source.h"
+
+// capture thread with bounded frame ring
+#include "capture.h"
+
+// VAAPI or software encoding
+#include "encoder.h"
+
+// per stage latency statistics
+#include "stats.h"
+
+// concurrent encoding of depth and texture
+#include "stream_workers.h"
+
+// shared dummy chroma planes
+#include "chroma_plane.h"
+
+// spatial/temporal depth denoising
+#include "depth_denoise.h"
+
+// texture QP offsets from depth
+#include "depth_roi.h"
+
+// fan-out to multiple receivers
+#include "udp_relay.h"
+
 // Realsense API
 #include <librealsense2/rs.hpp>
 #include <librealsense2/rs_advanced_mode.hpp>
@@ -40,21 +70,28 @@ struct input_args
 	int seconds;
 	float depth_units;
 	StreamType stream;
+	frame_source_config source;
+	capture_config capture;
+	encoder_config encoder;
+	stats_config stats;
+	udp_relay_config relay;
+	bool parallel_encode;
+	bool ir_in_chroma; //single encoder, infrared in depth U/V plane
 	std::string json;
 	bool needs_postprocessing;
+	depth_denoise_config denoise;
+	depth_roi_config roi;
 };
 
-bool main_loop(const input_args& input, rs2::pipeline& realsense, nhve *streamer);
-void process_depth_data(const input_args &input, rs2::depth_frame &depth);
+bool main_loop(const input_args& input, frame_source& realsense, encoder *streamer);
+void process_depth_data(const input_args &input, rs2::depth_frame &depth, depth_lut *lut);
 
-void init_realsense(rs2::pipeline& pipe, input_args& input);
-void init_realsense_depth(rs2::pipeline& pipe, const rs2::config &cfg, input_args& input);
-void print_intrinsics(const rs2::pipeline_profile& profile, rs2_stream stream);
+void init_realsense(frame_source& source, input_args& input);
+void init_realsense_depth(frame_source& source, input_args& input);
+void print_intrinsics(const frame_source& source, rs2_stream stream);
 
 int process_user_input(int argc, char* argv[], input_args* input, nhve_net_config *net_config, nhve_hw_config *hw_config);
 
-const uint16_t P010LE_MAX = 0xFFC0; //in binary 10 ones followed by 6 zeroes
-
 const int DEPTH = 0; //depth hardware encoder index
 const int IR = 1; //ir hardware encoder index
 
@@ -63,24 +100,38 @@ int main(int argc, char* argv[])
 	//prepare NHVE Network Hardware Video Encoder
 	struct nhve_net_config net_config = {0};
 	struct nhve_hw_config hw_configs[2] = { {0}, {0} };
-	struct nhve *streamer;
+	struct encoder *streamer;
 
 	struct input_args user_input = {0};
 	user_input.depth_units=0.0001f; //optionally override with user input
 
-	rs2::pipeline realsense;
-
 	if(process_user_input(argc, argv, &user_input, &net_config, hw_configs) < 0)
 		return 1;
 
+	frame_source realsense(user_input.source);
+
 	init_realsense(realsense, user_input);
 
-	if( (streamer = nhve_init(&net_config, hw_configs, 2, 0)) == NULL )
+	//with --fanout encoder sends to relay which sends to all destinations
+	udp_relay relay(user_input.relay);
+
+	if(relay.start(&net_config, 0) < 0)
+		return 1;
+
+	//with infrared in depth chroma there is only depth encoder
+	const int hw_size = user_input.ir_in_chroma ? 1 : 2;
+
+	if( (streamer = encoder_init(&net_config, hw_configs, hw_size, 0, user_input.encoder)) == NULL )
 		return hint_user_on_failure(argv);
 
+	//depth driven texture QP offsets go through FFmpeg frame side data, only software encoders take it
+	if(user_input.roi.qp && streamer->software.empty())
+		cerr << "WARNING - texture ROI needs software encoding (--encoder=software), ignored" << endl;
+
 	bool status = main_loop(user_input, realsense, streamer);
 
-	nhve_close(streamer);
+	encoder_close(streamer);
+	relay.stop();
 
 	if(status)
 		cout << "Finished successfully." << endl;
@@ -89,56 +140,75 @@ int main(int argc, char* argv[])
 }
 
 //true on success, false on failure
-bool main_loop(const input_args& input, rs2::pipeline& realsense, nhve *streamer)
+bool main_loop(const input_args& input, frame_source& realsense, encoder *streamer)
 {
 	const int frames = input.seconds * input.framerate;
 	int f;
 	nhve_frame frame[2] = { {0}, {0} };
 
-	uint16_t *depth_uv = NULL; //data of dummy color plane for P010LE
-	uint8_t *ir_uv = NULL; //data of dummy color plane for NV12 for Realsense infrared
+	frame_capture capture(realsense, input.capture);
+	captured_frameset captured;
+	const int streams = input.ir_in_chroma ? 1 : 2;
+	pipeline_stats stats(input.stats, input.ir_in_chroma ? vector<string>{"depth+infrared"} : vector<string>{"depth", "infrared"});
+
+	stream_workers workers(streamer, streams, input.parallel_encode, &stats);
+
+	depth_lut lut; //depth units conversion table (if device doesn't support depth units)
+	vector<uint16_t> depth_ir_uv; //depth U/V plane carrying infrared (with --ir-in-chroma)
+
+	thread_pool denoise_pool(input.denoise.strength ? input.denoise.threads : 1);
+	depth_denoiser denoiser(input.denoise.strength, denoise_pool);
+
+	depth_roi roi(input.roi);
 
 	for(f = 0; f < frames; ++f)
 	{
-		rs2::frameset frameset = realsense.wait_for_frames();
+		if(!capture.wait_for_frames(&captured))
+			break;
+
+		rs2::frameset frameset = captured.frameset;
 		rs2::depth_frame depth = frameset.get_depth_frame();
 		rs2::video_frame ir = frameset.get_infrared_frame();
 
-		const int w = depth.get_width();
 		const int h = depth.get_height();
-		const int depth_stride=depth.get_stride_in_bytes();
+		int depth_stride=depth.get_stride_in_bytes();
+		uint16_t *depth_data = (uint16_t*)depth.get_data(); //realsense frame or denoised copy
 		const int ir_stride=ir.get_stride_in_bytes();
 
 		//L515 doesn't support setting depth units and clamping
 		if(input.needs_postprocessing)
-			process_depth_data(input, depth);
-
-		if(!depth_uv)
-		{  //prepare dummy color plane for P010LE format, half the size of Y
-			//we can't alloc it in advance, this is the first time we know realsense stride
-			//the stride will be at least width * 2 (Realsense Z16, VAAPI P010LE)
-			depth_uv = new uint16_t[depth_stride/2*h/2];
-
-			for(int i=0;i<depth_stride/2*h/2;++i)
-				depth_uv[i] = UINT16_MAX / 2; //dummy middle value for U/V, equals 128 << 8, equals 32768
-
-			//prepare dummy color plane for NV12 format, half the size of Y
-			if(input.stream == INFRARED)
-			{
-				ir_uv = new uint8_t[ir_stride * h /2];
-				memset(ir_uv, 128, ir_stride * h /2);
-			}
+		{
+			process_depth_data(input, depth, &lut);
+			captured.processed = chrono::steady_clock::now();
+		}
+
+		if(input.denoise.strength)
+		{
+			depth_data = denoiser.process(depth_data, depth.get_width(), h, depth_stride);
+			depth_stride = depth.get_width() * 2;
+			captured.processed = chrono::steady_clock::now();
 		}
 
 		//supply realsense depth frame data as ffmpeg frame data
+		//the stride will be at least width * 2 (Realsense Z16, VAAPI P010LE)
 		frame[0].linesize[0] = frame[0].linesize[1] =  depth_stride; //the strides of Y and UV are equal
-		frame[0].data[0] = (uint8_t*) depth.get_data();
-		frame[0].data[1] = (uint8_t*) depth_uv;
+		frame[0].data[0] = (uint8_t*) depth_data;
+		frame[0].data[1] = chroma_plane_p010le(depth_stride, h); //shared dummy U/V plane
+
+		if(input.ir_in_chroma)
+		{  //2x downsampled infrared in depth U, the same stride as depth Y
+			depth_ir_uv.resize(depth_stride / 2 * (h / 2));
+			chroma_plane_pack_ir((const uint8_t*)ir.get_data(), ir_stride, depth.get_width(), h, &depth_ir_uv[0], depth_stride);
+			frame[0].data[1] = (uint8_t*)&depth_ir_uv[0];
+		}
 
-		if(nhve_send(streamer, &frame[0], 0) != NHVE_OK)
+		//infrared is the left imager, the same geometry as depth
+		if(input.roi.qp)
 		{
-			cerr << "failed to send" << endl;
-			break;
+			const float units = input.needs_postprocessing ? input.depth_units : depth.get_units();
+
+			encoder_set_roi(streamer, IR, roi.process(depth_data, depth.get_width(), h, depth_stride, units));
+			captured.roi = chrono::steady_clock::now();
 		}
 
 		//supply realsense infrared frame data as ffmpeg frame data
@@ -146,71 +216,66 @@ bool main_loop(const input_args& input, rs2::pipeline& realsense, nhve *streamer
 		frame[1].data[0] = (uint8_t*) ir.get_data();
 
 		frame[1].linesize[1] = (input.stream == INFRARED) ? ir_stride : 0; //NV12 strides of Y and UV are equal, UYVY is single plane
-		frame[1].data[1] = ir_uv; //data for NV12 or NULL for single plane UYVY
+		frame[1].data[1] = (input.stream == INFRARED) ? chroma_plane_nv12(ir_stride, ir.get_height()) : NULL; //NV12 dummy U/V or NULL for UYVY
 
-		if(nhve_send(streamer, &frame[1], 1) != NHVE_OK)
+		//depth and texture are encoded one after another or concurrently
+		if(workers.send(frame) != NHVE_OK)
 		{
 			cerr << "failed to send" << endl;
 			break;
 		}
+
+		stats.add_frameset(captured, capture.dropped());
 	}
 
 	//flush the hardware by sending NULL frames
-	nhve_send(streamer, NULL, 0);
-	nhve_send(streamer, NULL, 1);
+	workers.send(NULL);
 
-	delete [] depth_uv;
-	delete [] ir_uv;
+	stats.finish(capture.dropped());
 
 	//all the requested frames processed?
 	return f==frames;
 }
 
-void process_depth_data(const input_args &input, rs2::depth_frame &depth)
+void process_depth_data(const input_args &input, rs2::depth_frame &depth, depth_lut *lut)
 {
-	const int half_stride = depth.get_stride_in_bytes()/2;
-	const int height = depth.get_height();
-
 	const float depth_units_set = depth.get_units();
 	const float multiplier = depth_units_set / input.depth_units;
 
 	//note - we process data in place rather than making a copy
 	uint16_t* data = (uint16_t*)depth.get_data();
 
-	for(int i = 0;i < half_stride * height; ++i)
-	{
-		uint32_t val = data[i] * multiplier;
-		data[i] = val <= P010LE_MAX ? val : 0;
-	}
+	//lookup table or vectorized arithmetic (whichever is faster on this CPU)
+	//the table is rebuilt only if device reports different depth units
+	depth_rescale(lut, data, depth.get_width(), depth.get_height(), depth.get_stride_in_bytes(), multiplier);
 }
 
-void init_realsense(rs2::pipeline& pipe, input_args& input)
+void init_realsense(frame_source& source, input_args& input)
 {
-	rs2::config cfg;
 
-	cfg.enable_stream(RS2_STREAM_DEPTH, input.width, input.height, RS2_FORMAT_Z16, input.framerate);
+	source.enable_stream(RS2_STREAM_DEPTH, input.width, input.height, RS2_FORMAT_Z16, input.framerate);
 	if(input.stream == INFRARED)
-		cfg.enable_stream(RS2_STREAM_INFRARED, input.width, input.height, RS2_FORMAT_Y8, input.framerate);
+		source.enable_stream(RS2_STREAM_INFRARED, input.width, input.height, RS2_FORMAT_Y8, input.framerate);
 	else //INFRARED_RGB
-		cfg.enable_stream(RS2_STREAM_INFRARED, input.width, input.height, RS2_FORMAT_UYVY, input.framerate);
+		source.enable_stream(RS2_STREAM_INFRARED, input.width, input.height, RS2_FORMAT_UYVY, input.framerate);
 
-	rs2::pipeline_profile profile = pipe.start(cfg);
+	source.start();
 
-	init_realsense_depth(pipe, cfg, input);
+	init_realsense_depth(source, input);
 	
-	print_intrinsics(profile, RS2_STREAM_DEPTH);
+	print_intrinsics(source, RS2_STREAM_DEPTH);
 }
 
-void init_realsense_depth(rs2::pipeline& pipe, const rs2::config &cfg, input_args& input)
+void init_realsense_depth(frame_source& source, input_args& input)
 {
-	rs2::pipeline_profile profile = pipe.get_active_profile();
+	rs2::device device = source.get_device();
 
-	rs2::depth_sensor depth_sensor = profile.get_device().first<rs2::depth_sensor>();
+	rs2::depth_sensor depth_sensor = device.first<rs2::depth_sensor>();
 
 	if(!input.json.empty())
 	{
 		cout << "loading settings from json:" << endl << input.json  << endl;
-		auto serializable  = profile.get_device().as<rs2::serializable_device>();
+		auto serializable  = device.as<rs2::serializable_device>();
 		serializable.load_json(input.json);
 	}
 
@@ -247,16 +312,17 @@ void init_realsense_depth(rs2::pipeline& pipe, const rs2::config &cfg, input_arg
 	cout << "-range " << input.depth_units * P010LE_MAX << " m" << endl;
 	cout << "-precision " << input.depth_units*64.0f << " m (" << input.depth_units*64.0f*1000 << " mm)" << endl;
 
-	bool supports_advanced_mode = depth_sensor.supports(RS2_CAMERA_INFO_ADVANCED_MODE);
+	//recordings and synthetic frames may only be post-processed
+	bool supports_advanced_mode = depth_sensor.supports(RS2_CAMERA_INFO_ADVANCED_MODE) && source.is_live();
 
 	if(supports_advanced_mode)
 	{
-		 rs400::advanced_mode advanced = profile.get_device();
-		 pipe.stop(); //workaround the problem with setting advanced_mode on running stream
+		 rs400::advanced_mode advanced = device;
+		 source.stop(); //workaround the problem with setting advanced_mode on running stream
 		 STDepthTableControl depth_table = advanced.get_depth_table();
 		 depth_table.depthClampMax = P010LE_MAX;
 		 advanced.set_depth_table(depth_table);
-		 profile = pipe.start(cfg);
+		 source.start();
 	}
 	else
 	{
@@ -268,9 +334,9 @@ void init_realsense_depth(rs2::pipeline& pipe, const rs2::config &cfg, input_arg
 	" range at " << input.depth_units * P010LE_MAX << " m" << endl;
 }
 
-void print_intrinsics(const rs2::pipeline_profile& profile, rs2_stream stream)
+void print_intrinsics(const frame_source& source, rs2_stream stream)
 {
-	rs2::video_stream_profile stream_profile = profile.get_stream(stream).as<rs2::video_stream_profile>();
+	rs2::video_stream_profile stream_profile = source.get_stream(stream).as<rs2::video_stream_profile>();
 	rs2_intrinsics i = stream_profile.get_intrinsics();
 
 	const float rad2deg = 180.0f / M_PI;
@@ -286,6 +352,9 @@ void print_intrinsics(const rs2::pipeline_profile& profile, rs2_stream stream)
 
 int process_user_input(int argc, char* argv[], input_args* input, nhve_net_config *net_config, nhve_hw_config *hw_config)
 {
+	options opts;
+	argc = options_parse(argc, argv, &opts);
+
 	if(argc < 8)
 	{
 		cerr << "Usage: " << argv[0] << " <host> <port> <ir/ir-rgb> <width> <height> <framerate> <seconds> [device] [bitrate_depth] [bitrate_ir] [depth units] [json]" << endl;
@@ -302,6 +371,31 @@ int process_user_input(int argc, char* argv[], input_args* input, nhve_net_confi
 		cerr << argv[0] << " 192.168.0.100 9768 ir-rgb 848 480 30 500 /dev/dri/renderD128 8000000 1000000 0.00003125" << endl;
 		cerr << argv[0] << " 192.168.0.100 9768 ir 640 480 30 500 /dev/dri/renderD128 8000000 1000000 0.0000390625 my_config.json" << endl;
 
+		cerr << endl << "options:" << endl;
+		cerr << "--source=S           live, synthetic or recording.bag (default live)" << endl;
+		cerr << "--realtime=0/1       play recording/synthetic frames in real time (default 1)" << endl;
+		cerr << "--ring=drop/block    capture ring policy when encoding is too slow (default drop, block with --realtime=0)" << endl;
+		cerr << "--ring-size=N        capture ring size, 0 to capture on encoding thread (default 2)" << endl;
+		cerr << "--encoder=E          auto, vaapi, software or null (default auto, software if VAAPI fails)" << endl;
+		cerr << "--encoder-threads=N  software encoder threads (default 0, all cores)" << endl;
+		cerr << "--encoder-preset=P   software encoder x264/x265 preset (default superfast/ultrafast)" << endl;
+		cerr << "--stats=N            print latency statistics every N seconds (default 0, only at exit)" << endl;
+		cerr << "--stats-csv=FILE     write every statistics report to csv file" << endl;
+		cerr << "--stats-json=FILE    write statistics summary to json file at exit" << endl;
+		cerr << "--fanout=H:P,...     also send to these hosts/multicast groups (e.g. 239.0.0.1:9766)" << endl;
+		cerr << "--multicast-ttl=N    multicast time to live (default 1, local network)" << endl;
+		cerr << "--udp-batch=B        frame (and relay) send batching off, mmsg or gso (default gso)" << endl;
+		cerr << "--pacing=F           send each frame over fraction F of frame interval (default 0, burst)" << endl;
+		cerr << "--fec=K              XOR parity per K datagrams 2-64, needs rnhve-fec-receiver (default 0, disabled)" << endl;
+		cerr << "--fec-interleave=D   interleaved FEC groups for burst loss 1-16 (default 1)" << endl;
+		cerr << "--parallel-encode    encode depth and ir concurrently" << endl;
+		cerr << "--ir-in-chroma       ir only: 2x downsampled ir in depth U plane, single encoder" << endl;
+		cerr << "--denoise=N          spatial/temporal depth denoising strength 1-3 (default 0, disabled)" << endl;
+		cerr << "--denoise-threads=N  denoising threads (default 0, all cores)" << endl;
+		cerr << "--roi=N              texture QP offset of far background from depth (default 0, disabled)" << endl;
+		cerr << "--roi-near=M         roi, full texture quality up to this depth in meters (default 1.0)" << endl;
+		cerr << "--roi-far=M          roi, the whole QP offset from this depth in meters (default 3.0)" << endl;
+
 		return -1;
 	}
 
@@ -384,6 +478,49 @@ int process_user_input(int argc, char* argv[], input_args* input, nhve_net_confi
 
 	input->needs_postprocessing = false;
 
+	if(frame_source_config_parse(opts, &input->source) < 0)
+		return -1;
+
+	if(capture_config_parse(opts, &input->capture) < 0)
+		return -1;
+
+	if(encoder_config_parse(opts, &input->encoder) < 0)
+		return -1;
+
+	if(stats_config_parse(opts, &input->stats) < 0)
+		return -1;
+
+	if(udp_relay_config_parse(opts, input->framerate, &input->relay) < 0)
+		return -1;
+
+	input->parallel_encode = options_has(opts, "parallel-encode");
+	input->ir_in_chroma = options_has(opts, "ir-in-chroma");
+
+	if(input->ir_in_chroma && input->stream != INFRARED)
+	{
+		cerr << "--ir-in-chroma needs 'ir' stream (Y8), not 'ir-rgb'" << endl;
+		return -1;
+	}
+
+	if(depth_denoise_config_parse(opts, &input->denoise) < 0)
+		return -1;
+
+	if(depth_roi_config_parse(opts, &input->roi) < 0)
+		return -1;
+
+	if(input->roi.qp && input->ir_in_chroma)
+	{
+		cerr << "--roi works with infrared encoded as separate stream (without --ir-in-chroma)" << endl;
+		return -1;
+	}
+
+	//software infrared encoder is initialized with adaptive quantization for QP offsets
+	if(input->roi.qp)
+		input->encoder.roi_subframe = IR;
+
+	if(input->ir_in_chroma)
+		cout << "Infrared in depth chroma (" << input->width / 2 << "x" << input->height / 2 << "), single encoder" << endl;
+
 	return 0;
 }
 
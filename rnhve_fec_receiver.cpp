@@ -0,0 +1,151 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ * (FEC recovery in front of the receiving end)
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+// XOR parity forward error correction
+#include "udp_fec.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+//user supplied input
+struct input_args
+{
+	int listen_port;
+	string host;
+	string port;
+	int seconds;
+};
+
+int process_user_input(int argc, char* argv[], input_args* input);
+int open_sockets(const input_args &input, int *in, int *out);
+
+int main(int argc, char* argv[])
+{
+	input_args input;
+	int in, out;
+
+	if(process_user_input(argc, argv, &input) < 0)
+		return 1;
+
+	if(open_sockets(input, &in, &out) < 0)
+		return 1;
+
+	cout << "Recovering port " << input.listen_port << " to " << input.host << ":" << input.port << endl;
+
+	fec_decoder decoder;
+	vector<uint8_t> buffer(65536);
+	pollfd fd = {in, POLLIN, 0};
+	uint64_t forwarded = 0, failed = 0;
+
+	auto deliver = [&](const uint8_t *payload, int size)
+	{
+		if(send(out, payload, size, 0) == size)
+			++forwarded;
+		else
+			++failed;
+	};
+
+	const chrono::steady_clock::time_point end = chrono::steady_clock::now() + chrono::seconds(input.seconds);
+
+	while(chrono::steady_clock::now() < end)
+	{
+		if(poll(&fd, 1, 100) <= 0)
+			continue;
+
+		for(int size; (size = recv(in, &buffer[0], buffer.size(), MSG_DONTWAIT)) >= 0; )
+			decoder.receive(&buffer[0], size, deliver);
+	}
+
+	const fec_decoder_stats &stats = decoder.stats();
+
+	cout << "Received " << stats.received << ", recovered " << stats.recovered << ", lost " << stats.lost <<
+		", invalid " << stats.invalid << ", forwarded " << forwarded << ", failed to forward " << failed << endl;
+
+	close(in);
+	close(out);
+
+	return 0;
+}
+
+int open_sockets(const input_args &input, int *in, int *out)
+{
+	sockaddr_in local = {0};
+	local.sin_family = AF_INET;
+	local.sin_addr.s_addr = htonl(INADDR_ANY);
+	local.sin_port = htons(input.listen_port);
+
+	const int buffer = 8 * 1024 * 1024; //keyframe bursts
+
+	if( (*in = socket(AF_INET, SOCK_DGRAM, 0)) < 0 || bind(*in, (sockaddr*)&local, sizeof(local)) < 0)
+	{
+		cerr << "unable to listen on port " << input.listen_port << ": " << strerror(errno) << endl;
+		return -1;
+	}
+
+	setsockopt(*in, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+
+	addrinfo hints = {0}, *address = NULL;
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	const int error = getaddrinfo(input.host.c_str(), input.port.c_str(), &hints, &address);
+
+	if(error)
+	{
+		cerr << "unable to resolve " << input.host << ": " << gai_strerror(error) << endl;
+		return -1;
+	}
+
+	if( (*out = socket(AF_INET, SOCK_DGRAM, 0)) < 0 || connect(*out, address->ai_addr, address->ai_addrlen) < 0)
+	{
+		cerr << "unable to create socket for " << input.host << ":" << input.port << ": " << strerror(errno) << endl;
+		freeaddrinfo(address);
+		return -1;
+	}
+
+	freeaddrinfo(address);
+
+	return 0;
+}
+
+int process_user_input(int argc, char* argv[], input_args* input)
+{
+	if(argc < 5)
+	{
+		cerr << "Usage: " << argv[0] << " <listen port> <host> <port> <seconds>" << endl;
+		cerr << endl << "Receives stream sent with --fec, recovers lost datagrams and forwards the stream to host:port" << endl;
+		cerr << endl << "examples: " << endl;
+		cerr << argv[0] << " 9766 127.0.0.1 9767 60" << endl;
+		return -1;
+	}
+
+	input->listen_port = atoi(argv[1]);
+	input->host = argv[2];
+	input->port = argv[3];
+	input->seconds = atoi(argv[4]);
+
+	return 0;
+}
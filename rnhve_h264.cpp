@@ -13,16 +13,45 @@
 // Network Hardware Video Encoder
 #include "nhve.h"
 
+// depth processing kernels
+#include "depth_kernels.h"
+
+// 8 bit depth packing
+#include "depth_pack.h"
+
+// live camera, recording or synthetic frames
+#include "frame_source.h"
+
+// capture thread with bounded frame ring
+#include "capture.h"
+
+// VAAPI or software encoding
+#include "encoder.h"
+
+// per stage latency statistics
+#include "stats.h"
+
+// sequential or concurrent encoding of streams
+#include "stream_workers.h"
+
+// shared dummy chroma planes
+#include "chroma_plane.h"
+
+// fan-out to multiple receivers
+#include "udp_relay.h"
+
 // Realsense API
 #include <librealsense2/rs.hpp>
 
 #include <fstream>
+#include <streambuf> //loading json config
 #include <iostream>
+#include <vector>
 using namespace std;
 
 int hint_user_on_failure(char *argv[]);
 
-enum StreamType {COLOR, INFRARED, INFRARED_RGB};
+enum StreamType {COLOR, INFRARED, INFRARED_RGB, DEPTH};
 
 //user supplied input
 struct input_args
@@ -31,11 +60,21 @@ struct input_args
 	int height;
 	int framerate;
 	int seconds;
+	float depth_units;
 	StreamType stream;
+	frame_source_config source;
+	capture_config capture;
+	encoder_config encoder;
+	stats_config stats;
+	udp_relay_config relay;
+	std::string json;
+	bool needs_postprocessing;
 };
 
-bool main_loop(const input_args& input, rs2::pipeline& realsense, nhve *streamer);
-void init_realsense(rs2::pipeline& pipe, const input_args& input);
+bool main_loop(const input_args& input, frame_source& realsense, encoder *streamer);
+bool main_loop_depth(const input_args& input, frame_source& realsense, encoder *streamer);
+void init_realsense(frame_source& source, input_args& input);
+void init_realsense_depth(frame_source& source, input_args& input);
 int process_user_input(int argc, char* argv[], input_args* input, nhve_net_config *net_config, nhve_hw_config *hw_config);
 
 int main(int argc, char* argv[])
@@ -45,23 +84,32 @@ int main(int argc, char* argv[])
 	//prepare NHVE Network Hardware Video Encoder
 	struct nhve_net_config net_config = {0};
 	struct nhve_hw_config hw_config = {0};
-	struct nhve *streamer;
+	struct encoder *streamer;
 
 	struct input_args user_input = {0};
-
-	rs2::pipeline realsense;
+	user_input.depth_units=0.0001f; //optionally override with user input
 
 	if(process_user_input(argc, argv, &user_input, &net_config, &hw_config) < 0)
 		return 1;
 
+	frame_source realsense(user_input.source);
+
 	init_realsense(realsense, user_input);
 
-	if( (streamer = nhve_init(&net_config, &hw_config, 1, 0)) == NULL )
+	//with --fanout encoder sends to relay which sends to all destinations
+	udp_relay relay(user_input.relay);
+
+	if(relay.start(&net_config, 0) < 0)
+		return 1;
+
+	if( (streamer = encoder_init(&net_config, &hw_config, 1, 0, user_input.encoder)) == NULL )
 		return hint_user_on_failure(argv);
 
-	bool status=main_loop(user_input, realsense, streamer);
+	bool status = (user_input.stream == DEPTH) ?
+		main_loop_depth(user_input, realsense, streamer) : main_loop(user_input, realsense, streamer);
 
-	nhve_close(streamer);
+	encoder_close(streamer);
+	relay.stop();
 
 	if(status)
 		cout << "Finished successfully." << endl;
@@ -70,69 +118,182 @@ int main(int argc, char* argv[])
 }
 
 //true on success, false on failure
-bool main_loop(const input_args& input, rs2::pipeline& realsense, nhve *streamer)
+bool main_loop(const input_args& input, frame_source& realsense, encoder *streamer)
 {
 	const int frames = input.seconds * input.framerate;
 	int f;
 	nhve_frame frame = {0};
-	uint8_t *color_data = NULL; //data of dummy color plane for NV12 with Realsense infrared
+
+	frame_capture capture(realsense, input.capture);
+	captured_frameset captured;
+	pipeline_stats stats(input.stats, {input.stream == COLOR ? "color" : "infrared"});
+	stream_workers workers(streamer, 1, false, &stats);
 
 	for(f = 0; f < frames; ++f)
 	{
-		rs2::frameset frameset = realsense.wait_for_frames();
+		if(!capture.wait_for_frames(&captured))
+			break;
 
-		rs2::video_frame video_frame = (input.stream == COLOR) ? frameset.get_color_frame() : frameset.get_infrared_frame(0);
+		rs2::frameset frameset = captured.frameset;
 
-		if(input.stream == INFRARED && !color_data)
-		{  //prepare dummy color plane for NV12 format, half the size of Y
-		   //we can't alloc it in advance, this is the first time we know realsense stride
-			int size = video_frame.get_stride_in_bytes()*video_frame.get_height()/2;
-			color_data = new uint8_t[size];
-			memset(color_data, 128, size);
-		}
+		rs2::video_frame video_frame = (input.stream == COLOR) ? frameset.get_color_frame() : frameset.get_infrared_frame(0);
 
 		frame.linesize[0] =  video_frame.get_stride_in_bytes();
 		frame.data[0] = (uint8_t*) video_frame.get_data();
 
 		//if we are streaming infrared we have 2 planes (luminance and color)
+		//the shared dummy color plane for NV12 follows realsense stride (known only from frame)
 		frame.linesize[1] = (input.stream == INFRARED) ? frame.linesize[0] : 0;
-		frame.data[1] = color_data; //dummy color plane for infrared
+		frame.data[1] = (input.stream == INFRARED) ? chroma_plane_nv12(frame.linesize[0], video_frame.get_height()) : NULL;
+
+		if(workers.send(&frame) != NHVE_OK)
+		{
+			cerr << "failed to send" << endl;
+			break;
+		}
+
+		stats.add_frameset(captured, capture.dropped());
+	}
+
+	//flush the streamer by sending NULL frame
+	workers.send(NULL);
+
+	stats.finish(capture.dropped());
+
+	//all the requested frames processed?
+	return f==frames;
+}
+
+//true on success, false on failure
+bool main_loop_depth(const input_args& input, frame_source& realsense, encoder *streamer)
+{
+	const int frames = input.seconds * input.framerate;
+	int f;
+	nhve_frame frame = {0};
+
+	frame_capture capture(realsense, input.capture);
+	captured_frameset captured;
+	pipeline_stats stats(input.stats, {"depth"});
+	stream_workers workers(streamer, 1, false, &stats);
+	depth_lut lut; //depth units conversion table (if device doesn't support depth units)
+	vector<uint8_t> nv12; //packed depth, Y plane followed by UV plane
+
+	for(f = 0; f < frames; ++f)
+	{
+		if(!capture.wait_for_frames(&captured))
+			break;
+
+		rs2::depth_frame depth = captured.frameset.get_depth_frame();
 
-		if(nhve_send(streamer, &frame, 0) != NHVE_OK)
+		const int w = depth.get_width();
+		const int h = depth.get_height();
+		const int stride = depth.get_stride_in_bytes();
+
+		//L515 doesn't support setting depth units
+		if(input.needs_postprocessing)
+			depth_rescale(&lut, (uint16_t*)depth.get_data(), w, h, stride, depth.get_units() / input.depth_units);
+
+		//16 bit depth to 8 bit NV12 for H.264 (see depth_pack.h)
+		nv12.resize(w * h * 3 / 2);
+		depth_pack_nv12((const uint16_t*)depth.get_data(), stride, w, h, &nv12[0], w, &nv12[w * h], w);
+		captured.processed = chrono::steady_clock::now();
+
+		frame.linesize[0] = frame.linesize[1] = w;
+		frame.data[0] = &nv12[0];
+		frame.data[1] = &nv12[w * h];
+
+		if(workers.send(&frame) != NHVE_OK)
 		{
 			cerr << "failed to send" << endl;
 			break;
 		}
+
+		stats.add_frameset(captured, capture.dropped());
 	}
 
 	//flush the streamer by sending NULL frame
-	nhve_send(streamer, NULL, 0);
+	workers.send(NULL);
 
-	delete [] color_data;
+	stats.finish(capture.dropped());
 
 	//all the requested frames processed?
 	return f==frames;
 }
 
-void init_realsense(rs2::pipeline& pipe, const input_args& input)
+void init_realsense(frame_source& source, input_args& input)
 {
-	rs2::config cfg;
 
 	if(input.stream == COLOR)
-		cfg.enable_stream(RS2_STREAM_COLOR, input.width, input.height, RS2_FORMAT_YUYV, input.framerate);
+		source.enable_stream(RS2_STREAM_COLOR, input.width, input.height, RS2_FORMAT_YUYV, input.framerate);
 	else if(input.stream == INFRARED)
-		cfg.enable_stream(RS2_STREAM_INFRARED, input.width, input.height, RS2_FORMAT_Y8, input.framerate);
-	else //INFRARED_RGB
-		cfg.enable_stream(RS2_STREAM_INFRARED, input.width, input.height, RS2_FORMAT_UYVY, input.framerate);
+		source.enable_stream(RS2_STREAM_INFRARED, input.width, input.height, RS2_FORMAT_Y8, input.framerate);
+	else if(input.stream == INFRARED_RGB)
+		source.enable_stream(RS2_STREAM_INFRARED, input.width, input.height, RS2_FORMAT_UYVY, input.framerate);
+	else //DEPTH
+		source.enable_stream(RS2_STREAM_DEPTH, input.width, input.height, RS2_FORMAT_Z16, input.framerate);
+
+	source.start();
 
-	rs2::pipeline_profile profile = pipe.start(cfg);
+	if(input.stream == DEPTH)
+		init_realsense_depth(source, input);
+}
+
+//unlike P010LE the packing uses the whole 16 bit range, no clamping
+void init_realsense_depth(frame_source& source, input_args& input)
+{
+	rs2::device device = source.get_device();
+
+	rs2::depth_sensor depth_sensor = device.first<rs2::depth_sensor>();
+
+	if(!input.json.empty())
+	{
+		cout << "loading settings from json:" << endl << input.json  << endl;
+		auto serializable  = device.as<rs2::serializable_device>();
+		serializable.load_json(input.json);
+	}
+
+	bool supports_depth_units = depth_sensor.supports(RS2_OPTION_DEPTH_UNITS) &&
+										!depth_sensor.is_option_read_only(RS2_OPTION_DEPTH_UNITS);
+
+	float depth_unit_set = input.depth_units;
+
+	if(supports_depth_units)
+	{
+		try
+		{
+			depth_sensor.set_option(RS2_OPTION_DEPTH_UNITS, input.depth_units);
+			depth_unit_set = depth_sensor.get_option(RS2_OPTION_DEPTH_UNITS);
+			if(depth_unit_set != input.depth_units)
+				cerr << "WARNING - device corrected depth units to value: " << depth_unit_set << endl;
+		}
+		catch(const exception &)
+		{
+			rs2::option_range range = depth_sensor.get_option_range(RS2_OPTION_DEPTH_UNITS);
+			cerr << "failed to set depth units to " << input.depth_units << " (range is " << range.min << "-" << range.max << ")" << endl;
+			throw;
+		}
+	}
+	else
+	{
+		cerr << "WARNING - device doesn't support setting depth units!" << endl;
+		input.needs_postprocessing = true;
+	}
+
+	cout << (supports_depth_units ? "Setting" : "Simulating") <<
+		" realsense depth units: " << depth_unit_set << endl;
+	cout << "This will result in:" << endl;
+	cout << "-range " << input.depth_units * UINT16_MAX << " m" << endl;
+	cout << "-precision " << input.depth_units*4.0f << " m (" << input.depth_units*4.0f*1000 << " mm) on flat surfaces" << endl;
 }
 
 int process_user_input(int argc, char* argv[], input_args* input, nhve_net_config *net_config, nhve_hw_config *hw_config)
 {
+	options opts;
+	argc = options_parse(argc, argv, &opts);
+
 	if(argc < 8)
 	{
-		cerr << "Usage: " << argv[0] << " <host> <port> <color/ir/ir-rgb> <width> <height> <framerate> <seconds> [device] [bitrate]" << endl;
+		cerr << "Usage: " << argv[0] << " <host> <port> <color/ir/ir-rgb/depth> <width> <height> <framerate> <seconds> [device] [bitrate] [depth units] [json]" << endl;
 		cerr << endl << "examples: " << endl;
 		cerr << argv[0] << " 127.0.0.1 9766 color 640 360 30 5" << endl;
 		cerr << argv[0] << " 127.0.0.1 9766 ir 640 360 30 5" << endl;
@@ -141,6 +302,26 @@ int process_user_input(int argc, char* argv[], input_args* input, nhve_net_confi
 		cerr << argv[0] << " 127.0.0.1 9766 ir 640 360 30 5 /dev/dri/renderD128" << endl;
 		cerr << argv[0] << " 127.0.0.1 9766 ir-rgb 640 360 30 5 /dev/dri/renderD128" << endl;
 		cerr << argv[0] << " 192.168.0.125 9766 color 640 360 30 50 /dev/dri/renderD128 500000" << endl;
+		cerr << argv[0] << " 192.168.0.100 9768 depth 848 480 30 500 /dev/dri/renderD128 4000000 0.0001" << endl;
+		cerr << argv[0] << " 192.168.0.100 9768 depth 640 480 30 500 /dev/dri/renderD128 4000000 0.0001 my_config.json" << endl;
+
+		cerr << endl << "options:" << endl;
+		cerr << "--source=S           live, synthetic or recording.bag (default live)" << endl;
+		cerr << "--realtime=0/1       play recording/synthetic frames in real time (default 1)" << endl;
+		cerr << "--ring=drop/block    capture ring policy when encoding is too slow (default drop, block with --realtime=0)" << endl;
+		cerr << "--ring-size=N        capture ring size, 0 to capture on encoding thread (default 2)" << endl;
+		cerr << "--encoder=E          auto, vaapi, software or null (default auto, software if VAAPI fails)" << endl;
+		cerr << "--encoder-threads=N  software encoder threads (default 0, all cores)" << endl;
+		cerr << "--encoder-preset=P   software encoder x264/x265 preset (default superfast/ultrafast)" << endl;
+		cerr << "--stats=N            print latency statistics every N seconds (default 0, only at exit)" << endl;
+		cerr << "--stats-csv=FILE     write every statistics report to csv file" << endl;
+		cerr << "--stats-json=FILE    write statistics summary to json file at exit" << endl;
+		cerr << "--fanout=H:P,...     also send to these hosts/multicast groups (e.g. 239.0.0.1:9766)" << endl;
+		cerr << "--multicast-ttl=N    multicast time to live (default 1, local network)" << endl;
+		cerr << "--udp-batch=B        frame (and relay) send batching off, mmsg or gso (default gso)" << endl;
+		cerr << "--pacing=F           send each frame over fraction F of frame interval (default 0, burst)" << endl;
+		cerr << "--fec=K              XOR parity per K datagrams 2-64, needs rnhve-fec-receiver (default 0, disabled)" << endl;
+		cerr << "--fec-interleave=D   interleaved FEC groups for burst loss 1-16 (default 1)" << endl;
 
 		return -1;
 	}
@@ -153,6 +334,8 @@ int process_user_input(int argc, char* argv[], input_args* input, nhve_net_confi
 		input->stream = INFRARED;
 	if(strlen(argv[3]) > 3 && argv[3][2] == '-')
 		input->stream = INFRARED_RGB;
+	if(argv[3][0] == 'd')
+		input->stream = DEPTH;
 
 	//native format of Realsense RGB sensor is YUYV (YUY2, YUYV422)
 	//see https://github.com/IntelRealSense/librealsense/issues/3042
@@ -165,9 +348,13 @@ int process_user_input(int argc, char* argv[], input_args* input, nhve_net_confi
 	//- Realsense IR sensor Y8 with VAAPI NV12 (luminance plane with dummy color plane)
 	//- Realsense IR sensor rgb data UYVY with VAAPI uyvy422
 	//this way we always have optimal format at least on one side and hardware conversion on other
+
+	//H.264 has no 10 bit profile in VAAPI, depth is packed into 8 bit NV12
+	//(coarse depth in Y, fine depth as triangle waves in U/V, see depth_pack.h)
+	//receiving end has to unpack it with depth_unpack_nv12
 	hw_config->pixel_format = "yuyv422";
 
-	if(input->stream == INFRARED)
+	if(input->stream == INFRARED || input->stream == DEPTH)
 		hw_config->pixel_format = "nv12";
 	else if(input->stream == INFRARED_RGB)
 		hw_config->pixel_format = "uyvy422";
@@ -195,6 +382,38 @@ int process_user_input(int argc, char* argv[], input_args* input, nhve_net_confi
 	//with 848x480 HEVC Main10 encoding
 	hw_config->compression_level = 1;
 
+	if(argc > 10)
+		input->depth_units = strtof(argv[10], NULL);
+
+	if(argc > 11)
+	{
+		ifstream file(argv[11]);
+		if(!file)
+		{
+			cerr << "unable to open file " << argv[11] << endl;
+			return -1;
+		}
+
+		input->json = string((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+	}
+
+	input->needs_postprocessing = false;
+
+	if(frame_source_config_parse(opts, &input->source) < 0)
+		return -1;
+
+	if(capture_config_parse(opts, &input->capture) < 0)
+		return -1;
+
+	if(encoder_config_parse(opts, &input->encoder) < 0)
+		return -1;
+
+	if(stats_config_parse(opts, &input->stats) < 0)
+		return -1;
+
+	if(udp_relay_config_parse(opts, input->framerate, &input->relay) < 0)
+		return -1;
+
 	return 0;
 }
 
@@ -204,5 +423,6 @@ int hint_user_on_failure(char *argv[])
 	cerr << argv[0] << " 127.0.0.1 9766 color 640 360 30 5 /dev/dri/renderD128" << endl;
 	cerr << argv[0] << " 127.0.0.1 9766 ir 640 360 30 5 /dev/dri/renderD128" << endl;
 	cerr << argv[0] << " 127.0.0.1 9766 ir-rgb 640 360 30 5 /dev/dri/renderD128" << endl;
+	cerr << argv[0] << " 127.0.0.1 9766 depth 640 360 30 5 /dev/dri/renderD128" << endl;
 	return -1;
 }
@@ -16,6 +16,45 @@
 // Network Hardware Video Encoder
 #include "nhve.h"
 
+// depth processing kernels
+#include "depth_kernels.h"
+
+// live camera, recording or synthetic frames
+#include "frame_source.h"
+
+// capture thread with bounded frame ring
+#include "capture.h"
+
+// VAAPI or software encoding
+#include "encoder.h"
+
+// per stage latency statistics
+#include "stats.h"
+
+// sequential or concurrent encoding of streams
+#include "stream_workers.h"
+
+// shared dummy chroma planes
+#include "chroma_plane.h"
+
+// coarse + fine depth streams
+#include "depth_split.h"
+
+// non-linear depth quantization
+#include "depth_curve.h"
+
+// adaptive depth range
+#include "depth_range.h"
+
+// invalid depth inpainting
+#include "depth_inpaint.h"
+
+// spatial/temporal depth denoising
+#include "depth_denoise.h"
+
+// fan-out to multiple receivers
+#include "udp_relay.h"
+
 // Realsense API
 #include <librealsense2/rs.hpp>
 #include <librealsense2/rs_advanced_mode.hpp>
@@ -24,6 +63,9 @@
 #include <streambuf> //loading json config
 #include <iostream>
 #include <cassert>
+#include <vector>
+#include <memory>
+#include <thread>
 using namespace std;
 
 int hint_user_on_failure(char *argv[]);
@@ -39,51 +81,140 @@ struct input_args
 	int seconds;
 	float depth_units;
 	StreamType stream;
+	frame_source_config source;
+	capture_config capture;
+	encoder_config encoder;
+	stats_config stats;
+	udp_relay_config relay;
 	std::string json;
 	bool needs_postprocessing;
+	bool depth_split;
+	depth_curve curve;
+	depth_range_config range;
+	bool inpaint;
+	int inpaint_threads;
+	depth_denoise_config denoise;
+	std::vector<std::string> cameras; //serials with --cameras, empty for the default device
 };
 
-bool main_loop_color_infrared(const input_args& input, rs2::pipeline& realsense, nhve *streamer);
-bool main_loop_depth(const input_args& input, rs2::pipeline& realsense, nhve *streamer);
-void process_depth_data(const input_args &input, rs2::depth_frame &depth);
+//the only camera or one of multiple cameras
+struct camera
+{
+	input_args input; //with camera serial and stats label
+	nhve_net_config net_config; //port + camera index
+	std::unique_ptr<udp_relay> relay; //with --fanout
+	std::unique_ptr<frame_source> realsense;
+	encoder *streamer;
+	bool status;
+};
 
-void init_realsense(rs2::pipeline& pipe, input_args& input);
-void init_realsense_depth(rs2::pipeline& pipe, const rs2::config &cfg, input_args& input);
-void print_intrinsics(const rs2::pipeline_profile& profile, rs2_stream stream);
+bool main_loop(camera &c, thread_pool &inpaint_pool, thread_pool &denoise_pool);
+bool main_loop_color_infrared(const input_args& input, frame_source& realsense, encoder *streamer);
+bool main_loop_depth(const input_args& input, frame_source& realsense, encoder *streamer, thread_pool &inpaint_pool, thread_pool &denoise_pool);
+void close_cameras(vector<camera> &cameras);
+void process_depth_data(const input_args &input, rs2::depth_frame &depth, depth_lut *lut);
 
-int process_user_input(int argc, char* argv[], input_args* input, nhve_net_config *net_config, nhve_hw_config *hw_config);
+void init_realsense(frame_source& source, input_args& input);
+void init_realsense_depth(frame_source& source, input_args& input);
+void print_depth_curve(const input_args& input);
+void print_intrinsics(const frame_source& source, rs2_stream stream);
 
-const uint16_t P010LE_MAX = 0xFFC0; //in binary 10 ones followed by 6 zeroes
+int process_user_input(int argc, char* argv[], input_args* input, nhve_net_config *net_config, nhve_hw_config *hw_config);
 
 int main(int argc, char* argv[])
 {
 	//nhve_hw_config {WIDTH, HEIGHT, FRAMERATE, DEVICE, ENCODER, PIXEL_FORMAT, PROFILE, BFRAMES, BITRATE, QP, GOP_SIZE};
 	//prepare NHVE Network Hardware Video Encoder
 	struct nhve_net_config net_config = {0};
-	struct nhve_hw_config hw_config = {0};
-	struct nhve *streamer;
+	struct nhve_hw_config hw_configs[2] = { {0}, {0} };
 
 	struct input_args user_input = {0};
 	user_input.depth_units=0.0001f; //optionally override with user input
 
-	rs2::pipeline realsense;
-
-	if(process_user_input(argc, argv, &user_input, &net_config, &hw_config) < 0)
+	if(process_user_input(argc, argv, &user_input, &net_config, hw_configs) < 0)
 		return 1;
 
-	init_realsense(realsense, user_input);
+	//coarse and fine depth are encoded as two Main10 streams
+	const int hw_size = user_input.depth_split ? 2 : 1;
+	//depth curve parameters and validity mask are sent to receiver through auxiliary channels
+	const int aux_size = (user_input.curve.type != DEPTH_CURVE_NONE) + user_input.inpaint;
 
-	if( (streamer = nhve_init(&net_config, &hw_config, 1, 0)) == NULL )
-		return hint_user_on_failure(argv);
+	//the default device or each of --cameras with its own capture thread, encoder and port
+	const int count = max<int>(user_input.cameras.size(), 1);
+	vector<camera> cameras(count);
 
-	bool status = false;
+	for(int i = 0; i < count; ++i)
+	{
+		camera &c = cameras[i];
+		c.input = user_input;
+		c.net_config = net_config;
+		c.streamer = NULL;
+		c.status = false;
 
-	if(user_input.stream == DEPTH)
-		status = main_loop_depth(user_input, realsense, streamer);
-	else //color, infrared, infrared rgb
-		status = main_loop_color_infrared(user_input, realsense, streamer);
+		if(!user_input.cameras.empty())
+		{
+			const string &serial = user_input.cameras[i];
+
+			c.input.source.serial = serial;
+			c.input.stats = stats_config_labeled(user_input.stats, serial);
+			c.net_config.port = net_config.port + i;
+
+			//software encoders of all cameras share the cores instead of each taking all
+			if(!user_input.encoder.software.threads)
+				c.input.encoder.software.threads = max(1, (int)thread::hardware_concurrency() / count);
+
+			cout << "Camera " << serial << " streaming to port " << c.net_config.port << endl;
+		}
+
+		c.realsense.reset(new frame_source(c.input.source));
+
+		init_realsense(*c.realsense, c.input);
+
+		//fanout destinations ports are also offset by camera index
+		c.relay.reset(new udp_relay(c.input.relay));
+
+		if(c.relay->start(&c.net_config, i) < 0)
+		{
+			close_cameras(cameras);
+			return 1;
+		}
+
+		//with VAAPI each camera has its own encoder context on the same device
+		if( (c.streamer = encoder_init(&c.net_config, hw_configs, hw_size, aux_size, c.input.encoder)) == NULL )
+		{
+			close_cameras(cameras);
+			return hint_user_on_failure(argv);
+		}
+	}
+
+	//depth processing threads are shared by cameras (taking turns)
+	thread_pool inpaint_pool(user_input.inpaint ? user_input.inpaint_threads : 1);
+	thread_pool denoise_pool(user_input.denoise.strength ? user_input.denoise.threads : 1);
 
-	nhve_close(streamer);
+	if(count == 1)
+		main_loop(cameras[0], inpaint_pool, denoise_pool);
+	else
+	{
+		vector<thread> threads;
+
+		for(camera &c : cameras)
+			threads.push_back(thread(main_loop, ref(c), ref(inpaint_pool), ref(denoise_pool)));
+
+		for(thread &t : threads)
+			t.join();
+	}
+
+	bool status = true;
+
+	for(const camera &c : cameras)
+	{
+		if(!c.status && count > 1)
+			cerr << "Camera " << c.input.source.serial << " failed" << endl;
+
+		status = status && c.status;
+	}
+
+	close_cameras(cameras);
 
 	if(status)
 		cout << "Finished successfully." << endl;
@@ -92,152 +223,253 @@ int main(int argc, char* argv[])
 }
 
 //true on success, false on failure
-bool main_loop_color_infrared(const input_args& input, rs2::pipeline& realsense, nhve *streamer)
+bool main_loop(camera &c, thread_pool &inpaint_pool, thread_pool &denoise_pool)
+{
+	if(c.input.stream == DEPTH)
+		c.status = main_loop_depth(c.input, *c.realsense, c.streamer, inpaint_pool, denoise_pool);
+	else //color, infrared, infrared rgb
+		c.status = main_loop_color_infrared(c.input, *c.realsense, c.streamer);
+
+	return c.status;
+}
+
+void close_cameras(vector<camera> &cameras)
+{
+	for(camera &c : cameras)
+	{
+		encoder_close(c.streamer);
+		c.streamer = NULL;
+		c.relay.reset(); //after encoder flushed the last packets
+		c.realsense.reset();
+	}
+}
+
+//true on success, false on failure
+bool main_loop_color_infrared(const input_args& input, frame_source& realsense, encoder *streamer)
 {
 	const int frames = input.seconds * input.framerate;
 	int f;
 	nhve_frame frame = {0};
-	uint8_t *color_data = NULL; //data of dummy color plane for NV12 with Realsense infrared
+
+	frame_capture capture(realsense, input.capture);
+	captured_frameset captured;
+	pipeline_stats stats(input.stats, {input.stream == COLOR ? "color" : "infrared"});
+	stream_workers workers(streamer, 1, false, &stats);
 
 	for(f = 0; f < frames; ++f)
 	{
-		rs2::frameset frameset = realsense.wait_for_frames();
+		if(!capture.wait_for_frames(&captured))
+			break;
 
-		rs2::video_frame video_frame = (input.stream == COLOR) ? frameset.get_color_frame() : frameset.get_infrared_frame(0);
+		rs2::frameset frameset = captured.frameset;
 
-		if(input.stream == INFRARED && !color_data)
-		{  //prepare dummy color plane for NV12 format, half the size of Y
-		   //we can't alloc it in advance, this is the first time we know realsense stride
-			int size = video_frame.get_stride_in_bytes()*video_frame.get_height()/2;
-			color_data = new uint8_t[size];
-			memset(color_data, 128, size);
-		}
+		rs2::video_frame video_frame = (input.stream == COLOR) ? frameset.get_color_frame() : frameset.get_infrared_frame(0);
 
 		frame.linesize[0] =  video_frame.get_stride_in_bytes();
 		frame.data[0] = (uint8_t*) video_frame.get_data();
 
 		//if we are streaming infrared we have 2 planes (luminance and dummy color)
+		//the shared dummy color plane for NV12 follows realsense stride (known only from frame)
 		frame.linesize[1] = (input.stream == INFRARED) ? frame.linesize[0] : 0;
-		frame.data[1] = color_data; //dummy color plane for infrared
+		frame.data[1] = (input.stream == INFRARED) ? chroma_plane_nv12(frame.linesize[0], video_frame.get_height()) : NULL;
 
-		if(nhve_send(streamer, &frame, 0) != NHVE_OK)
+		if(workers.send(&frame) != NHVE_OK)
 		{
 			cerr << "failed to send" << endl;
 			break;
 		}
+
+		stats.add_frameset(captured, capture.dropped());
 	}
 
 	//flush the streamer by sending NULL frame
-	nhve_send(streamer, NULL, 0);
+	workers.send(NULL);
 
-	delete [] color_data;
+	stats.finish(capture.dropped());
 
 	//all the requested frames processed?
 	return f==frames;
 }
 
 //true on success, false on failure
-bool main_loop_depth(const input_args& input, rs2::pipeline& realsense, nhve *streamer)
+bool main_loop_depth(const input_args& input, frame_source& realsense, encoder *streamer, thread_pool &inpaint_pool, thread_pool &denoise_pool)
 {
 	const int frames = input.seconds * input.framerate;
 	int f;
-	nhve_frame frame = {0};
-	uint16_t *color_data = NULL; //data of dummy color plane for P010LE
+	nhve_frame frame[2] = { {0}, {0} };
+
+	frame_capture capture(realsense, input.capture);
+	captured_frameset captured;
+	pipeline_stats stats(input.stats, input.depth_split ? vector<string>{"depth", "depth-fine"} : vector<string>{"depth"});
+	stream_workers workers(streamer, input.depth_split ? 2 : 1, false, &stats);
+	depth_lut lut; //depth units conversion table (if device doesn't support depth units)
+	vector<uint16_t> coarse, fine; //with depth split, P010LE Y planes
+	depth_lut curve_lut; //device units to depth curve table (if depth curve is used)
+	depth_curve curve = input.curve; //with adaptive range near/far follow the scene
+	depth_range range(input.range, curve.near, curve.far);
+
+	//with each frameset, changes only with adaptive range
+	uint8_t curve_message[DEPTH_CURVE_MESSAGE_SIZE];
+	nhve_frame curve_frame = { {curve_message}, {DEPTH_CURVE_MESSAGE_SIZE} };
+	depth_curve_to_message(curve, curve_message);
+
+	depth_inpainter inpainter(inpaint_pool);
+	nhve_frame mask_frame = {0};
+
+	depth_denoiser denoiser(input.denoise.strength, denoise_pool);
 
 	for(f = 0; f < frames; ++f)
 	{
-		rs2::frameset frameset = realsense.wait_for_frames();
+		if(!capture.wait_for_frames(&captured))
+			break;
+
+		rs2::frameset frameset = captured.frameset;
 		rs2::depth_frame depth = frameset.get_depth_frame();
 
 		const int w = depth.get_width();
 		const int h = depth.get_height();
-		const int stride=depth.get_stride_in_bytes();
+		int stride=depth.get_stride_in_bytes();
+		uint16_t *data = (uint16_t*)depth.get_data(); //realsense frame or denoised copy
 
 		//L515 doesn't support setting depth units and clamping
-		if(input.needs_postprocessing)
-			process_depth_data(input, depth);
-
-		if(!color_data)
-		{  //prepare dummy color plane for P010LE format, half the size of Y
-			//we can't alloc it in advance, this is the first time we know realsense stride
-			//the stride will be at least width * 2 (Realsense Z16, VAAPI P010LE)
-			color_data = new uint16_t[stride/2*h/2];
-			for(int i=0;i<w*h/2;++i)
-				color_data[i] = UINT16_MAX / 2; //dummy middle value for U/V, equals 128 << 8, equals 32768
+		//depth curve table works with device units (also for L515) and replaces rescaling
+		if(input.needs_postprocessing && input.curve.type == DEPTH_CURVE_NONE)
+		{
+			process_depth_data(input, depth, &lut);
+			captured.processed = chrono::steady_clock::now();
+		}
+
+		//linear depth (before curve), the denoiser keeps its own copy for temporal filtering
+		if(input.denoise.strength)
+		{
+			data = denoiser.process(data, w, h, stride);
+			stride = w * 2;
+			captured.processed = chrono::steady_clock::now();
+		}
+
+		if(input.curve.type != DEPTH_CURVE_NONE)
+		{
+			if(range.update(data, w, h, stride, depth.get_units()))
+			{
+				const float knee = (curve.knee - curve.near) / (curve.far - curve.near);
+				curve.near = range.near();
+				curve.far = range.far();
+				curve.knee = curve.near + knee * (curve.far - curve.near);
+				depth_curve_to_message(curve, curve_message);
+				curve_lut.table.clear(); //rebuild for the new range
+			}
+
+			depth_curve_lut_update(&curve_lut, curve, depth.get_units());
+			depth_lut_apply(curve_lut, data, w, h, stride);
+			captured.processed = chrono::steady_clock::now();
+		}
+
+		//after post-processing, which also zeroes depth out of range
+		if(input.inpaint)
+		{
+			const vector<uint8_t> &mask = inpainter.process(data, w, h, stride);
+			mask_frame.data[0] = (uint8_t*)mask.data();
+			mask_frame.linesize[0] = mask.size();
+			captured.processed = chrono::steady_clock::now();
 		}
 
 		//supply realsense frame data as ffmpeg frame data
-		frame.linesize[0] = frame.linesize[1] =  stride; //the stride of Y and interleaved UV is equal
-		frame.data[0] = (uint8_t*) depth.get_data();
-		frame.data[1] = (uint8_t*) color_data;
+		//the stride will be at least width * 2 (Realsense Z16, VAAPI P010LE)
+		frame[0].linesize[0] = frame[0].linesize[1] =  stride; //the stride of Y and interleaved UV is equal
+		frame[0].data[0] = (uint8_t*) data;
+		frame[0].data[1] = chroma_plane_p010le(stride, h); //shared dummy U/V plane
 
-		if(nhve_send(streamer, &frame, 0) != NHVE_OK)
+		if(input.depth_split)
+		{
+			coarse.resize(w * h);
+			fine.resize(w * h);
+			depth_split(data, stride, w, h, &coarse[0], w * 2, &fine[0], w * 2);
+			captured.processed = chrono::steady_clock::now();
+
+			frame[0].linesize[0] = frame[0].linesize[1] = frame[1].linesize[0] = frame[1].linesize[1] = w * 2;
+			frame[0].data[0] = (uint8_t*) &coarse[0];
+			frame[1].data[0] = (uint8_t*) &fine[0];
+			frame[0].data[1] = frame[1].data[1] = chroma_plane_p010le(w * 2, h);
+		}
+
+		if(workers.send(frame) != NHVE_OK)
 		{
 			cerr << "failed to send" << endl;
 			break;
 		}
+
+		//the curve and mask subframes follow encoded subframes
+		int aux = streamer->hw_size;
+
+		if(input.curve.type != DEPTH_CURVE_NONE && encoder_send(streamer, &curve_frame, aux++) != NHVE_OK)
+		{
+			cerr << "failed to send depth curve" << endl;
+			break;
+		}
+
+		if(input.inpaint && encoder_send(streamer, &mask_frame, aux++) != NHVE_OK)
+		{
+			cerr << "failed to send depth mask" << endl;
+			break;
+		}
+
+		stats.add_frameset(captured, capture.dropped());
 	}
 
 	//flush the streamer by sending NULL frame
-	nhve_send(streamer, NULL, 0);
+	workers.send(NULL);
 
-	delete [] color_data;
+	stats.finish(capture.dropped());
 
 	//all the requested frames processed?
 	return f==frames;
 }
 
-void process_depth_data(const input_args &input, rs2::depth_frame &depth)
+void process_depth_data(const input_args &input, rs2::depth_frame &depth, depth_lut *lut)
 {
-	const int half_stride = depth.get_stride_in_bytes()/2;
-	const int height = depth.get_height();
-
 	const float depth_units_set = depth.get_units();
 	const float multiplier = depth_units_set / input.depth_units;
 
 	//note - we process data in place rather than making a copy
 	uint16_t* data = (uint16_t*)depth.get_data();
 
-	for(int i = 0;i < half_stride * height; ++i)
-	{
-		uint32_t val = data[i] * multiplier;
-		data[i] = val <= P010LE_MAX ? val : 0;
-	}
+	//lookup table or vectorized arithmetic (whichever is faster on this CPU)
+	//the table is rebuilt only if device reports different depth units
+	depth_rescale(lut, data, depth.get_width(), depth.get_height(), depth.get_stride_in_bytes(), multiplier);
 }
 
-void init_realsense(rs2::pipeline& pipe, input_args& input)
+void init_realsense(frame_source& source, input_args& input)
 {
-	rs2::config cfg;
 
 	if(input.stream == COLOR)
-		cfg.enable_stream(RS2_STREAM_COLOR, input.width, input.height, RS2_FORMAT_YUYV, input.framerate);
+		source.enable_stream(RS2_STREAM_COLOR, input.width, input.height, RS2_FORMAT_YUYV, input.framerate);
 	else if(input.stream == INFRARED)
-		cfg.enable_stream(RS2_STREAM_INFRARED, input.width, input.height, RS2_FORMAT_Y8, input.framerate);
+		source.enable_stream(RS2_STREAM_INFRARED, input.width, input.height, RS2_FORMAT_Y8, input.framerate);
 	else if(input.stream == INFRARED_RGB)
-		cfg.enable_stream(RS2_STREAM_INFRARED, input.width, input.height, RS2_FORMAT_UYVY, input.framerate);
+		source.enable_stream(RS2_STREAM_INFRARED, input.width, input.height, RS2_FORMAT_UYVY, input.framerate);
 	else if(input.stream == DEPTH)
-		cfg.enable_stream(RS2_STREAM_DEPTH, input.width, input.height, RS2_FORMAT_Z16, input.framerate);
+		source.enable_stream(RS2_STREAM_DEPTH, input.width, input.height, RS2_FORMAT_Z16, input.framerate);
 
-	rs2::pipeline_profile profile = pipe.start(cfg);
+	source.start();
 
 	if(input.stream != DEPTH)
 		return;
 
-	init_realsense_depth(pipe, cfg, input);
+	init_realsense_depth(source, input);
 	
-	print_intrinsics(profile, RS2_STREAM_DEPTH);
+	print_intrinsics(source, RS2_STREAM_DEPTH);
 }
 
-void init_realsense_depth(rs2::pipeline& pipe, const rs2::config &cfg, input_args& input)
+void init_realsense_depth(frame_source& source, input_args& input)
 {
-	rs2::pipeline_profile profile = pipe.get_active_profile();
+	rs2::device device = source.get_device();
 
-	rs2::depth_sensor depth_sensor = profile.get_device().first<rs2::depth_sensor>();
+	rs2::depth_sensor depth_sensor = device.first<rs2::depth_sensor>();
 
 	if(!input.json.empty())
 	{
 		cout << "loading settings from json:" << endl << input.json  << endl;
-		auto serializable  = profile.get_device().as<rs2::serializable_device>();
+		auto serializable  = device.as<rs2::serializable_device>();
 		serializable.load_json(input.json);
 	}
 
@@ -271,19 +503,28 @@ void init_realsense_depth(rs2::pipeline& pipe, const rs2::config &cfg, input_arg
 	cout << (supports_depth_units ? "Setting" : "Simulating") <<
 		" realsense depth units: " << depth_unit_set << endl;
 	cout << "This will result in:" << endl;
-	cout << "-range " << input.depth_units * P010LE_MAX << " m" << endl;
-	cout << "-precision " << input.depth_units*64.0f << " m (" << input.depth_units*64.0f*1000 << " mm)" << endl;
+	if(input.curve.type != DEPTH_CURVE_NONE)
+		print_depth_curve(input);
+	else
+		cout << "-range " << input.depth_units * P010LE_MAX << " m" << endl;
+
+	//with depth split the fine stream restores 6 bits lost in P010LE (1 depth unit, coarse stream alone 64)
+	const float precision = input.depth_units * (input.depth_split ? 1.0f : 64.0f);
 
-	bool supports_advanced_mode = depth_sensor.supports(RS2_CAMERA_INFO_ADVANCED_MODE);
+	if(input.curve.type == DEPTH_CURVE_NONE)
+		cout << "-precision " << precision << " m (" << precision*1000 << " mm)" << endl;
+
+	//recordings and synthetic frames may only be post-processed
+	bool supports_advanced_mode = depth_sensor.supports(RS2_CAMERA_INFO_ADVANCED_MODE) && source.is_live();
 
 	if(supports_advanced_mode)
 	{
-		 rs400::advanced_mode advanced = profile.get_device();
-		 pipe.stop(); //workaround the problem with setting advanced_mode on running stream
+		 rs400::advanced_mode advanced = device;
+		 source.stop(); //workaround the problem with setting advanced_mode on running stream
 		 STDepthTableControl depth_table = advanced.get_depth_table();
 		 depth_table.depthClampMax = P010LE_MAX;
 		 advanced.set_depth_table(depth_table);
-		 profile = pipe.start(cfg);
+		 source.start();
 	}
 	else
 	{
@@ -294,9 +535,26 @@ void init_realsense_depth(rs2::pipeline& pipe, const rs2::config &cfg, input_arg
 	" range at " << input.depth_units * P010LE_MAX << " m" << endl;
 }
 
-void print_intrinsics(const rs2::pipeline_profile& profile, rs2_stream stream)
+void print_depth_curve(const input_args& input)
 {
-	rs2::video_stream_profile stream_profile = profile.get_stream(stream).as<rs2::video_stream_profile>();
+	const depth_curve &c = input.curve;
+
+	cout << "-" << depth_curve_name(c.type) << " depth curve, range " << c.near << "-" << c.far << " m" << endl;
+	cout << "-precision " << depth_curve_step(c, c.near)*1000 << " mm at " << c.near << " m";
+	if(c.type == DEPTH_CURVE_PIECEWISE)
+		cout << ", " << depth_curve_step(c, c.knee)*1000 << " mm above " << c.knee << " m";
+	cout << ", " << depth_curve_step(c, c.far)*1000 << " mm at " << c.far << " m" << endl;
+
+	//the curve can't be finer than device depth units
+	if(depth_curve_step(c, c.near) < input.depth_units)
+		cerr << "WARNING - curve precision at near is finer than depth units " << input.depth_units << endl;
+	if(c.far > input.depth_units * P010LE_MAX)
+		cerr << "WARNING - curve far is beyond depth range " << input.depth_units * P010LE_MAX << " m" << endl;
+}
+
+void print_intrinsics(const frame_source& source, rs2_stream stream)
+{
+	rs2::video_stream_profile stream_profile = source.get_stream(stream).as<rs2::video_stream_profile>();
 	rs2_intrinsics i = stream_profile.get_intrinsics();
 
 	const float rad2deg = 180.0f / M_PI;
@@ -312,6 +570,9 @@ void print_intrinsics(const rs2::pipeline_profile& profile, rs2_stream stream)
 
 int process_user_input(int argc, char* argv[], input_args* input, nhve_net_config *net_config, nhve_hw_config *hw_config)
 {
+	options opts;
+	argc = options_parse(argc, argv, &opts);
+
 	if(argc < 8)
 	{
 		cerr << "Usage: " << argv[0] << " <host> <port> <color/ir/ir-rgb/depth> <width> <height> <framerate> <seconds> [device] [bitrate] [depth units] [json]" << endl;
@@ -332,6 +593,37 @@ int process_user_input(int argc, char* argv[], input_args* input, nhve_net_confi
 		cerr << argv[0] << " 192.168.0.100 9768 depth 848 480 30 500 /dev/dri/renderD128 2000000 0.0000125" << endl;
 		cerr << argv[0] << " 192.168.0.100 9768 depth 640 480 30 500 /dev/dri/renderD128 8000000 0.0000390625 my_config.json" << endl;
 
+		cerr << endl << "options:" << endl;
+		cerr << "--source=S           live, synthetic or recording.bag (default live)" << endl;
+		cerr << "--realtime=0/1       play recording/synthetic frames in real time (default 1)" << endl;
+		cerr << "--ring=drop/block    capture ring policy when encoding is too slow (default drop, block with --realtime=0)" << endl;
+		cerr << "--ring-size=N        capture ring size, 0 to capture on encoding thread (default 2)" << endl;
+		cerr << "--encoder=E          auto, vaapi, software or null (default auto, software if VAAPI fails)" << endl;
+		cerr << "--encoder-threads=N  software encoder threads (default 0, all cores)" << endl;
+		cerr << "--encoder-preset=P   software encoder x264/x265 preset (default superfast/ultrafast)" << endl;
+		cerr << "--stats=N            print latency statistics every N seconds (default 0, only at exit)" << endl;
+		cerr << "--stats-csv=FILE     write every statistics report to csv file" << endl;
+		cerr << "--stats-json=FILE    write statistics summary to json file at exit" << endl;
+		cerr << "--fanout=H:P,...     also send to these hosts/multicast groups (e.g. 239.0.0.1:9766)" << endl;
+		cerr << "--multicast-ttl=N    multicast time to live (default 1, local network)" << endl;
+		cerr << "--udp-batch=B        frame (and relay) send batching off, mmsg or gso (default gso)" << endl;
+		cerr << "--pacing=F           send each frame over fraction F of frame interval (default 0, burst)" << endl;
+		cerr << "--fec=K              XOR parity per K datagrams 2-64, needs rnhve-fec-receiver (default 0, disabled)" << endl;
+		cerr << "--fec-interleave=D   interleaved FEC groups for burst loss 1-16 (default 1)" << endl;
+		cerr << "--depth-split        depth as coarse and fine Main10 streams (16 bit precision)" << endl;
+		cerr << "--depth-curve=C      depth quantization none, linear, inverse, log or piecewise (default none)" << endl;
+		cerr << "--curve-near=M       depth curve range start in meters (default 0.2)" << endl;
+		cerr << "--curve-far=M        depth curve range end in meters (default 6.5)" << endl;
+		cerr << "--curve-knee=M       piecewise curve, half of the codes below (default 1.0)" << endl;
+		cerr << "--adaptive-range=N   depth curve near/far from histogram every N frames (default 0, disabled)" << endl;
+		cerr << "--range-low=F        adaptive range, fraction of depth allowed below near (default 0.01)" << endl;
+		cerr << "--range-high=F       adaptive range, fraction of depth allowed above far (default 0.01)" << endl;
+		cerr << "--inpaint            fill invalid depth before encoding, send validity mask" << endl;
+		cerr << "--inpaint-threads=N  inpainting threads (default 0, all cores)" << endl;
+		cerr << "--denoise=N          spatial/temporal depth denoising strength 1-3 (default 0, disabled)" << endl;
+		cerr << "--denoise-threads=N  denoising threads (default 0, all cores)" << endl;
+		cerr << "--cameras=S          all or serials S1,S2,... streamed to port, port+1, ... (default one camera)" << endl;
+
 		return -1;
 	}
 
@@ -408,6 +700,51 @@ int process_user_input(int argc, char* argv[], input_args* input, nhve_net_confi
 	//with 848x480 HEVC Main10 encoding
 	hw_config->compression_level = 1;
 
+	//fine depth stream (with --depth-split) is the second subframe with the same configuration
+	input->depth_split = options_has(opts, "depth-split");
+
+	if(input->depth_split && input->stream != DEPTH)
+	{
+		cerr << "--depth-split works only with depth stream" << endl;
+		return -1;
+	}
+
+	hw_config[1] = hw_config[0];
+
+	if(depth_curve_parse(opts, &input->curve) < 0)
+		return -1;
+
+	if(depth_range_config_parse(opts, &input->range) < 0)
+		return -1;
+
+	input->inpaint = options_has(opts, "inpaint");
+	input->inpaint_threads = options_get_int(opts, "inpaint-threads", 0);
+
+	if(input->inpaint && input->stream != DEPTH)
+	{
+		cerr << "--inpaint works only with depth stream" << endl;
+		return -1;
+	}
+
+	if(depth_denoise_config_parse(opts, &input->denoise) < 0)
+		return -1;
+
+	if(input->denoise.strength && input->stream != DEPTH)
+	{
+		cerr << "--denoise works only with depth stream" << endl;
+		return -1;
+	}
+
+	//adaptive range remaps depth through curve, linear unless specified
+	if(input->range.interval > 0 && input->curve.type == DEPTH_CURVE_NONE)
+		input->curve.type = DEPTH_CURVE_LINEAR;
+
+	if(input->curve.type != DEPTH_CURVE_NONE && (input->stream != DEPTH || input->depth_split))
+	{
+		cerr << "--depth-curve and --adaptive-range work only with depth stream (without --depth-split)" << endl;
+		return -1;
+	}
+
 	if(argc > 10)
 		input->depth_units = strtof(argv[10], NULL);
 
@@ -425,6 +762,24 @@ int process_user_input(int argc, char* argv[], input_args* input, nhve_net_confi
 
 	input->needs_postprocessing = false;
 
+	if(frame_source_config_parse(opts, &input->source) < 0)
+		return -1;
+
+	if(frame_source_cameras_parse(opts, input->source, &input->cameras) < 0)
+		return -1;
+
+	if(capture_config_parse(opts, &input->capture) < 0)
+		return -1;
+
+	if(encoder_config_parse(opts, &input->encoder) < 0)
+		return -1;
+
+	if(stats_config_parse(opts, &input->stats) < 0)
+		return -1;
+
+	if(udp_relay_config_parse(opts, input->framerate, &input->relay) < 0)
+		return -1;
+
 	return 0;
 }
 
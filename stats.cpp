@@ -0,0 +1,390 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Per stage latency and throughput statistics
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include "stats.h"
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+
+using namespace std;
+using namespace std::chrono;
+
+static const char *STAGE_NAMES[STAGE_COUNT] = {"sensor", "queue", "process", "align", "roi", "sent", "sensor-sent"};
+static const double PERCENTILES[] = {50, 90, 99};
+
+int stats_config_parse(const options &opts, stats_config *config)
+{
+	config->interval = options_get_int(opts, "stats", 0);
+	config->csv = options_get(opts, "stats-csv", "");
+	config->json = options_get(opts, "stats-json", "");
+	config->label.clear();
+
+	if(config->interval < 0)
+	{
+		cerr << "stats interval has to be non-negative (0 for report only at exit)" << endl;
+		return -1;
+	}
+
+	return 0;
+}
+
+static string labeled_file(const string &file, const string &label)
+{
+	if(file.empty())
+		return file;
+
+	const size_t dot = file.rfind('.');
+	const size_t slash = file.rfind('/');
+
+	//no extension (or dot only in directory name)
+	if(dot == string::npos || (slash != string::npos && dot < slash))
+		return file + "-" + label;
+
+	return file.substr(0, dot) + "-" + label + file.substr(dot);
+}
+
+stats_config stats_config_labeled(const stats_config &config, const string &label)
+{
+	stats_config labeled = config;
+
+	labeled.label = label;
+	labeled.csv = labeled_file(config.csv, label);
+	labeled.json = labeled_file(config.json, label);
+
+	return labeled;
+}
+
+histogram::histogram()
+{
+	reset();
+}
+
+//values below SUB_BUCKETS have their own buckets, above that
+//each power of 2 range is split into SUB_BUCKETS equal buckets
+static int bucket_index(uint64_t value, int sub_buckets, int buckets)
+{
+	if(value < (uint64_t)sub_buckets)
+		return value;
+
+	const int msb = 63 - __builtin_clzll(value);
+	const int shift = msb - 4; //sub_buckets is 16 (2^4)
+	const int index = sub_buckets + shift * sub_buckets + (int)((value >> shift) - sub_buckets);
+
+	return index < buckets ? index : buckets - 1;
+}
+
+static uint64_t bucket_upper_bound(int index, int sub_buckets)
+{
+	if(index < sub_buckets)
+		return index;
+
+	const int shift = (index - sub_buckets) / sub_buckets;
+	const int sub = (index - sub_buckets) % sub_buckets;
+
+	return ((uint64_t)(sub_buckets + sub + 1) << shift) - 1;
+}
+
+void histogram::add(uint64_t value)
+{
+	buckets[bucket_index(value, SUB_BUCKETS, BUCKETS)].fetch_add(1, memory_order_relaxed);
+	total.fetch_add(1, memory_order_relaxed);
+	total_sum.fetch_add(value, memory_order_relaxed);
+
+	uint64_t current = maximum.load(memory_order_relaxed);
+	while(value > current && !maximum.compare_exchange_weak(current, value, memory_order_relaxed))
+		;
+}
+
+void histogram::reset()
+{
+	for(int i = 0; i < BUCKETS; ++i)
+		buckets[i].store(0, memory_order_relaxed);
+
+	total.store(0, memory_order_relaxed);
+	total_sum.store(0, memory_order_relaxed);
+	maximum.store(0, memory_order_relaxed);
+}
+
+uint64_t histogram::count() const
+{
+	return total.load(memory_order_relaxed);
+}
+
+uint64_t histogram::sum() const
+{
+	return total_sum.load(memory_order_relaxed);
+}
+
+uint64_t histogram::max() const
+{
+	return maximum.load(memory_order_relaxed);
+}
+
+uint64_t histogram::percentile(double p) const
+{
+	const uint64_t n = count();
+
+	if(!n)
+		return 0;
+
+	//rank of the percentile value, 1 based
+	uint64_t rank = (uint64_t)(p / 100.0 * n + 0.5);
+	rank = rank < 1 ? 1 : (rank > n ? n : rank);
+
+	uint64_t seen = 0;
+
+	for(int i = 0; i < BUCKETS; ++i)
+		if( (seen += buckets[i].load(memory_order_relaxed)) >= rank )
+		{
+			const uint64_t upper = bucket_upper_bound(i, SUB_BUCKETS);
+			return upper < max() ? upper : max();
+		}
+
+	return max();
+}
+
+void stats_histograms::add(uint64_t value)
+{
+	window.add(value);
+	total.add(value);
+}
+
+pipeline_stats::pipeline_stats(const stats_config &config, const vector<string> &names) :
+	config(config), streams(new stream_stats[names.size()]), stream_count(names.size()),
+	start(steady_clock::now()), window_start(start), frames(0), window_frames(0), window_dropped(0)
+{
+	for(int i = 0; i < stream_count; ++i)
+		streams[i].name = names[i];
+
+	if(config.csv.empty())
+		return;
+
+	csv.open(config.csv);
+
+	if(!csv)
+		cerr << "unable to open stats csv file " << config.csv << endl;
+	else
+		csv << "elapsed_s,window_s,frames,fps,dropped,stage,count,p50,p90,p99,max,unit" << endl;
+}
+
+void pipeline_stats::add_encode(int stream, steady_clock::duration duration, int bytes)
+{
+	streams[stream].encode_us.add(duration_cast<microseconds>(duration).count());
+
+	if(bytes >= 0)
+		streams[stream].bytes.add(bytes);
+}
+
+static uint64_t elapsed_us(steady_clock::time_point from, steady_clock::time_point to)
+{
+	return to > from ? duration_cast<microseconds>(to - from).count() : 0;
+}
+
+//the stage lasts from the latest earlier time point (points not set are zero)
+static steady_clock::time_point stage_start(const captured_frameset &c, steady_clock::time_point end)
+{
+	steady_clock::time_point start = c.dequeued;
+
+	if(c.processed > start && c.processed < end)
+		start = c.processed;
+	if(c.aligned > start && c.aligned < end)
+		start = c.aligned;
+	if(c.roi > start && c.roi < end)
+		start = c.roi;
+
+	return start;
+}
+
+void pipeline_stats::add_frameset(const captured_frameset &c, uint64_t dropped)
+{
+	const steady_clock::time_point sent = steady_clock::now();
+	const steady_clock::time_point unset;
+
+	stages_us[STAGE_QUEUE].add(elapsed_us(c.captured, c.dequeued));
+
+	if(c.processed != unset)
+		stages_us[STAGE_PROCESS].add(elapsed_us(stage_start(c, c.processed), c.processed));
+	if(c.aligned != unset)
+		stages_us[STAGE_ALIGN].add(elapsed_us(stage_start(c, c.aligned), c.aligned));
+	if(c.roi != unset)
+		stages_us[STAGE_ROI].add(elapsed_us(stage_start(c, c.roi), c.roi));
+
+	stages_us[STAGE_SENT].add(elapsed_us(c.captured, sent));
+
+	//global time and system time domains are synchronized with host clock
+	if(c.frameset.get_frame_timestamp_domain() != RS2_TIMESTAMP_DOMAIN_HARDWARE_CLOCK)
+	{
+		const double now_ms = duration<double, milli>(system_clock::now().time_since_epoch()).count();
+		const double sent_us = (now_ms - c.frameset.get_timestamp()) * 1000.0;
+		const double sensor_us = sent_us - elapsed_us(c.captured, sent);
+
+		stages_us[STAGE_SENSOR].add(sensor_us > 0 ? sensor_us : 0);
+		stages_us[STAGE_SENSOR_SENT].add(sent_us > 0 ? sent_us : 0);
+	}
+
+	++frames;
+	++window_frames;
+
+	if(config.interval && sent - window_start >= seconds(config.interval))
+	{
+		report(false, dropped);
+
+		for(int i = 0; i < STAGE_COUNT; ++i)
+			stages_us[i].window.reset();
+
+		for(int i = 0; i < stream_count; ++i)
+		{
+			streams[i].encode_us.window.reset();
+			streams[i].bytes.window.reset();
+		}
+
+		window_start = sent;
+		window_frames = 0;
+		window_dropped = dropped;
+	}
+}
+
+void pipeline_stats::finish(uint64_t dropped)
+{
+	if(!frames)
+		return;
+
+	report(true, dropped);
+
+	if(!config.json.empty())
+		write_json(dropped);
+}
+
+static void print_histogram(ostream &out, const string &name, const histogram &h, double scale, const char *unit)
+{
+	if(!h.count())
+		return;
+
+	out << "-" << left << setw(16) << name << right << fixed << setprecision(2);
+
+	for(double p : PERCENTILES)
+		out << " p" << (int)p << " " << setw(8) << h.percentile(p) * scale;
+
+	out << " max " << setw(8) << h.max() * scale << " " << unit << endl;
+}
+
+static void csv_histogram(ostream &csv, const string &prefix, const string &name, const histogram &h, double scale, const char *unit)
+{
+	if(!h.count())
+		return;
+
+	csv << prefix << name << "," << h.count();
+
+	for(double p : PERCENTILES)
+		csv << "," << h.percentile(p) * scale;
+
+	csv << "," << h.max() * scale << "," << unit << endl;
+}
+
+void pipeline_stats::report(bool total, uint64_t dropped)
+{
+	const steady_clock::time_point now = steady_clock::now();
+	const double elapsed_s = duration<double>(now - start).count();
+	const double window_s = total ? elapsed_s : duration<double>(now - window_start).count();
+	const uint64_t n = total ? frames : window_frames;
+	const uint64_t lost = total ? dropped : dropped - window_dropped;
+	const double fps = window_s > 0 ? n / window_s : 0;
+
+	//the whole report at once, with multiple cameras reports come from multiple threads
+	ostringstream out;
+
+	out << (config.label.empty() ? "" : config.label + " ") <<
+		(total ? "Stats (whole run, " : "Stats (last ") << fixed << setprecision(1) << window_s << " s): " <<
+		n << " framesets, " << fps << " fps, dropped " << lost << endl;
+
+	for(int i = 0; i < STAGE_COUNT; ++i)
+		print_histogram(out, STAGE_NAMES[i], total ? stages_us[i].total : stages_us[i].window, 0.001, "ms");
+
+	for(int i = 0; i < stream_count; ++i)
+	{
+		const stream_stats &s = streams[i];
+		print_histogram(out, "encode " + s.name, total ? s.encode_us.total : s.encode_us.window, 0.001, "ms");
+		print_histogram(out, "bytes " + s.name, total ? s.bytes.total : s.bytes.window, 1.0, "B");
+	}
+
+	cout << out.str() << flush;
+
+	if(!csv)
+		return;
+
+	ostringstream prefix;
+	prefix << fixed << setprecision(3) << elapsed_s << "," << window_s << "," << n << "," << fps << "," << lost << ",";
+
+	csv << fixed << setprecision(3);
+
+	for(int i = 0; i < STAGE_COUNT; ++i)
+		csv_histogram(csv, prefix.str(), STAGE_NAMES[i], total ? stages_us[i].total : stages_us[i].window, 0.001, "ms");
+
+	for(int i = 0; i < stream_count; ++i)
+	{
+		const stream_stats &s = streams[i];
+		csv_histogram(csv, prefix.str(), "encode-" + s.name, total ? s.encode_us.total : s.encode_us.window, 0.001, "ms");
+		csv_histogram(csv, prefix.str(), "bytes-" + s.name, total ? s.bytes.total : s.bytes.window, 1.0, "B");
+	}
+}
+
+static void json_histogram(ostream &json, const string &name, const histogram &h, double scale, bool last)
+{
+	json << "    \"" << name << "\": {\"count\": " << h.count();
+
+	for(double p : PERCENTILES)
+		json << ", \"p" << (int)p << "\": " << h.percentile(p) * scale;
+
+	json << ", \"max\": " << h.max() * scale << "}" << (last ? "" : ",") << endl;
+}
+
+void pipeline_stats::write_json(uint64_t dropped)
+{
+	ofstream json(config.json);
+
+	if(!json)
+	{
+		cerr << "unable to open stats json file " << config.json << endl;
+		return;
+	}
+
+	const double elapsed_s = duration<double>(steady_clock::now() - start).count();
+
+	json << fixed << setprecision(3);
+	json << "{" << endl;
+	if(!config.label.empty())
+		json << "  \"label\": \"" << config.label << "\"," << endl;
+	json << "  \"seconds\": " << elapsed_s << "," << endl;
+	json << "  \"framesets\": " << frames << "," << endl;
+	json << "  \"fps\": " << (elapsed_s > 0 ? frames / elapsed_s : 0) << "," << endl;
+	json << "  \"dropped\": " << dropped << "," << endl;
+	json << "  \"stages_ms\": {" << endl;
+
+	for(int i = 0; i < STAGE_COUNT; ++i)
+		json_histogram(json, STAGE_NAMES[i], stages_us[i].total, 0.001, i == STAGE_COUNT - 1);
+
+	json << "  }," << endl;
+	json << "  \"streams\": {" << endl;
+
+	for(int i = 0; i < stream_count; ++i)
+	{
+		json << "   \"" << streams[i].name << "\": {" << endl;
+		json_histogram(json, "encode_ms", streams[i].encode_us.total, 0.001, false);
+		json_histogram(json, "bytes", streams[i].bytes.total, 1.0, true);
+		json << "   }" << (i == stream_count - 1 ? "" : ",") << endl;
+	}
+
+	json << "  }" << endl;
+	json << "}" << endl;
+}
@@ -0,0 +1,129 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Per stage latency and throughput statistics
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include "capture.h"
+#include "options.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct stats_config
+{
+	int interval; //seconds between reports, 0 reports only at exit
+	std::string csv; //file for every report (empty for none)
+	std::string json; //file for summary at exit (empty for none)
+	std::string label; //report prefix (e.g. camera serial), empty for none
+};
+
+//--stats=N --stats-csv=file --stats-json=file, returns -1 on invalid input
+int stats_config_parse(const options &opts, stats_config *config);
+
+//the same configuration with label, csv and json files get label suffix (file.csv -> file-label.csv)
+stats_config stats_config_labeled(const stats_config &config, const std::string &label);
+
+//lock-free log-linear histogram of non-negative values
+//16 sub-buckets per power of 2 give about 6% resolution
+class histogram
+{
+public:
+	histogram();
+
+	void add(uint64_t value);
+	void reset();
+
+	uint64_t count() const;
+	uint64_t sum() const;
+	uint64_t max() const;
+	//upper bound of the bucket holding p-th percentile (p in 0-100), capped at max
+	uint64_t percentile(double p) const;
+
+private:
+	static const int SUB_BUCKETS = 16;
+	static const int BUCKETS = SUB_BUCKETS * 40;
+
+	std::atomic<uint64_t> buckets[BUCKETS];
+	std::atomic<uint64_t> total;
+	std::atomic<uint64_t> total_sum;
+	std::atomic<uint64_t> maximum;
+};
+
+//stages between frame time points (see captured_frameset)
+enum StatsStage
+{
+	STAGE_SENSOR, //device timestamp -> wait_for_frames returned (host synchronized timestamps only)
+	STAGE_QUEUE, //captured -> dequeued by encoding thread
+	STAGE_PROCESS, //-> depth post-processing end
+	STAGE_ALIGN, //-> alignment end
+	STAGE_ROI, //-> texture region of interest map end
+	STAGE_SENT, //captured -> all streams sent
+	STAGE_SENSOR_SENT, //device timestamp -> all streams sent (host synchronized timestamps only)
+	STAGE_COUNT
+};
+
+//each value goes to window (since the last report) and total histogram
+struct stats_histograms
+{
+	histogram window;
+	histogram total;
+
+	void add(uint64_t value);
+};
+
+struct stream_stats
+{
+	std::string name;
+	stats_histograms encode_us; //send start -> send end
+	stats_histograms bytes; //encoded bytes per frame (if known)
+};
+
+//frameset stages are added from the encoding thread
+//encoding of streams may be added concurrently from worker threads
+class pipeline_stats
+{
+public:
+	pipeline_stats(const stats_config &config, const std::vector<std::string> &streams);
+
+	//thread safe, bytes < 0 if not known
+	void add_encode(int stream, std::chrono::steady_clock::duration duration, int bytes);
+
+	//call when all streams of frameset were sent, prints report every interval
+	void add_frameset(const captured_frameset &captured, uint64_t dropped);
+
+	//prints (and dumps) summary of the whole run
+	void finish(uint64_t dropped);
+
+private:
+	void report(bool total, uint64_t dropped);
+	void write_json(uint64_t dropped);
+
+	const stats_config config;
+
+	stats_histograms stages_us[STAGE_COUNT];
+	std::unique_ptr<stream_stats[]> streams;
+	const int stream_count;
+
+	std::chrono::steady_clock::time_point start;
+	std::chrono::steady_clock::time_point window_start;
+	uint64_t frames, window_frames, window_dropped;
+
+	std::ofstream csv;
+};
+
+#endif
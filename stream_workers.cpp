@@ -0,0 +1,107 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Concurrent encoding of multiple streams
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include "stream_workers.h"
+
+stream_workers::stream_workers(encoder *streamer, int streams, bool concurrent, pipeline_stats *stats) :
+	streamer(streamer), stats(stats), streams(streams), frames(NULL), generation(0), pending(0), stopping(false), results(streams, NHVE_OK)
+{
+	if(!concurrent)
+		return;
+
+	for(int i = 0; i < streams; ++i)
+		threads.push_back(std::thread(&stream_workers::run, this, i));
+}
+
+stream_workers::~stream_workers()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	work_ready.notify_all();
+
+	for(size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+}
+
+int stream_workers::send(const nhve_frame *frames)
+{
+	if(threads.empty())
+	{
+		int result = NHVE_OK;
+
+		for(int i = 0; i < streams; ++i)
+			if(send_stream(frames ? &frames[i] : NULL, i) != NHVE_OK)
+			{
+				result = NHVE_ERROR;
+				if(frames) //stop on the first failed frame, keep flushing the rest
+					break;
+			}
+
+		return result;
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+
+	this->frames = frames;
+	pending = threads.size();
+	++generation;
+
+	work_ready.notify_all();
+	work_done.wait(lock, [this]{ return pending == 0; });
+
+	for(size_t i = 0; i < results.size(); ++i)
+		if(results[i] != NHVE_OK)
+			return results[i];
+
+	return NHVE_OK;
+}
+
+void stream_workers::run(int index)
+{
+	unsigned long done = 0;
+
+	while(true)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		work_ready.wait(lock, [&]{ return stopping || generation != done; });
+
+		if(stopping)
+			return;
+
+		done = generation;
+		const nhve_frame *frame = frames ? &frames[index] : NULL;
+		lock.unlock();
+
+		const int result = send_stream(frame, index);
+
+		lock.lock();
+		results[index] = result;
+
+		if(--pending == 0)
+			work_done.notify_one();
+	}
+}
+
+int stream_workers::send_stream(const nhve_frame *frame, int index)
+{
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	const int result = encoder_send(streamer, frame, index);
+
+	//flushing is not a frame
+	if(stats && frame && result == NHVE_OK)
+		stats->add_encode(index, std::chrono::steady_clock::now() - start, streamer->sent_bytes[index]);
+
+	return result;
+}
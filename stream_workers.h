@@ -0,0 +1,66 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Concurrent encoding of multiple streams
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef STREAM_WORKERS_H
+#define STREAM_WORKERS_H
+
+// VAAPI or software encoding
+#include "encoder.h"
+
+// per stage latency statistics
+#include "stats.h"
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//when concurrent each stream index is encoded by its own worker thread
+//send() hands frames of one frameset to workers and waits for all (barrier)
+//so the frameset latency is the slowest encode instead of the sum of encodes
+//
+//otherwise frames are sent one after another on the calling thread
+//
+//encoders of different indices are independent (VAAPI and software), network sends
+//of all indices share one NHVE instance and are serialized by encoder_send
+class stream_workers
+{
+public:
+	//stats may be NULL, otherwise encoding time and size of each stream is recorded
+	stream_workers(encoder *streamer, int streams, bool concurrent, pipeline_stats *stats);
+	~stream_workers();
+
+	//sends frames[i] with index i, NULL frames flush encoders
+	//returns NHVE_OK if all sends succeeded
+	int send(const nhve_frame *frames);
+
+private:
+	void run(int index);
+	int send_stream(const nhve_frame *frame, int index);
+
+	encoder *streamer;
+	pipeline_stats *stats;
+	const int streams;
+	const nhve_frame *frames;
+
+	std::mutex mutex;
+	std::condition_variable work_ready;
+	std::condition_variable work_done;
+	unsigned long generation;
+	int pending;
+	bool stopping;
+	std::vector<int> results;
+	std::vector<std::thread> threads;
+};
+
+#endif
@@ -0,0 +1,315 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Software encoding with FFmpeg libx264/libx265
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include "sw_encoder.h"
+#include "pixel_convert.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/opt.h>
+}
+
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <ctime>
+#include <chrono>
+
+using namespace std;
+
+struct sw_encoder
+{
+	AVCodecContext *context;
+	AVFrame *frame;
+	AVPacket *packet;
+	pixel_convert_fn convert;
+	int64_t pts;
+	int qp_range; //FFmpeg region of interest offsets are fractions of it
+	vector<AVRegionOfInterest> roi;
+
+	//throughput and CPU cost summary printed on close
+	chrono::steady_clock::duration encoding;
+	clock_t cpu_start;
+	chrono::steady_clock::time_point wall_start;
+};
+
+static const char *x264_profile(int profile)
+{
+	switch(profile)
+	{
+		case FF_PROFILE_H264_CONSTRAINED_BASELINE: return "baseline";
+		case FF_PROFILE_H264_MAIN: return "main";
+		default: return "high";
+	}
+}
+
+static const char *x265_profile(int profile)
+{
+	return profile == FF_PROFILE_HEVC_MAIN_10 ? "main10" : "main";
+}
+
+struct sw_encoder *sw_encoder_init(const nhve_hw_config *hw, const sw_encoder_config *config)
+{
+	const bool hevc = hw->encoder && strncmp(hw->encoder, "hevc", 4) == 0;
+	const char *name = hevc ? "libx265" : "libx264";
+	int bit_depth;
+
+	pixel_convert_fn convert = pixel_convert_find(hw->pixel_format, &bit_depth);
+
+	if(!convert)
+	{
+		cerr << "software encoder doesn't support pixel format " << hw->pixel_format << endl;
+		return NULL;
+	}
+
+	if(bit_depth == 10 && !hevc)
+	{
+		cerr << "software encoder supports 10 bit " << hw->pixel_format << " only with HEVC" << endl;
+		return NULL;
+	}
+
+	const AVCodec *codec = avcodec_find_encoder_by_name(name);
+
+	if(!codec)
+	{
+		cerr << "FFmpeg was built without " << name << " encoder" << endl;
+		return NULL;
+	}
+
+	//x264/x265 disable adaptive quantization (and with it QP offsets) in constant QP mode
+	if(config->roi && hw->qp && !hw->bit_rate)
+	{
+		cerr << "software encoder regions of interest need bitrate or CRF, not constant qp" << endl;
+		return NULL;
+	}
+
+	sw_encoder *e = new sw_encoder();
+	e->convert = convert;
+	e->pts = 0;
+	e->qp_range = 51 + 6 * (bit_depth - 8);
+	e->encoding = chrono::steady_clock::duration::zero();
+
+	if( !(e->context = avcodec_alloc_context3(codec)) || !(e->frame = av_frame_alloc()) || !(e->packet = av_packet_alloc()) )
+	{
+		cerr << "failed to allocate " << name << " encoder" << endl;
+		sw_encoder_close(e);
+		return NULL;
+	}
+
+	AVCodecContext *c = e->context;
+
+	c->width = hw->width;
+	c->height = hw->height;
+	c->time_base = av_make_q(1, hw->framerate);
+	c->framerate = av_make_q(hw->framerate, 1);
+	c->pix_fmt = bit_depth == 10 ? AV_PIX_FMT_YUV420P10LE : AV_PIX_FMT_YUV420P;
+	c->max_b_frames = hw->max_b_frames;
+	c->thread_count = config->threads;
+
+	if(hw->gop_size)
+		c->gop_size = hw->gop_size;
+
+	//like VAAPI with bit_rate - constant bitrate with 1 second buffer
+	if(hw->bit_rate)
+		c->bit_rate = c->rc_max_rate = c->rc_buffer_size = hw->bit_rate;
+
+	AVDictionary *opts = NULL;
+
+	//zerolatency - no lookahead, no frame threading (sliced/wavefront threads instead)
+	av_dict_set(&opts, "preset", config->preset.empty() ? (hevc ? "ultrafast" : "superfast") : config->preset.c_str(), 0);
+	av_dict_set(&opts, "tune", "zerolatency", 0);
+	av_dict_set(&opts, "profile", hevc ? x265_profile(hw->profile) : x264_profile(hw->profile), 0);
+
+	if(hevc)
+	{
+		ostringstream params;
+		params << "log-level=warning";
+
+		if(config->threads)
+			params << ":pools=" << config->threads;
+		if(hw->qp && !hw->bit_rate)
+			params << ":qp=" << hw->qp;
+		//ultrafast and superfast presets have aq-mode=0, FFmpeg then skips regions of interest,
+		//and aq-strength=0, x265 then ignores the offsets FFmpeg passes
+		if(config->roi)
+			params << ":aq-mode=1:aq-strength=1.0";
+
+		av_dict_set(&opts, "x265-params", params.str().c_str(), 0);
+	}
+	else
+	{
+		if(hw->qp && !hw->bit_rate)
+			av_dict_set_int(&opts, "qp", hw->qp, 0);
+		//superfast keeps x264 default variance AQ but ultrafast (e.g. --encoder-preset) turns it off
+		if(config->roi)
+			av_dict_set_int(&opts, "aq-mode", 1, 0);
+	}
+
+	const int error = avcodec_open2(c, codec, &opts);
+	av_dict_free(&opts);
+
+	if(error < 0)
+	{
+		cerr << "failed to open " << name << " encoder (preset " << config->preset << ")" << endl;
+		sw_encoder_close(e);
+		return NULL;
+	}
+
+	e->frame->format = c->pix_fmt;
+	e->frame->width = c->width;
+	e->frame->height = c->height;
+
+	if(av_frame_get_buffer(e->frame, 32) < 0)
+	{
+		cerr << "failed to allocate " << name << " frame" << endl;
+		sw_encoder_close(e);
+		return NULL;
+	}
+
+	e->cpu_start = clock();
+	e->wall_start = chrono::steady_clock::now();
+
+	cout << "Software encoding with " << name << " (" << c->width << "x" << c->height << " " <<
+		hw->pixel_format << ", threads " << (config->threads ? to_string(config->threads) : "auto") << ")" << endl;
+
+	return e;
+}
+
+void sw_encoder_close(struct sw_encoder *e)
+{
+	if(!e)
+		return;
+
+	if(e->pts)
+	{
+		const double wall_s = chrono::duration<double>(chrono::steady_clock::now() - e->wall_start).count();
+		const double cpu_s = double(clock() - e->cpu_start) / CLOCKS_PER_SEC;
+		const double encoding_ms = chrono::duration<double, milli>(e->encoding).count();
+
+		//process CPU time also includes capture and processing, it is an upper bound
+		cout << e->context->codec->name << " encoded " << e->pts << " frames, " << encoding_ms / e->pts << " ms/frame, " <<
+			e->pts / wall_s << " fps, CPU " << cpu_s / wall_s << " cores" << endl;
+	}
+
+	av_packet_free(&e->packet);
+	av_frame_free(&e->frame);
+	avcodec_free_context(&e->context);
+
+	delete e;
+}
+
+int sw_encoder_send_frame(struct sw_encoder *e, const nhve_frame *frame)
+{
+	const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	int error;
+
+	if(!frame)
+		error = avcodec_send_frame(e->context, NULL);
+	else
+	{
+		//encoder may still hold reference to the previous frame
+		if(av_frame_make_writable(e->frame) < 0)
+		{
+			cerr << "failed to make software encoder frame writable" << endl;
+			return NHVE_ERROR;
+		}
+
+		nhve_frame planes;
+		for(int i = 0; i < NHVE_NUM_DATA_POINTERS; ++i)
+		{
+			planes.data[i] = e->frame->data[i];
+			planes.linesize[i] = e->frame->linesize[i];
+		}
+
+		e->convert(*frame, e->context->width, e->context->height, &planes);
+		e->frame->pts = e->pts++;
+
+		//frame is reused, side data from the previous frame would stay
+		av_frame_remove_side_data(e->frame, AV_FRAME_DATA_REGIONS_OF_INTEREST);
+
+		if(!e->roi.empty())
+		{
+			const size_t size = e->roi.size() * sizeof(AVRegionOfInterest);
+			AVFrameSideData *roi = av_frame_new_side_data(e->frame, AV_FRAME_DATA_REGIONS_OF_INTEREST, size);
+
+			if(!roi)
+			{
+				cerr << "failed to allocate software encoder region of interest" << endl;
+				return NHVE_ERROR;
+			}
+
+			memcpy(roi->data, &e->roi[0], size);
+		}
+
+		error = avcodec_send_frame(e->context, e->frame);
+	}
+
+	e->encoding += chrono::steady_clock::now() - start;
+
+	if(error < 0)
+	{
+		cerr << "failed to send frame to software encoder" << endl;
+		return NHVE_ERROR;
+	}
+
+	return NHVE_OK;
+}
+
+void sw_encoder_set_roi(struct sw_encoder *e, const vector<sw_encoder_roi> &roi)
+{
+	e->roi.resize(roi.size());
+
+	for(size_t i = 0; i < roi.size(); ++i)
+	{
+		AVRegionOfInterest &r = e->roi[i];
+
+		r.self_size = sizeof(AVRegionOfInterest);
+		r.top = roi[i].top;
+		r.bottom = roi[i].bottom;
+		r.left = roi[i].left;
+		r.right = roi[i].right;
+		//libx264/libx265 scale it back by qp range, so integer offset is exact
+		r.qoffset = av_make_q(roi[i].qp_offset, e->qp_range);
+	}
+}
+
+int sw_encoder_receive_packet(struct sw_encoder *e, nhve_frame *packet)
+{
+	const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	av_packet_unref(e->packet);
+	const int error = avcodec_receive_packet(e->context, e->packet);
+
+	e->encoding += chrono::steady_clock::now() - start;
+
+	if(error == AVERROR(EAGAIN) || error == AVERROR_EOF)
+		return 0;
+
+	if(error < 0)
+	{
+		cerr << "failed to receive packet from software encoder" << endl;
+		return NHVE_ERROR;
+	}
+
+	memset(packet, 0, sizeof(*packet));
+	packet->data[0] = e->packet->data;
+	packet->linesize[0] = e->packet->size;
+
+	return 1;
+}
+
+const char *sw_encoder_name(const struct sw_encoder *e)
+{
+	return e->context->codec->name;
+}
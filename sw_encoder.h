@@ -0,0 +1,71 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Software encoding with FFmpeg libx264/libx265
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef SW_ENCODER_H
+#define SW_ENCODER_H
+
+// Network Hardware Video Encoder
+#include "nhve.h"
+
+#include <string>
+#include <vector>
+
+struct sw_encoder_config
+{
+	int threads; //0 for automatic (all cores)
+	std::string preset; //x264/x265 preset, empty for default (superfast/ultrafast)
+	bool roi; //regions of interest will be set, enables adaptive quantization
+};
+
+//rectangle in pixels (right and bottom exclusive) encoded with QP changed by qp_offset
+//negative offset is better quality, positive is cheaper
+struct sw_encoder_roi
+{
+	int left;
+	int top;
+	int right;
+	int bottom;
+	int qp_offset;
+};
+
+struct sw_encoder;
+
+//takes the same configuration as VAAPI encoder
+//- encoder h264_vaapi/hevc_vaapi selects libx264/libx265
+//- pixel format is one of the formats we use with VAAPI (see pixel_convert.h)
+//- profile, bit_rate or qp, gop_size, max_b_frames are respected
+//- device and compression_level are ignored
+//the encoder is tuned for zero latency (no lookahead, sliced threads)
+//returns NULL on failure
+struct sw_encoder *sw_encoder_init(const nhve_hw_config *hw_config, const sw_encoder_config *config);
+void sw_encoder_close(struct sw_encoder *e);
+
+//send frame laid out like for nhve_send, NULL frame starts flushing the encoder
+int sw_encoder_send_frame(struct sw_encoder *e, const nhve_frame *frame);
+
+//regions of interest for the following frames (empty vector clears)
+//passed to libx264/libx265 as FFmpeg region of interest side data
+//FFmpeg skips it without adaptive quantization (off in ultrafast presets) and the encoders
+//don't apply it with constant QP, so encoder has to be initialized with sw_encoder_config roi
+//(forces aq-mode and x265 aq-strength, rejects qp without bit_rate)
+void sw_encoder_set_roi(struct sw_encoder *e, const std::vector<sw_encoder_roi> &roi);
+
+//encoded packet in packet->data[0] with size in packet->linesize[0]
+//the data is valid until the next call
+//returns 1 if packet was received, 0 if no more packets are ready, NHVE_ERROR on failure
+int sw_encoder_receive_packet(struct sw_encoder *e, nhve_frame *packet);
+
+//library encoder name (libx264, libx265)
+const char *sw_encoder_name(const struct sw_encoder *e);
+
+#endif
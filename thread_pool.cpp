@@ -0,0 +1,98 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Thread pool for data parallel per frame work
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include "thread_pool.h"
+
+thread_pool::thread_pool(int threads) :
+	task(NULL), tasks(0), next(0), active(0), generation(0), stopping(false)
+{
+	if(threads <= 0)
+		threads = std::thread::hardware_concurrency();
+
+	for(int i = 1; i < threads; ++i)
+		this->threads.push_back(std::thread(&thread_pool::work, this));
+}
+
+thread_pool::~thread_pool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	work_ready.notify_all();
+
+	for(size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+}
+
+int thread_pool::size() const
+{
+	return threads.size() + 1;
+}
+
+void thread_pool::run(int tasks, const std::function<void(int)> &task)
+{
+	if(threads.empty() || tasks == 1)
+	{
+		for(int i = 0; i < tasks; ++i)
+			task(i);
+		return;
+	}
+
+	std::lock_guard<std::mutex> run_lock(running);
+	std::unique_lock<std::mutex> lock(mutex);
+
+	this->task = &task;
+	this->tasks = tasks;
+	next = 0;
+	active = threads.size();
+	++generation;
+
+	lock.unlock();
+	work_ready.notify_all();
+
+	execute();
+
+	lock.lock();
+	work_done.wait(lock, [this]{ return active == 0; });
+}
+
+void thread_pool::execute()
+{
+	for(int i = next++; i < tasks; i = next++)
+		(*task)(i);
+}
+
+void thread_pool::work()
+{
+	unsigned long done = 0;
+
+	while(true)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		work_ready.wait(lock, [&]{ return stopping || generation != done; });
+
+		if(stopping)
+			return;
+
+		done = generation;
+		lock.unlock();
+
+		execute();
+
+		lock.lock();
+
+		if(--active == 0)
+			work_done.notify_one();
+	}
+}
@@ -0,0 +1,58 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Thread pool for data parallel per frame work
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//run() splits work into tasks taken by workers and the calling thread
+//and returns when all tasks are done (fork-join)
+//the pool may be shared between threads (e.g. cameras), concurrent run() calls take turns
+class thread_pool
+{
+public:
+	//threads includes the calling thread, 0 for all cores
+	explicit thread_pool(int threads);
+	~thread_pool();
+
+	//calls task(i) for i in [0, tasks), tasks run concurrently in any order
+	void run(int tasks, const std::function<void(int)> &task);
+
+	//number of threads working in run (including calling thread)
+	int size() const;
+
+private:
+	void work();
+	void execute();
+
+	std::vector<std::thread> threads;
+
+	std::mutex running; //one run at a time
+	std::mutex mutex;
+	std::condition_variable work_ready;
+	std::condition_variable work_done;
+	const std::function<void(int)> *task;
+	int tasks;
+	std::atomic<int> next;
+	int active;
+	unsigned long generation;
+	bool stopping;
+};
+
+#endif
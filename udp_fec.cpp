@@ -0,0 +1,313 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * XOR parity forward error correction for UDP datagrams
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include "udp_fec.h"
+
+#include <arpa/inet.h>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RNHVE_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+const uint16_t FEC_MAGIC = 0x5246;
+//groups kept by decoder, older datagrams are too late to help
+const uint32_t FEC_WINDOW = 1024;
+
+void fec_xor_scalar(uint8_t *dst, const uint8_t *src, int size)
+{
+	for(int i = 0; i < size; ++i)
+		dst[i] ^= src[i];
+}
+
+#ifdef RNHVE_X86
+
+__attribute__((target("sse2")))
+static void fec_xor_sse2_impl(uint8_t *dst, const uint8_t *src, int size)
+{
+	int i = 0;
+
+	for(; i + 16 <= size; i += 16)
+	{
+		__m128i d = _mm_loadu_si128((__m128i*)(dst + i));
+		__m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(d, s));
+	}
+
+	for(; i < size; ++i)
+		dst[i] ^= src[i];
+}
+
+__attribute__((target("avx2")))
+static void fec_xor_avx2_impl(uint8_t *dst, const uint8_t *src, int size)
+{
+	int i = 0;
+
+	for(; i + 32 <= size; i += 32)
+	{
+		__m256i d = _mm256_loadu_si256((__m256i*)(dst + i));
+		__m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_xor_si256(d, s));
+	}
+
+	for(; i < size; ++i)
+		dst[i] ^= src[i];
+}
+
+fec_xor_fn fec_xor_sse2()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2") ? fec_xor_sse2_impl : NULL;
+}
+
+fec_xor_fn fec_xor_avx2()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") ? fec_xor_avx2_impl : NULL;
+}
+
+#else
+
+fec_xor_fn fec_xor_sse2()
+{
+	return NULL;
+}
+
+fec_xor_fn fec_xor_avx2()
+{
+	return NULL;
+}
+
+#endif
+
+static fec_xor_fn select_fec_xor()
+{
+	if(fec_xor_fn fn = fec_xor_avx2())
+		return fn;
+	if(fec_xor_fn fn = fec_xor_sse2())
+		return fn;
+
+	return fec_xor_scalar;
+}
+
+void fec_xor(uint8_t *dst, const uint8_t *src, int size)
+{
+	static const fec_xor_fn fn = select_fec_xor();
+	fn(dst, src, size);
+}
+
+static void write_header(uint8_t *header, int count, int index, uint32_t number)
+{
+	const uint16_t magic = htons(FEC_MAGIC);
+	number = htonl(number);
+
+	memcpy(header, &magic, 2);
+	header[2] = count;
+	header[3] = index;
+	memcpy(header + 4, &number, 4);
+}
+
+//sum ^= src at offset, growing zero padded sum if needed
+static void xor_at(vector<uint8_t> &sum, int offset, const uint8_t *src, int size)
+{
+	if(sum.size() < (size_t)(offset + size))
+		sum.resize(offset + size, 0);
+
+	fec_xor(&sum[offset], src, size);
+}
+
+fec_encoder::fec_encoder(int group_size, int interleave) :
+	group_size(group_size), groups(interleave), column(0), next_group(0)
+{
+	for(group &g : groups)
+	{
+		g.count = 0;
+		g.parity.assign(FEC_HEADER, 0);
+	}
+}
+
+int fec_encoder::protect(uint8_t *payload, int size)
+{
+	group &g = groups[column];
+	column = (column + 1) % groups.size();
+
+	if(g.count == 0)
+		g.number = next_group++;
+
+	write_header(payload - FEC_HEADER, 0, g.count, g.number);
+
+	const uint8_t length[2] = {(uint8_t)(size >> 8), (uint8_t)size};
+
+	xor_at(g.parity, FEC_HEADER, length, 2);
+	xor_at(g.parity, FEC_HEADER + 2, payload, size);
+
+	if(++g.count == group_size)
+		close(g);
+
+	return size + FEC_HEADER;
+}
+
+void fec_encoder::close(group &g)
+{
+	if(!g.count)
+		return;
+
+	write_header(&g.parity[0], g.count, FEC_PARITY, g.number);
+	parities.push_back(move(g.parity));
+
+	if(!spare.empty())
+	{
+		g.parity = move(spare.back());
+		spare.pop_back();
+	}
+
+	g.parity.assign(FEC_HEADER, 0);
+	g.count = 0;
+}
+
+void fec_encoder::flush()
+{
+	for(group &g : groups)
+		close(g);
+}
+
+bool fec_encoder::pending() const
+{
+	for(const group &g : groups)
+		if(g.count)
+			return true;
+
+	return false;
+}
+
+const vector<vector<uint8_t> > &fec_encoder::ready() const
+{
+	return parities;
+}
+
+void fec_encoder::release()
+{
+	for(vector<uint8_t> &p : parities)
+		spare.push_back(move(p));
+
+	parities.clear();
+}
+
+fec_decoder::fec_decoder() : groups(FEC_WINDOW), newest(0), counters()
+{
+	for(group &g : groups)
+		g.used = false;
+}
+
+void fec_decoder::receive(const uint8_t *datagram, int size, const function<void(const uint8_t *payload, int size)> &deliver)
+{
+	uint16_t magic;
+	uint32_t number;
+
+	if(size < FEC_HEADER + 1)
+	{
+		++counters.invalid;
+		return;
+	}
+
+	memcpy(&magic, datagram, 2);
+	memcpy(&number, datagram + 4, 4);
+	number = ntohl(number);
+
+	const int count = datagram[2];
+	const int index = datagram[3];
+
+	if(ntohs(magic) != FEC_MAGIC || (index != FEC_PARITY && index >= FEC_MAX_GROUP) ||
+		(int32_t)(newest - number) >= (int32_t)FEC_WINDOW)
+	{
+		++counters.invalid;
+		return;
+	}
+
+	if((int32_t)(number - newest) > 0)
+		newest = number;
+
+	group &g = groups[number % FEC_WINDOW];
+
+	if(!g.used || g.number != number)
+	{
+		expire(g);
+		g.used = true;
+		g.number = number;
+		g.count = g.received = 0;
+		g.mask = 0;
+		g.parity = false;
+		g.xor_sum.clear();
+	}
+
+	const uint8_t *payload = datagram + FEC_HEADER;
+	const int length = size - FEC_HEADER;
+
+	if(index == FEC_PARITY)
+	{
+		if(g.parity || count == 0 || count > FEC_MAX_GROUP)
+			return;
+
+		g.parity = true;
+		g.count = count;
+		xor_at(g.xor_sum, 0, payload, length);
+	}
+	else
+	{
+		if(g.mask & (1ULL << index))
+			return; //duplicate or already recovered
+
+		g.mask |= 1ULL << index;
+		++g.received;
+		++counters.received;
+
+		deliver(payload, length);
+
+		const uint8_t prefix[2] = {(uint8_t)(length >> 8), (uint8_t)length};
+		xor_at(g.xor_sum, 0, prefix, 2);
+		xor_at(g.xor_sum, 2, payload, length);
+	}
+
+	if(!g.parity || g.received != g.count - 1)
+		return;
+
+	//exactly one missing, the sum is its length prefixed payload
+	const int missing_length = (g.xor_sum[0] << 8) | g.xor_sum[1];
+	int missing = 0;
+
+	while(g.mask & (1ULL << missing))
+		++missing;
+
+	if(missing_length + 2 > (int)g.xor_sum.size())
+		return;
+
+	g.mask |= 1ULL << missing;
+	++g.received;
+	++counters.recovered;
+
+	deliver(&g.xor_sum[2], missing_length);
+}
+
+void fec_decoder::expire(group &g)
+{
+	if(g.used && g.parity && g.received < g.count)
+		counters.lost += g.count - g.received;
+}
+
+const fec_decoder_stats &fec_decoder::stats() const
+{
+	return counters;
+}
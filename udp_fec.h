@@ -0,0 +1,121 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * XOR parity forward error correction for UDP datagrams
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef UDP_FEC_H
+#define UDP_FEC_H
+
+#include <functional>
+#include <vector>
+#include <stdint.h>
+
+//every datagram is prefixed with header:
+//- magic (2 bytes)
+//- group size (1 byte, 0 in data datagrams as group may close early)
+//- index in group (1 byte, FEC_PARITY for parity)
+//- group number (4 bytes, network order)
+//parity is XOR of group data datagrams, each as 2 byte length + payload zero padded to the longest
+const int FEC_HEADER = 8;
+const int FEC_PARITY = 0xFF;
+const int FEC_MAX_GROUP = 64;
+const int FEC_MAX_INTERLEAVE = 16;
+
+//dst ^= src, size bytes
+typedef void (*fec_xor_fn)(uint8_t *dst, const uint8_t *src, int size);
+
+//the best implementation for this CPU, selected at runtime on first use
+void fec_xor(uint8_t *dst, const uint8_t *src, int size);
+
+void fec_xor_scalar(uint8_t *dst, const uint8_t *src, int size);
+//NULL if not supported by CPU (or not compiled for this architecture)
+fec_xor_fn fec_xor_sse2();
+fec_xor_fn fec_xor_avx2();
+
+//one parity per group of group_size data datagrams (overhead 1/group_size), any single loss in group is recovered
+//consecutive datagrams go round robin to interleave groups, so burst of up to interleave datagrams is recovered
+class fec_encoder
+{
+public:
+	fec_encoder(int group_size, int interleave);
+
+	//payload has to be preceded by FEC_HEADER bytes of headroom where header is written
+	//returns datagram size (with header), parity of group completed by it goes to ready
+	int protect(uint8_t *payload, int size);
+
+	//closes groups that are not full (e.g. at frame end so parity doesn't wait for next frame)
+	void flush();
+
+	//some group is open (has data datagrams without parity)
+	bool pending() const;
+
+	//parity datagrams completed since release, send them and release
+	const std::vector<std::vector<uint8_t> > &ready() const;
+	void release();
+
+private:
+	struct group
+	{
+		uint32_t number;
+		int count;
+		std::vector<uint8_t> parity; //header + XOR of length prefixed payloads
+	};
+
+	void close(group &g);
+
+	const int group_size;
+	std::vector<group> groups; //open group per interleave column
+	int column;
+	uint32_t next_group;
+
+	std::vector<std::vector<uint8_t> > parities;
+	std::vector<std::vector<uint8_t> > spare;
+};
+
+struct fec_decoder_stats
+{
+	uint64_t received; //data datagrams
+	uint64_t recovered;
+	uint64_t lost; //known to be lost (group with parity and more than one missing)
+	uint64_t invalid; //not FEC datagrams or too old
+};
+
+//receiver side, passes data datagrams on as they arrive and recovered ones as soon as possible
+class fec_decoder
+{
+public:
+	fec_decoder();
+
+	//deliver is called with payload of datagram (if data) and of datagram recovered by it
+	void receive(const uint8_t *datagram, int size, const std::function<void(const uint8_t *payload, int size)> &deliver);
+
+	const fec_decoder_stats &stats() const;
+
+private:
+	struct group
+	{
+		uint32_t number;
+		bool used;
+		int count; //0 until parity arrives
+		int received; //data datagrams
+		uint64_t mask; //received indexes
+		bool parity;
+		std::vector<uint8_t> xor_sum; //of everything received, the missing datagram if exactly one is missing
+	};
+
+	void expire(group &g);
+
+	std::vector<group> groups; //ring indexed by group number
+	uint32_t newest;
+	fec_decoder_stats counters;
+};
+
+#endif
@@ -0,0 +1,593 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Fan-out of encoded stream datagrams to multiple destinations
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include "udp_relay.h"
+#include "mlsp_packet.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <cerrno>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103 //linux/udp.h, older glibc headers don't have it
+#endif
+
+using namespace std;
+
+//MLSP datagrams fit in MTU, this fits any UDP datagram
+const int MAX_DATAGRAM = 65536;
+//keyframe bursts arrive on loopback faster than they are sent out
+const int RECEIVE_BUFFER = 8 * 1024 * 1024;
+//how often relay thread checks for stop without traffic
+const int POLL_MS = 100;
+//pacing token bucket depth, a few MTU datagrams may go back to back
+const double PACING_BURST = 4 * 1500;
+//FEC groups are closed at MLSP subframe end, those left open (e.g. lost subframe end) after this long without datagrams
+const int FEC_IDLE_MS = 5;
+
+int udp_relay_config_parse(const options &opts, int framerate, udp_relay_config *config)
+{
+	stringstream list(options_get(opts, "fanout", ""));
+	string destination;
+
+	config->destinations.clear();
+	config->ttl = options_get_int(opts, "multicast-ttl", 1);
+	config->pacing = options_get_float(opts, "pacing", 0.0f);
+	config->framerate = framerate;
+	config->fec = options_get_int(opts, "fec", 0);
+	config->fec_interleave = options_get_int(opts, "fec-interleave", 1);
+
+	if(udp_batch_parse(opts, &config->batch) < 0)
+		return -1;
+
+	while(getline(list, destination, ','))
+	{
+		const size_t colon = destination.rfind(':');
+
+		if(colon == string::npos || colon == 0 || atoi(destination.c_str() + colon + 1) <= 0)
+		{
+			cerr << "fanout destination has to be host:port, not '" << destination << "'" << endl;
+			return -1;
+		}
+
+		config->destinations.push_back(destination);
+	}
+
+	if(config->pacing < 0.0f || config->pacing > 1.0f)
+	{
+		cerr << "pacing has to be fraction of frame interval 0-1" << endl;
+		return -1;
+	}
+
+	if(config->fec == 1 || config->fec < 0 || config->fec > FEC_MAX_GROUP)
+	{
+		cerr << "fec has to be 2-" << FEC_MAX_GROUP << " datagrams per parity" << endl;
+		return -1;
+	}
+
+	if(config->fec_interleave < 1 || config->fec_interleave > FEC_MAX_INTERLEAVE)
+	{
+		cerr << "fec interleave has to be 1-" << FEC_MAX_INTERLEAVE << endl;
+		return -1;
+	}
+
+	if(config->ttl < 0 || config->ttl > 255)
+	{
+		cerr << "multicast ttl has to be 0-255" << endl;
+		return -1;
+	}
+
+	return 0;
+}
+
+//connected non-blocking UDP socket, -1 on failure
+static int connect_destination(const string &host, int port, int ttl)
+{
+	addrinfo hints = {0}, *address = NULL;
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	const int error = getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &address);
+
+	if(error)
+	{
+		cerr << "unable to resolve " << host << ": " << gai_strerror(error) << endl;
+		return -1;
+	}
+
+	const int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+	const in_addr_t ip = ntohl(((sockaddr_in*)address->ai_addr)->sin_addr.s_addr);
+
+	if(fd >= 0 && IN_MULTICAST(ip))
+	{
+		const unsigned char multicast_ttl = ttl;
+		setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &multicast_ttl, sizeof(multicast_ttl));
+	}
+
+	if(fd < 0 || connect(fd, address->ai_addr, address->ai_addrlen) < 0)
+	{
+		cerr << "unable to create socket for " << host << ":" << port << ": " << strerror(errno) << endl;
+		if(fd >= 0)
+			close(fd);
+		freeaddrinfo(address);
+		return -1;
+	}
+
+	freeaddrinfo(address);
+
+	return fd;
+}
+
+udp_relay::udp_relay(const udp_relay_config &config) :
+	config(config), receiver(-1),
+	buffer(UDP_RELAY_BATCH * MAX_DATAGRAM), iovecs(2 * UDP_RELAY_BATCH + FEC_MAX_INTERLEAVE),
+	messages(iovecs.size()), sizes(iovecs.size()), cpu(0), queued(0), stopping(false)
+{
+	//parity datagrams per batch are at most one per datagram (subframe ends) + FEC_MAX_INTERLEAVE left open before
+	for(size_t i = 0; i < messages.size(); ++i)
+	{
+		messages[i].msg_hdr = msghdr();
+		messages[i].msg_hdr.msg_iov = &iovecs[i];
+		messages[i].msg_hdr.msg_iovlen = 1;
+	}
+}
+
+udp_relay::~udp_relay()
+{
+	stop();
+
+	for(udp_relay_destination &d : targets)
+		close(d.socket);
+
+	if(receiver >= 0)
+		close(receiver);
+}
+
+int udp_relay::start(nhve_net_config *net_config, int port_offset)
+{
+	if(config.destinations.empty() && config.pacing <= 0.0f && !config.fec)
+		return 0;
+
+	vector<pair<string, int> > hosts;
+	hosts.push_back(make_pair(string(net_config->ip), (int)net_config->port));
+
+	for(const string &d : config.destinations)
+	{
+		const size_t colon = d.rfind(':');
+		hosts.push_back(make_pair(d.substr(0, colon), atoi(d.c_str() + colon + 1) + port_offset));
+	}
+
+	for(const pair<string, int> &h : hosts)
+	{
+		udp_relay_destination d = {h.first + ":" + to_string(h.second), -1, 0, 0, 0, 0, 0, config.batch == UDP_BATCH_GSO};
+
+		if( (d.socket = connect_destination(h.first, h.second, config.ttl)) < 0 )
+			return -1;
+
+		targets.push_back(d);
+	}
+
+	sockaddr_in local = {0};
+	socklen_t size = sizeof(local);
+	local.sin_family = AF_INET;
+	local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	local.sin_port = 0; //any free port
+
+	const int buffer = RECEIVE_BUFFER;
+
+	if( (receiver = socket(AF_INET, SOCK_DGRAM, 0)) < 0 ||
+		bind(receiver, (sockaddr*)&local, sizeof(local)) < 0 ||
+		getsockname(receiver, (sockaddr*)&local, &size) < 0)
+	{
+		cerr << "unable to create relay socket: " << strerror(errno) << endl;
+		return -1;
+	}
+
+	//the kernel may cap it at net.core.rmem_max
+	setsockopt(receiver, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+
+	net_config->ip = "127.0.0.1";
+	net_config->port = ntohs(local.sin_port);
+
+	cout << "Relay through loopback port " << net_config->port << " to";
+	for(const udp_relay_destination &d : targets)
+		cout << " " << d.name;
+	cout << endl;
+
+	if(config.pacing > 0.0f)
+		cout << "Pacing frames over " << 1000.0f * config.pacing / config.framerate << " ms" << endl;
+
+	if(config.fec)
+	{
+		fec.reset(new fec_encoder(config.fec, config.fec_interleave));
+		cout << "FEC parity per " << config.fec << " datagrams (" << 100 / config.fec << "% overhead), interleave " <<
+			config.fec_interleave << endl;
+	}
+
+	stopping = false;
+	thread = std::thread(config.pacing > 0.0f ? &udp_relay::run_paced : &udp_relay::run, this);
+
+	return 0;
+}
+
+void udp_relay::run()
+{
+	pollfd fd = {receiver, POLLIN, 0};
+
+	while(true)
+	{
+		//drain what is there on stop (encoder flushed before)
+		const bool last = stopping;
+		const bool pending = fec && fec->pending();
+		int count;
+
+		if(!last && poll(&fd, 1, pending ? FEC_IDLE_MS : POLL_MS) <= 0)
+		{	//groups left open by stream without subframe end
+			if(pending && (count = protect_flush()))
+				forward(count);
+			continue;
+		}
+
+		while( (count = receive()) > 0 )
+			forward(protect(count));
+
+		if(last)
+		{
+			if( (count = protect_flush()) )
+				forward(count);
+			break;
+		}
+	}
+
+	timespec t;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+	cpu = t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+}
+
+void udp_relay::run_paced()
+{
+	const double window = config.pacing / config.framerate; //seconds
+	pollfd fd = {receiver, POLLIN, 0};
+
+	double rate = 0; //bytes per second
+	double tokens = PACING_BURST;
+	chrono::steady_clock::time_point refill = chrono::steady_clock::now(), heard = refill;
+
+	while(true)
+	{
+		//on stop send what is queued without pacing
+		const bool last = stopping;
+
+		if(!last)
+		{	//sleep until data arrives, there are tokens for the next datagram or open FEC groups time out
+			const double deficit = queue.empty() ? 0 : min<double>(queue.front().size(), PACING_BURST) - tokens;
+			const double idle = FEC_IDLE_MS / 1000.0 - chrono::duration<double>(chrono::steady_clock::now() - heard).count();
+			double wait = queue.empty() ? POLL_MS / 1000.0 : max(0.0, deficit / rate);
+
+			if(fec && fec->pending())
+				wait = min(wait, max(0.0, idle));
+
+			const timespec timeout = {(time_t)wait, (long)((wait - (time_t)wait) * 1e9)};
+
+			ppoll(&fd, 1, &timeout, NULL);
+		}
+
+		bool arrived = false;
+
+		for(int count; (count = receive()) > 0; arrived = true)
+			enqueue(protect(count));
+
+		const chrono::steady_clock::time_point now = chrono::steady_clock::now();
+		tokens = min(PACING_BURST, tokens + rate * chrono::duration<double>(now - refill).count());
+		refill = now;
+
+		if(arrived)
+			heard = now;
+
+		//groups left open by stream without subframe end
+		if(fec && fec->pending() && (last || now - heard >= chrono::milliseconds(FEC_IDLE_MS)))
+		{
+			enqueue(protect_flush());
+			arrived = true;
+		}
+
+		//new frame (or its part), send everything queued within the window from now
+		if(arrived)
+			rate = queued / window;
+
+		int count = 0;
+
+		while(!queue.empty() && count < UDP_RELAY_BATCH &&
+			(last || tokens >= min<double>(queue.front().size(), PACING_BURST)))
+		{
+			vector<uint8_t> &datagram = queue.front();
+
+			memcpy(&buffer[count * MAX_DATAGRAM], datagram.data(), datagram.size());
+			iovecs[count].iov_base = &buffer[count * MAX_DATAGRAM];
+			iovecs[count].iov_len = sizes[count] = datagram.size();
+			tokens -= datagram.size(); //datagram larger than bucket leaves debt
+			queued -= datagram.size();
+			++count;
+
+			spare.push_back(move(datagram));
+			queue.pop_front();
+		}
+
+		if(count)
+			forward(count);
+
+		if(last && queue.empty())
+			break;
+	}
+
+	timespec t;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+	cpu = t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+}
+
+//copies datagrams from slots to pacing queue
+void udp_relay::enqueue(int count)
+{
+	for(int i = 0; i < count; ++i)
+	{
+		const uint8_t *data = (uint8_t*)iovecs[i].iov_base;
+
+		if(spare.empty())
+			queue.push_back(vector<uint8_t>());
+		else
+		{
+			queue.push_back(move(spare.back()));
+			spare.pop_back();
+		}
+
+		queue.back().assign(data, data + sizes[i]);
+		queued += sizes[i];
+	}
+}
+
+//number of datagrams received into slots, 0 if there are none
+int udp_relay::receive()
+{
+	//headroom for FEC header
+	for(int i = 0; i < UDP_RELAY_BATCH; ++i)
+	{
+		iovecs[i].iov_base = &buffer[i * MAX_DATAGRAM + FEC_HEADER];
+		iovecs[i].iov_len = MAX_DATAGRAM - FEC_HEADER;
+	}
+
+	if(config.batch == UDP_BATCH_OFF)
+	{
+		sizes[0] = recv(receiver, iovecs[0].iov_base, iovecs[0].iov_len, MSG_DONTWAIT);
+		iovecs[0].iov_len = sizes[0];
+		return sizes[0] < 0 ? 0 : 1;
+	}
+
+	const int count = recvmmsg(receiver, &messages[0], UDP_RELAY_BATCH, MSG_DONTWAIT, NULL);
+
+	for(int i = 0; i < count; ++i)
+		iovecs[i].iov_len = sizes[i] = messages[i].msg_len;
+
+	return count < 0 ? 0 : count;
+}
+
+//adds FEC headers to received datagrams and appends completed parity, returns datagram count
+int udp_relay::protect(int count)
+{
+	if(!fec)
+		return count;
+
+	fec->release(); //the previous parity is already sent or queued
+
+	for(int i = 0; i < count; ++i)
+	{
+		uint8_t *payload = (uint8_t*)iovecs[i].iov_base;
+		const bool end = mlsp_subframe_end(payload, sizes[i]);
+
+		sizes[i] = fec->protect(payload, sizes[i]);
+		iovecs[i].iov_base = payload - FEC_HEADER;
+		iovecs[i].iov_len = sizes[i];
+
+		//the rest of subframe is in this group, its parity doesn't wait for the next one
+		if(end)
+			fec->flush();
+	}
+
+	return append_parity(count);
+}
+
+//parity of groups that are not full, returns datagram count
+int udp_relay::protect_flush()
+{
+	if(!fec)
+		return 0;
+
+	fec->release();
+	fec->flush();
+
+	return append_parity(0);
+}
+
+int udp_relay::append_parity(int count)
+{
+	for(const vector<uint8_t> &parity : fec->ready())
+	{
+		iovecs[count].iov_base = (void*)parity.data();
+		iovecs[count].iov_len = sizes[count] = parity.size();
+		++count;
+	}
+
+	return count;
+}
+
+void udp_relay::forward(int count)
+{
+	for(udp_relay_destination &d : targets)
+		if(config.batch == UDP_BATCH_OFF)
+			send_single(d, 0, count);
+		else if(!d.gso)
+			send_mmsg(d, 0, count);
+		else
+			send_gso(d, count);
+}
+
+void udp_relay::send_single(udp_relay_destination &d, int first, int end)
+{
+	for(int i = first; i < end; ++i)
+	{
+		++d.syscalls;
+
+		if(send(d.socket, iovecs[i].iov_base, sizes[i], MSG_DONTWAIT) != sizes[i])
+		{
+			failed(d, 1);
+			continue;
+		}
+
+		++d.packets;
+		d.bytes += sizes[i];
+	}
+}
+
+void udp_relay::send_mmsg(udp_relay_destination &d, int first, int end)
+{
+	while(first < end)
+	{
+		++d.syscalls;
+
+		const int sent = sendmmsg(d.socket, &messages[first], end - first, MSG_DONTWAIT);
+
+		if(sent <= 0)
+		{	//the first one failed, try the rest
+			failed(d, 1);
+			++first;
+			continue;
+		}
+
+		for(int i = first; i < first + sent; ++i)
+			d.bytes += sizes[i];
+
+		d.packets += sent;
+		first += sent;
+	}
+}
+
+//runs of equal size datagrams (the last one may be shorter) go as single GSO send
+void udp_relay::send_gso(udp_relay_destination &d, int count)
+{
+	union
+	{
+		char buf[CMSG_SPACE(sizeof(uint16_t))];
+		cmsghdr align;
+	} control;
+
+	for(int first = 0, end; first < count; first = end)
+	{
+		const int segment = sizes[first];
+		int bytes = segment;
+
+		for(end = first + 1; end < count && end - first < UDP_GSO_SEGMENTS && bytes + sizes[end] <= UDP_GSO_BYTES; ++end)
+		{
+			if(sizes[end] > segment)
+				break;
+
+			bytes += sizes[end];
+
+			if(sizes[end] < segment)
+			{
+				++end;
+				break;
+			}
+		}
+
+		if(end - first == 1)
+		{
+			send_single(d, first, end);
+			continue;
+		}
+
+		msghdr message = msghdr();
+		message.msg_iov = &iovecs[first];
+		message.msg_iovlen = end - first;
+		message.msg_control = control.buf;
+		message.msg_controllen = sizeof(control.buf);
+
+		cmsghdr *cm = CMSG_FIRSTHDR(&message);
+		cm->cmsg_level = SOL_UDP;
+		cm->cmsg_type = UDP_SEGMENT;
+		cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+		*(uint16_t*)CMSG_DATA(cm) = segment;
+
+		++d.syscalls;
+
+		if(sendmsg(d.socket, &message, MSG_DONTWAIT) == bytes)
+		{
+			d.packets += end - first;
+			d.bytes += bytes;
+			continue;
+		}
+
+		if(errno == EIO || errno == EINVAL || errno == ENOPROTOOPT || errno == EOPNOTSUPP)
+		{	//kernel before 4.18 or device without checksum offload
+			cerr << "UDP GSO not supported for " << d.name << ", falling back to sendmmsg" << endl;
+			d.gso = false;
+			send_mmsg(d, first, count);
+			return;
+		}
+
+		failed(d, end - first);
+	}
+}
+
+void udp_relay::failed(udp_relay_destination &d, int count)
+{
+	if(errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+		d.dropped += count;
+	else
+		d.errors += count;
+}
+
+void udp_relay::stop()
+{
+	if(!thread.joinable())
+		return;
+
+	stopping = true;
+	thread.join();
+
+	for(const udp_relay_destination &d : targets)
+		cout << "Fanout " << d.name << ": " << d.packets << " packets, " << d.bytes / 1000 << " kB, dropped " <<
+			d.dropped << ", errors " << d.errors << ", " << d.syscalls << " sends" << endl;
+
+	cout << "Fanout relay CPU " << cpu << " ms" << endl;
+}
+
+const vector<udp_relay_destination> &udp_relay::destinations() const
+{
+	return targets;
+}
+
+double udp_relay::cpu_ms() const
+{
+	return cpu;
+}
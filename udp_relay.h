@@ -0,0 +1,134 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Fan-out of encoded stream datagrams to multiple destinations
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef UDP_RELAY_H
+#define UDP_RELAY_H
+
+// Network Hardware Video Encoder
+#include "nhve.h"
+
+#include "options.h"
+#include "udp_fec.h"
+#include "udp_sender.h"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+#include <sys/socket.h>
+
+//relay receives and sends up to UDP_RELAY_BATCH datagrams per syscall with --udp-batch (see udp_sender.h)
+const int UDP_RELAY_BATCH = 64;
+
+struct udp_relay_config
+{
+	std::vector<std::string> destinations; //host:port besides positional host and port
+	int ttl; //multicast time to live
+	UdpBatch batch;
+	float pacing; //fraction of frame interval to spread frame datagrams over, 0 to send bursts
+	int framerate;
+	int fec; //datagrams per parity, 0 without FEC
+	int fec_interleave;
+};
+
+//--fanout=HOST:PORT,HOST:PORT,... --multicast-ttl=N --udp-batch=off/mmsg/gso --pacing=F
+//--fec=K --fec-interleave=D, returns -1 on invalid input
+int udp_relay_config_parse(const options &opts, int framerate, udp_relay_config *config);
+
+struct udp_relay_destination
+{
+	std::string name; //host:port
+	int socket;
+	uint64_t packets;
+	uint64_t bytes;
+	uint64_t dropped; //socket buffer full (destination or its link too slow)
+	uint64_t errors; //e.g. nobody listening on loopback
+	uint64_t syscalls; //sends
+	bool gso; //UDP_SEGMENT works for this destination
+};
+
+//encoder sends to single host and port, the relay sends each datagram to many:
+//- encoder (NHVE or mlsp_sender) is redirected to relay socket on loopback (packets are encoded and sent once)
+//- relay thread sends every datagram to positional host:port and all --fanout destinations
+//- multicast groups are ordinary destinations (with --multicast-ttl)
+//- each destination has its own non-blocking connected socket and socket buffer,
+//  datagrams for destination with full buffer are dropped (counted), others are not stalled
+//
+//with pacing the relay also smooths bursts (keyframes) for all destinations:
+//- datagrams are queued and sent through token bucket
+//- each arrival sets the rate so that the queue is sent within pacing fraction of frame interval
+//- the bucket holds a few datagrams so P-frames still go out almost at once
+//
+//with FEC datagrams get FEC header and parity datagrams are added (see udp_fec.h)
+//- groups are closed after the last datagram of MLSP subframe so parity doesn't wait for the next frame
+//  (or after a few ms without datagrams if subframe end doesn't come)
+//- receiving side needs rnhve-fec-receiver in front of the decoder
+class udp_relay
+{
+public:
+	explicit udp_relay(const udp_relay_config &config);
+	~udp_relay();
+
+	//without --fanout, --pacing and --fec does nothing, otherwise starts relay and redirects net_config to it
+	//port_offset is added to --fanout ports (e.g. camera index), returns -1 on failure
+	int start(nhve_net_config *net_config, int port_offset);
+
+	//forwards datagrams already received and prints per destination statistics
+	void stop();
+
+	//valid after stop
+	const std::vector<udp_relay_destination> &destinations() const;
+	double cpu_ms() const; //relay thread CPU time
+
+private:
+	void run();
+	void run_paced();
+	void enqueue(int count);
+	int receive();
+	int protect(int count);
+	int protect_flush();
+	int append_parity(int count);
+	void forward(int count);
+	void send_single(udp_relay_destination &d, int first, int end);
+	void send_mmsg(udp_relay_destination &d, int first, int end);
+	void send_gso(udp_relay_destination &d, int count);
+	void failed(udp_relay_destination &d, int count);
+
+	const udp_relay_config config;
+
+	int receiver;
+	std::vector<udp_relay_destination> targets;
+
+	//UDP_RELAY_BATCH datagram slots, received with recvmmsg (after FEC header headroom) and sent from the same memory
+	//the rest of iovecs/messages points to FEC parity datagrams
+	std::vector<uint8_t> buffer;
+	std::vector<iovec> iovecs;
+	std::vector<mmsghdr> messages;
+	std::vector<int> sizes;
+	double cpu;
+
+	//pacing queue with spare datagram buffers (reused, no allocation per datagram)
+	std::deque<std::vector<uint8_t> > queue;
+	std::vector<std::vector<uint8_t> > spare;
+	size_t queued; //bytes
+
+	std::unique_ptr<fec_encoder> fec;
+
+	std::atomic<bool> stopping;
+	std::thread thread;
+};
+
+#endif
@@ -0,0 +1,224 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Batched sending of encoded frames as MLSP datagrams
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#include "udp_sender.h"
+#include "mlsp_packet.h"
+
+#include <algorithm>
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <unistd.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103 //linux/udp.h, older glibc headers don't have it
+#endif
+
+using namespace std;
+
+//datagrams per sendmmsg
+const int MMSG_BATCH = 64;
+
+int udp_batch_parse(const options &opts, UdpBatch *batch)
+{
+	const string name = options_get(opts, "udp-batch", "gso");
+
+	if(name == "off")
+		*batch = UDP_BATCH_OFF;
+	else if(name == "mmsg")
+		*batch = UDP_BATCH_MMSG;
+	else if(name == "gso")
+		*batch = UDP_BATCH_GSO;
+	else
+	{
+		cerr << "udp batch has to be off, mmsg or gso" << endl;
+		return -1;
+	}
+
+	return 0;
+}
+
+mlsp_sender::mlsp_sender(UdpBatch batch, int subframes) :
+	batch(batch), socket(-1), address(), address_size(0), framenumbers(subframes, 0), subframes(subframes), sends(0)
+{
+}
+
+mlsp_sender::~mlsp_sender()
+{
+	if(socket >= 0)
+		close(socket);
+}
+
+int mlsp_sender::open(const nhve_net_config &net_config)
+{
+	sockaddr_in *to = (sockaddr_in*)&address;
+	to->sin_family = AF_INET;
+	to->sin_port = htons(net_config.port);
+	address_size = sizeof(sockaddr_in);
+
+	if(inet_pton(AF_INET, net_config.ip, &to->sin_addr) != 1)
+	{
+		cerr << "invalid ip address " << net_config.ip << endl;
+		return -1;
+	}
+
+	//not connected like NHVE, ICMP unreachable (receiver not started yet) doesn't fail sends
+	if( (socket = ::socket(AF_INET, SOCK_DGRAM, 0)) < 0 )
+	{
+		cerr << "unable to create socket: " << strerror(errno) << endl;
+		return -1;
+	}
+
+	return 0;
+}
+
+int mlsp_sender::send(const uint8_t *data, int size, uint8_t subframe)
+{
+	const int packets = (size + MLSP_MAX_PAYLOAD - 1) / MLSP_MAX_PAYLOAD;
+	const uint16_t framenumber = framenumbers[subframe]++;
+
+	if(packets > 0xFFFF)
+	{
+		cerr << "frame too large for MLSP (" << size << " bytes)" << endl;
+		return NHVE_ERROR;
+	}
+
+	headers.resize(packets * MLSP_HEADER);
+	iovecs.resize(2 * packets);
+	messages.resize(packets);
+
+	for(int p = 0; p < packets; ++p)
+	{
+		const mlsp_header header = {framenumber, subframes, subframe, (uint16_t)packets, (uint16_t)p};
+		mlsp_header_write(header, &headers[p * MLSP_HEADER]);
+
+		iovecs[2 * p].iov_base = &headers[p * MLSP_HEADER];
+		iovecs[2 * p].iov_len = MLSP_HEADER;
+		iovecs[2 * p + 1].iov_base = (void*)(data + p * MLSP_MAX_PAYLOAD);
+		iovecs[2 * p + 1].iov_len = min(MLSP_MAX_PAYLOAD, size - p * MLSP_MAX_PAYLOAD);
+
+		messages[p].msg_hdr = msghdr();
+		messages[p].msg_hdr.msg_name = &address;
+		messages[p].msg_hdr.msg_namelen = address_size;
+		messages[p].msg_hdr.msg_iov = &iovecs[2 * p];
+		messages[p].msg_hdr.msg_iovlen = 2;
+	}
+
+	if(batch == UDP_BATCH_OFF)
+		return send_single(0, packets);
+	if(batch == UDP_BATCH_MMSG)
+		return send_mmsg(0, packets);
+
+	return send_gso(packets);
+}
+
+int mlsp_sender::send_single(int first, int end)
+{
+	for(int i = first; i < end; ++i)
+	{
+		++sends;
+
+		if(sendmsg(socket, &messages[i].msg_hdr, 0) < 0)
+		{
+			cerr << "failed to send datagram: " << strerror(errno) << endl;
+			return NHVE_ERROR;
+		}
+	}
+
+	return NHVE_OK;
+}
+
+int mlsp_sender::send_mmsg(int first, int end)
+{
+	while(first < end)
+	{
+		++sends;
+
+		const int sent = sendmmsg(socket, &messages[first], min(end - first, MMSG_BATCH), 0);
+
+		if(sent <= 0)
+		{
+			cerr << "failed to send datagrams: " << strerror(errno) << endl;
+			return NHVE_ERROR;
+		}
+
+		first += sent;
+	}
+
+	return NHVE_OK;
+}
+
+//full datagrams (and the last shorter one) go as UDP_SEGMENT sends of up to UDP_GSO_BYTES
+int mlsp_sender::send_gso(int count)
+{
+	const int segment = MLSP_HEADER + MLSP_MAX_PAYLOAD;
+	const int segments = min(UDP_GSO_SEGMENTS, UDP_GSO_BYTES / segment);
+
+	union
+	{
+		char buf[CMSG_SPACE(sizeof(uint16_t))];
+		cmsghdr align;
+	} control;
+
+	for(int first = 0, end; first < count; first = end)
+	{
+		end = min(count, first + segments);
+
+		if(end - first == 1)
+		{
+			if(send_single(first, end) != NHVE_OK)
+				return NHVE_ERROR;
+			continue;
+		}
+
+		msghdr message = msghdr();
+		message.msg_name = &address;
+		message.msg_namelen = address_size;
+		message.msg_iov = &iovecs[2 * first];
+		message.msg_iovlen = 2 * (end - first);
+		message.msg_control = control.buf;
+		message.msg_controllen = sizeof(control.buf);
+
+		cmsghdr *cm = CMSG_FIRSTHDR(&message);
+		cm->cmsg_level = SOL_UDP;
+		cm->cmsg_type = UDP_SEGMENT;
+		cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+		*(uint16_t*)CMSG_DATA(cm) = segment;
+
+		++sends;
+
+		if(sendmsg(socket, &message, 0) >= 0)
+			continue;
+
+		if(errno == EIO || errno == EINVAL || errno == ENOPROTOOPT || errno == EOPNOTSUPP)
+		{	//kernel before 4.18 or device without checksum offload
+			cerr << "UDP GSO not supported, falling back to sendmmsg" << endl;
+			batch = UDP_BATCH_MMSG;
+			return send_mmsg(first, count);
+		}
+
+		cerr << "failed to send datagrams: " << strerror(errno) << endl;
+		return NHVE_ERROR;
+	}
+
+	return NHVE_OK;
+}
+
+uint64_t mlsp_sender::syscalls() const
+{
+	return sends;
+}
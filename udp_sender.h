@@ -0,0 +1,77 @@
+/*
+ * Realsense Network Hardware Video Encoder
+ *
+ * Batched sending of encoded frames as MLSP datagrams
+ *
+ * Copyright 2020 (C) Bartosz Meglicki <meglickib@gmail.com>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ */
+
+#ifndef UDP_SENDER_H
+#define UDP_SENDER_H
+
+// Network Hardware Video Encoder
+#include "nhve.h"
+
+#include "options.h"
+
+#include <vector>
+#include <stdint.h>
+#include <sys/socket.h>
+
+//how datagrams of encoded frame (and relay batches) go through the kernel
+//- UDP_BATCH_OFF NHVE sends, one syscall per datagram (relay: one recv/send per datagram and destination)
+//- UDP_BATCH_MMSG sendmmsg (relay: recvmmsg/sendmmsg), up to 64 datagrams per syscall
+//- UDP_BATCH_GSO like MMSG but equal size datagrams go as one UDP_SEGMENT (GSO) send,
+//  segmented by the kernel (or NIC), falls back to MMSG if unsupported
+enum UdpBatch {UDP_BATCH_OFF, UDP_BATCH_MMSG, UDP_BATCH_GSO};
+
+//UDP GSO limits, segments per send (64 before Linux 5.x) and IP payload
+const int UDP_GSO_SEGMENTS = 64;
+const int UDP_GSO_BYTES = 65000;
+
+//--udp-batch=off/mmsg/gso (default gso), returns -1 on invalid input
+int udp_batch_parse(const options &opts, UdpBatch *batch);
+
+//packetizes encoded frames like MLSP (the same datagrams NHVE sends) and sends all of them at once:
+//- header and payload of each datagram are gathered from separate buffers (encoded data is not copied)
+//- framenumber is counted per subframe, the n-th frame of every subframe has the same number
+//- blocking socket like NHVE, a frame is either sent whole or send fails
+class mlsp_sender
+{
+public:
+	//subframes like NHVE hw_size + aux_size, UDP_BATCH_OFF sends datagram per syscall like NHVE (for comparison)
+	mlsp_sender(UdpBatch batch, int subframes);
+	~mlsp_sender();
+
+	//returns -1 on failure
+	int open(const nhve_net_config &net_config);
+
+	//returns NHVE_OK or NHVE_ERROR
+	int send(const uint8_t *data, int size, uint8_t subframe);
+
+	uint64_t syscalls() const;
+
+private:
+	int send_single(int first, int end);
+	int send_mmsg(int first, int end);
+	int send_gso(int count);
+
+	UdpBatch batch;
+	int socket;
+	sockaddr_storage address;
+	socklen_t address_size;
+	std::vector<uint16_t> framenumbers;
+	uint8_t subframes;
+
+	std::vector<uint8_t> headers;
+	std::vector<iovec> iovecs; //header and payload per datagram
+	std::vector<mmsghdr> messages;
+	uint64_t sends;
+};
+
+#endif